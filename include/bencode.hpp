@@ -2,19 +2,29 @@
 #define INC_BENCODE_HPP
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cctype>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <limits>
 #include <map>
 #include <memory>
+#include <new>
+#include <optional>
 #include <sstream>
-#include <stack>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -23,97 +33,383 @@
 #  define BENCODE_HAS_CHARCONV
 #endif
 
+#if __has_include(<span>)
+#  include <span>
+#  ifdef __cpp_lib_span
+#    define BENCODE_HAS_SPAN
+#  endif
+#endif
+
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#  define BENCODE_HAS_EXCEPTIONS
+#endif
+
+#if __has_include(<memory_resource>)
+#  include <memory_resource>
+#  ifdef __cpp_lib_memory_resource
+#    define BENCODE_HAS_PMR
+#  endif
+#endif
+
 #if __has_include(<boost/variant.hpp>)
 #  include <boost/variant.hpp>
 #  define BENCODE_HAS_BOOST
 #endif
 
+#if defined(__cpp_nontype_template_args) && \
+    __cpp_nontype_template_args >= 201911L
+#  define BENCODE_HAS_CLASS_NTTP
+#endif
+
+#if defined(__cpp_impl_three_way_comparison) && __has_include(<compare>)
+#  include <compare>
+#  ifdef __cpp_lib_three_way_comparison
+#    define BENCODE_HAS_THREE_WAY_COMPARISON
+#  endif
+#endif
+
+#define BENCODE_EXPAND(x) x
+#define BENCODE_FOR_EACH_1(m, t, x) m(t, x)
+#define BENCODE_FOR_EACH_2(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_1(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_3(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_2(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_4(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_3(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_5(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_4(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_6(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_5(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_7(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_6(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_8(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_7(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_9(m, t, x, ...)                                      \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_8(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_10(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_9(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_11(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_10(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_12(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_11(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_13(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_12(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_14(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_13(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_15(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_14(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_16(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_15(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_17(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_16(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_18(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_17(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_19(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_18(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_20(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_19(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_21(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_20(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_22(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_21(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_23(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_22(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_24(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_23(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_25(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_24(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_26(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_25(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_27(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_26(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_28(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_27(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_29(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_28(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_30(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_29(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_31(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_30(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_32(m, t, x, ...)                                     \
+  m(t, x), BENCODE_EXPAND(BENCODE_FOR_EACH_31(m, t, __VA_ARGS__))
+#define BENCODE_FOR_EACH_N(                                                   \
+  _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16,      \
+  _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30,       \
+  _31, _32, N, ...) N
+#define BENCODE_FOR_EACH(m, t, ...)                                           \
+  BENCODE_EXPAND(BENCODE_FOR_EACH_N(                                          \
+    __VA_ARGS__,                                                              \
+    BENCODE_FOR_EACH_32, BENCODE_FOR_EACH_31, BENCODE_FOR_EACH_30,            \
+    BENCODE_FOR_EACH_29, BENCODE_FOR_EACH_28, BENCODE_FOR_EACH_27,            \
+    BENCODE_FOR_EACH_26, BENCODE_FOR_EACH_25, BENCODE_FOR_EACH_24,            \
+    BENCODE_FOR_EACH_23, BENCODE_FOR_EACH_22, BENCODE_FOR_EACH_21,            \
+    BENCODE_FOR_EACH_20, BENCODE_FOR_EACH_19, BENCODE_FOR_EACH_18,            \
+    BENCODE_FOR_EACH_17, BENCODE_FOR_EACH_16, BENCODE_FOR_EACH_15,            \
+    BENCODE_FOR_EACH_14, BENCODE_FOR_EACH_13, BENCODE_FOR_EACH_12,            \
+    BENCODE_FOR_EACH_11, BENCODE_FOR_EACH_10, BENCODE_FOR_EACH_9,             \
+    BENCODE_FOR_EACH_8, BENCODE_FOR_EACH_7, BENCODE_FOR_EACH_6,               \
+    BENCODE_FOR_EACH_5, BENCODE_FOR_EACH_4, BENCODE_FOR_EACH_3,               \
+    BENCODE_FOR_EACH_2, BENCODE_FOR_EACH_1, ~                                 \
+  )(m, t, __VA_ARGS__))
+
 namespace bencode {
 
   template<template<typename ...> typename T>
   struct variant_traits;
 
+  namespace detail {
+    template<typename Exception, typename ...Args>
+    [[noreturn]] inline void throw_exception([[maybe_unused]] Args &&...args) {
+#ifdef BENCODE_HAS_EXCEPTIONS
+      throw Exception(std::forward<Args>(args)...);
+#else
+      std::abort();
+#endif
+    }
+
+    // The 64-bit FNV-1a hash. This is used for dict keys since, unlike
+    // `std::hash`, it can be computed at compile time for `key_literal`s. It
+    // can also be fed its input a piece at a time via `fnv1a_update`.
+    inline constexpr std::uint64_t fnv1a_basis = 14695981039346656037ull;
+
+    inline constexpr std::uint64_t
+    fnv1a_update(std::uint64_t hash, std::string_view s) noexcept {
+      for(char c : s) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+      }
+      return hash;
+    }
+
+    inline constexpr std::size_t fnv1a(std::string_view s) noexcept {
+      return static_cast<std::size_t>(fnv1a_update(fnv1a_basis, s));
+    }
+
+    inline constexpr std::size_t decimal_digits(std::size_t n) noexcept {
+      std::size_t digits = 1;
+      for(; n >= 10; n /= 10)
+        digits++;
+      return digits;
+    }
+  }
+
+  // A dict key known at compile time, holding its length, hash, and encoded
+  // form (e.g. `4:info`). Comparing against a key literal checks the length
+  // first and then compares a fixed number of bytes, and encoding one is a
+  // single `write`. With C++20, you can also write `key<"info">`.
+  template<std::size_t N>
+  struct key_literal {
+    static constexpr std::size_t prefix_size = detail::decimal_digits(N) + 1;
+
+    constexpr key_literal(const char (&s)[N + 1]) noexcept
+      : key_literal(std::string_view(s, N)) {}
+
+    constexpr explicit key_literal(std::string_view s) noexcept
+      : token{}, hash(detail::fnv1a(s)) {
+      assert(s.size() == N);
+      std::size_t n = N;
+      for(std::size_t i = prefix_size - 1; i != 0; i--, n /= 10)
+        token[i - 1] = static_cast<char>('0' + n % 10);
+      token[prefix_size - 1] = ':';
+      for(std::size_t i = 0; i != N; i++)
+        token[prefix_size + i] = s[i];
+    }
+
+    constexpr std::size_t size() const noexcept { return N; }
+    constexpr const char * data() const noexcept {
+      return token + prefix_size;
+    }
+
+    constexpr std::string_view view() const noexcept { return {data(), N}; }
+    constexpr operator std::string_view() const noexcept { return view(); }
+
+    constexpr std::string_view encoded() const noexcept {
+      return {token, sizeof(token)};
+    }
+
+    // These are public so that key literals can be template parameters.
+    char token[prefix_size + N];
+    std::size_t hash;
+  };
+
+  template<std::size_t M>
+  key_literal(const char (&)[M]) -> key_literal<M - 1>;
+
+#ifdef BENCODE_HAS_CLASS_NTTP
+  template<key_literal Key>
+  inline constexpr auto key = Key;
+#endif
+
+  namespace detail {
+    template<typename T>
+    inline constexpr bool is_key_literal_v = false;
+    template<std::size_t N>
+    inline constexpr bool is_key_literal_v<key_literal<N>> = true;
+
+    template<typename T>
+    using enable_if_string_like_t = std::enable_if_t<
+      !is_key_literal_v<T> && std::is_convertible_v<const T &, std::string_view>
+    >;
+
+    template<std::size_t N>
+    inline bool key_equal(std::string_view lhs, const key_literal<N> &rhs) {
+      // Compare through `view()` rather than `memcmp`ing `rhs.data()`
+      // directly: GCC can't see the bounds of a pointer into the middle of
+      // `token` and warns that the read overflows it. The size of `view()` is
+      // still the constant `N`, so this inlines to the same fixed-size compare.
+      return lhs == rhs.view();
+    }
+
+    // Pass a lookup key through to a dict whose comparator isn't transparent,
+    // converting key literals to the dict's key type.
+    template<typename Key, typename T>
+    inline decltype(auto) lookup_key(T &&key) {
+      if constexpr(is_key_literal_v<std::decay_t<T>>)
+        return Key(key.view());
+      else
+        return std::forward<T>(key);
+    }
+  }
+
+  template<std::size_t N, typename T,
+           typename = detail::enable_if_string_like_t<T>>
+  inline bool operator ==(const key_literal<N> &lhs, const T &rhs) {
+    return detail::key_equal(rhs, lhs);
+  }
+  template<std::size_t N, typename T,
+           typename = detail::enable_if_string_like_t<T>>
+  inline bool operator ==(const T &lhs, const key_literal<N> &rhs) {
+    return detail::key_equal(lhs, rhs);
+  }
+  template<std::size_t N, typename T,
+           typename = detail::enable_if_string_like_t<T>>
+  inline bool operator !=(const key_literal<N> &lhs, const T &rhs) {
+    return !detail::key_equal(rhs, lhs);
+  }
+  template<std::size_t N, typename T,
+           typename = detail::enable_if_string_like_t<T>>
+  inline bool operator !=(const T &lhs, const key_literal<N> &rhs) {
+    return !detail::key_equal(lhs, rhs);
+  }
+
+#define BENCODE_KEY_LITERAL_RELOP(op)                                         \
+  template<std::size_t N, typename T,                                         \
+           typename = detail::enable_if_string_like_t<T>>                     \
+  inline bool operator op(const key_literal<N> &lhs, const T &rhs) {          \
+    return lhs.view() op std::string_view(rhs);                               \
+  }                                                                           \
+  template<std::size_t N, typename T,                                         \
+           typename = detail::enable_if_string_like_t<T>>                     \
+  inline bool operator op(const T &lhs, const key_literal<N> &rhs) {          \
+    return std::string_view(lhs) op rhs.view();                               \
+  }
+
+  BENCODE_KEY_LITERAL_RELOP(<)
+  BENCODE_KEY_LITERAL_RELOP(<=)
+  BENCODE_KEY_LITERAL_RELOP(>)
+  BENCODE_KEY_LITERAL_RELOP(>=)
+
 #define BENCODE_MAP_PROXY_FN_1(name, specs)                                   \
   template<typename T>                                                        \
-  auto name(T &&t) specs { return proxy_->name(std::forward<T>(t)); }
+  auto name(T &&t) specs {                                                    \
+    return map_.name(detail::lookup_key<Key>(std::forward<T>(t)));            \
+  }
 
 #define BENCODE_MAP_PROXY_FN_N(name, specs)                                   \
   template<typename ...T>                                                     \
-  auto name(T &&...t) specs { return proxy_->name(std::forward<T>(t)...); }
+  auto name(T &&...t) specs { return map_.name(std::forward<T>(t)...); }
 
-  // A proxy of std::map, since the standard doesn't require that map support
-  // incomplete types.
-  template<typename Key, typename Value>
+  // A wrapper around std::map for use as a dict type. The standard doesn't
+  // require that map support incomplete value types, but every major standard
+  // library does, so the map is stored inline rather than boxed on the heap.
+  // This makes moving a dict O(1) and noexcept without an extra allocation.
+  template<typename Key, typename Value,
+           typename Allocator = std::allocator<std::pair<const Key, Value>>>
   class map_proxy {
   public:
-    using map_type = std::map<Key, Value>;
+    using map_type = std::map<Key, Value, std::less<Key>, Allocator>;
     using key_type = Key;
     using mapped_type = Value;
     using value_type = std::pair<const Key, Value>;
+    using allocator_type = Allocator;
+    using node_type = typename map_type::node_type;
+    using insert_return_type = typename map_type::insert_return_type;
 
     // Construction/assignment
-    map_proxy() : proxy_(new map_type()) {}
-    map_proxy(const map_proxy &rhs) : proxy_(new map_type(*rhs.proxy_)) {}
-    map_proxy(map_proxy &&rhs) noexcept : proxy_(std::move(rhs.proxy_)) {}
-    map_proxy(std::initializer_list<value_type> i) : proxy_(new map_type(i)) {}
+    map_proxy() = default;
+    explicit map_proxy(const allocator_type &alloc) : map_(alloc) {}
+    map_proxy(const map_proxy &rhs) = default;
+    map_proxy(const map_proxy &rhs, const allocator_type &alloc)
+      : map_(rhs.map_, alloc) {}
+    map_proxy(map_proxy &&rhs) = default;
+    map_proxy(map_proxy &&rhs, const allocator_type &alloc)
+      : map_(std::move(rhs.map_), alloc) {}
+    map_proxy(std::initializer_list<value_type> i,
+              const allocator_type &alloc = allocator_type())
+      : map_(i, alloc) {}
 
-    map_proxy operator =(const map_proxy &rhs) {
-      *proxy_ = *rhs.proxy_;
-      return *this;
-    }
+    map_proxy & operator =(const map_proxy &rhs) = default;
+    map_proxy & operator =(map_proxy &&rhs) = default;
 
-    map_proxy operator =(const map_proxy &&rhs) {
-      *proxy_ = std::move(*rhs.proxy_);
-      return *this;
+    void swap(map_proxy &rhs) noexcept(
+      std::is_nothrow_swappable_v<map_type>
+    ) {
+      map_.swap(rhs.map_);
     }
 
-    void swap(const map_proxy &rhs) { proxy_->swap(*rhs.proxy); }
+    allocator_type get_allocator() const { return map_.get_allocator(); }
 
-    operator map_type &() { return *proxy_; };
-    operator const map_type &() const { return *proxy_; };
+    operator map_type &() { return map_; };
+    operator const map_type &() const { return map_; };
 
     // Pointer access
-    map_type & operator *() { return *proxy_; }
-    const map_type & operator *() const { return *proxy_; }
-    map_type * operator ->() { return proxy_.get(); }
-    const map_type * operator ->() const { return proxy_.get(); }
+    map_type & operator *() { return map_; }
+    const map_type & operator *() const { return map_; }
+    map_type * operator ->() { return &map_; }
+    const map_type * operator ->() const { return &map_; }
 
     // Element access
     template<typename K>
-    mapped_type & at(K &&k) { return proxy_->at(std::forward<K>(k)); }
+    mapped_type & at(K &&k) {
+      return map_.at(detail::lookup_key<Key>(std::forward<K>(k)));
+    }
     template<typename K>
-    const mapped_type &
-    at(K &&k) const { return proxy_->at(std::forward<K>(k)); }
+    const mapped_type & at(K &&k) const {
+      return map_.at(detail::lookup_key<Key>(std::forward<K>(k)));
+    }
     template<typename K>
-    mapped_type & operator [](K &&k) { return (*proxy_)[std::forward<K>(k)]; }
+    mapped_type & operator [](K &&k) {
+      return map_[detail::lookup_key<Key>(std::forward<K>(k))];
+    }
 
     // Iterators
-    auto begin() noexcept { return proxy_->begin(); }
-    auto begin() const noexcept { return proxy_->begin(); }
-    auto cbegin() const noexcept { return proxy_->cbegin(); }
-    auto end() noexcept { return proxy_->end(); }
-    auto end() const noexcept { return proxy_->end(); }
-    auto cend() const noexcept { return proxy_->cend(); }
-    auto rbegin() noexcept { return proxy_->rbegin(); }
-    auto rbegin() const noexcept { return proxy_->rbegin(); }
-    auto crbegin() const noexcept { return proxy_->crbegin(); }
-    auto rend() noexcept { return proxy_->rend(); }
-    auto rend() const noexcept { return proxy_->rend(); }
-    auto crend() const noexcept { return proxy_->crend(); }
+    auto begin() noexcept { return map_.begin(); }
+    auto begin() const noexcept { return map_.begin(); }
+    auto cbegin() const noexcept { return map_.cbegin(); }
+    auto end() noexcept { return map_.end(); }
+    auto end() const noexcept { return map_.end(); }
+    auto cend() const noexcept { return map_.cend(); }
+    auto rbegin() noexcept { return map_.rbegin(); }
+    auto rbegin() const noexcept { return map_.rbegin(); }
+    auto crbegin() const noexcept { return map_.crbegin(); }
+    auto rend() noexcept { return map_.rend(); }
+    auto rend() const noexcept { return map_.rend(); }
+    auto crend() const noexcept { return map_.crend(); }
 
     // Capacity
-    bool empty() const noexcept { return proxy_->empty(); }
-    auto size() const noexcept { return proxy_->size(); }
-    auto max_size() const noexcept { return proxy_->max_size(); }
+    bool empty() const noexcept { return map_.empty(); }
+    auto size() const noexcept { return map_.size(); }
+    auto max_size() const noexcept { return map_.max_size(); }
 
     // Modifiers
-    void clear() noexcept { proxy_->clear(); }
+    void clear() noexcept { map_.clear(); }
     BENCODE_MAP_PROXY_FN_N(insert,)
     BENCODE_MAP_PROXY_FN_N(insert_or_assign,)
     BENCODE_MAP_PROXY_FN_N(emplace,)
     BENCODE_MAP_PROXY_FN_N(emplace_hint,)
     BENCODE_MAP_PROXY_FN_N(try_emplace,)
     BENCODE_MAP_PROXY_FN_N(erase,)
+    BENCODE_MAP_PROXY_FN_N(extract,)
 
     // Lookup
     BENCODE_MAP_PROXY_FN_1(count, const)
@@ -126,18 +422,25 @@ namespace bencode {
     BENCODE_MAP_PROXY_FN_1(upper_bound,)
     BENCODE_MAP_PROXY_FN_1(upper_bound, const)
 
-    auto key_comp() const { return proxy_->key_comp(); }
-    auto value_comp() const { return proxy_->value_comp(); }
+    auto key_comp() const { return map_.key_comp(); }
+    auto value_comp() const { return map_.value_comp(); }
 
   private:
-    std::unique_ptr<map_type> proxy_;
+    map_type map_;
   };
 
+  template<typename Key, typename Value, typename Allocator>
+  inline void swap(map_proxy<Key, Value, Allocator> &lhs,
+                   map_proxy<Key, Value, Allocator> &rhs)
+  noexcept(noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+  }
+
 #define BENCODE_MAP_PROXY_RELOP(op)                                           \
-  template<typename Key, typename Value>                                      \
-  bool operator op(const map_proxy<Key, Value> &lhs,                          \
-                   const map_proxy<Key, Value> &rhs) {                        \
-    return *lhs == *rhs;                                                      \
+  template<typename Key, typename Value, typename Allocator>                  \
+  bool operator op(const map_proxy<Key, Value, Allocator> &lhs,               \
+                   const map_proxy<Key, Value, Allocator> &rhs) {             \
+    return *lhs op *rhs;                                                      \
   }
 
   BENCODE_MAP_PROXY_RELOP(==)
@@ -147,6 +450,44 @@ namespace bencode {
   BENCODE_MAP_PROXY_RELOP(>)
   BENCODE_MAP_PROXY_RELOP(<)
 
+  namespace detail {
+    // How many values this thread is currently copying or destroying
+    // recursively. Recursing is faster than managing our own stack, so we
+    // only switch to that once we're `max_recursion` levels deep.
+    inline thread_local std::size_t recursion_depth = 0;
+    inline constexpr std::size_t max_recursion = 128;
+
+    class recursion_guard {
+    public:
+      recursion_guard() noexcept { ++recursion_depth; }
+      ~recursion_guard() { --recursion_depth; }
+
+      recursion_guard(const recursion_guard &) = delete;
+      recursion_guard & operator =(const recursion_guard &) = delete;
+
+      bool exceeded() const noexcept {
+        return recursion_depth > max_recursion;
+      }
+    };
+
+    template<typename T>
+    inline const T empty_value{};
+
+    template<typename Data>
+    typename Data::base_type copy_data(const Data &value);
+
+    template<typename Data>
+    void destroy_data(Data &value) noexcept;
+
+    template<bool Equality, typename Data>
+    int compare_data(const Data &lhs, const Data &rhs, std::size_t depth = 0);
+  }
+
+#define BENCODE_DATA_RELOP(op, equality)                                      \
+  friend bool operator op(const basic_data &lhs, const basic_data &rhs) {     \
+    return detail::compare_data<equality>(lhs, rhs) op 0;                     \
+  }
+
   template<template<typename ...> typename Variant, typename I, typename S,
            template<typename ...> typename L, template<typename ...> typename D>
   struct basic_data : Variant<I, S, L<basic_data<Variant, I, S, L, D>>,
@@ -159,9 +500,49 @@ namespace bencode {
     using base_type = Variant<integer, string, list, dict>;
     using base_type::base_type;
 
+    // Copying and destroying nested lists and dicts would otherwise recurse
+    // once per level, overflowing the stack for deeply-nested data, so both
+    // use an explicit stack instead.
+    basic_data() = default;
+    basic_data(const basic_data &rhs)
+      : basic_data(rhs, detail::recursion_guard()) {}
+    basic_data(basic_data &&rhs) = default;
+    ~basic_data() { detail::destroy_data(*this); }
+
+    basic_data & operator =(const basic_data &rhs) {
+      if(this != &rhs)
+        *this = basic_data(rhs);
+      return *this;
+    }
+    basic_data & operator =(basic_data &&rhs) = default;
+
     base_type & base() & { return *this; }
     base_type && base() && { return *this; }
     const base_type & base() const & { return *this; }
+
+    // Non-template friends, so that these are preferred over the variant's
+    // own operators, which recurse once per level of nesting. (In C++20,
+    // `std::variant`'s `<=>` can't even be resolved for a recursive type.)
+    BENCODE_DATA_RELOP(==, true)
+    BENCODE_DATA_RELOP(!=, true)
+    BENCODE_DATA_RELOP(>=, false)
+    BENCODE_DATA_RELOP(<=, false)
+    BENCODE_DATA_RELOP(>, false)
+    BENCODE_DATA_RELOP(<, false)
+
+#ifdef BENCODE_HAS_THREE_WAY_COMPARISON
+    friend std::strong_ordering
+    operator <=>(const basic_data &lhs, const basic_data &rhs) {
+      return detail::compare_data<false>(lhs, rhs) <=> 0;
+    }
+#endif
+  private:
+    basic_data(const basic_data &rhs, const detail::recursion_guard &guard)
+      : base_type(guard.exceeded() ? detail::empty_value<base_type> :
+                  rhs.base()) {
+      if(guard.exceeded())
+        base() = detail::copy_data(rhs);
+    }
   };
 
   template<typename T>
@@ -198,390 +579,7138 @@ namespace bencode {
     }
   };
 
-  using data = basic_data<std::variant, long long, std::string, std::vector,
-                          map_proxy>;
-  using data_view = basic_data<std::variant, long long, std::string_view,
-                               std::vector, map_proxy>;
+  // A view of a sequence of bytes. This is like `std::string_view`, but over
+  // `std::byte`, and is used as the string type of `byte_data_view`.
+  class bytes_view {
+  public:
+    using value_type = std::byte;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::byte *;
+    using const_pointer = const std::byte *;
+    using reference = const std::byte &;
+    using const_reference = const std::byte &;
+    using iterator = const std::byte *;
+    using const_iterator = const std::byte *;
 
-#ifdef BENCODE_HAS_BOOST
-  using boost_data = basic_data<boost::variant, long long, std::string,
-                                std::vector, map_proxy>;
-  using boost_data_view = basic_data<boost::variant, long long,
-                                     std::string_view, std::vector, map_proxy>;
+    constexpr bytes_view() noexcept = default;
+    constexpr bytes_view(const std::byte *data, size_type size) noexcept
+      : data_(data), size_(size) {}
+    bytes_view(const std::uint8_t *data, size_type size) noexcept
+      : data_(reinterpret_cast<const std::byte *>(data)), size_(size) {}
+    explicit bytes_view(std::string_view s) noexcept
+      : data_(reinterpret_cast<const std::byte *>(s.data())),
+        size_(s.size()) {}
 
-  template<>
-  struct variant_traits<boost::variant> {
-    template<typename Visitor, typename ...Variants>
-    static decltype(auto)
-    visit(Visitor &&visitor, Variants &&...variants) {
-      return boost::apply_visitor(std::forward<Visitor>(visitor),
-                                  std::forward<Variants>(variants).base()...);
+#ifdef BENCODE_HAS_SPAN
+    constexpr bytes_view(std::span<const std::byte> s) noexcept
+      : data_(s.data()), size_(s.size()) {}
+    bytes_view(std::span<const std::uint8_t> s) noexcept
+      : bytes_view(s.data(), s.size()) {}
+
+    constexpr operator std::span<const std::byte>() const noexcept {
+      return {data_, size_};
     }
+#endif
 
-    template<typename Type, typename Variant>
-    inline static decltype(auto) get_if(Variant *variant) {
-      return boost::get<Type>(variant);
+    constexpr const std::byte * data() const noexcept { return data_; }
+    constexpr size_type size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+
+    constexpr iterator begin() const noexcept { return data_; }
+    constexpr iterator end() const noexcept { return data_ + size_; }
+    constexpr const std::byte & operator [](size_type i) const noexcept {
+      return data_[i];
     }
 
-    template<typename Type, typename Variant>
-    inline static decltype(auto) get_if(const Variant *variant) {
-      return boost::get<Type>(variant);
+    // View these bytes as characters.
+    std::string_view chars() const noexcept {
+      return std::string_view(reinterpret_cast<const char *>(data_), size_);
     }
 
-    template<typename Variant>
-    inline static auto index(const Variant &variant) {
-      return variant.which();
+    // Compare lexicographically by unsigned byte value, as bencode requires
+    // for sorting dict keys.
+    int compare(const bytes_view &rhs) const noexcept {
+      auto len = (std::min)(size_, rhs.size_);
+      if(int r = len ? std::memcmp(data_, rhs.data_, len) : 0)
+        return r;
+      return size_ < rhs.size_ ? -1 : size_ > rhs.size_ ? 1 : 0;
     }
+  private:
+    const std::byte *data_ = nullptr;
+    size_type size_ = 0;
   };
-#endif
 
-  using integer = data::integer;
-  using string = data::string;
-  using list = data::list;
-  using dict = data::dict;
+#define BENCODE_BYTES_VIEW_RELOP(op)                                          \
+  inline bool operator op(const bytes_view &lhs, const bytes_view &rhs) {     \
+    return lhs.compare(rhs) op 0;                                             \
+  }
 
-  using integer_view = data_view::integer;
-  using string_view = data_view::string;
-  using list_view = data_view::list;
-  using dict_view = data_view::dict;
+  BENCODE_BYTES_VIEW_RELOP(==)
+  BENCODE_BYTES_VIEW_RELOP(!=)
+  BENCODE_BYTES_VIEW_RELOP(>=)
+  BENCODE_BYTES_VIEW_RELOP(<=)
+  BENCODE_BYTES_VIEW_RELOP(>)
+  BENCODE_BYTES_VIEW_RELOP(<)
 
-  enum eof_behavior {
-    check_eof,
-    no_check_eof
+  // A handle to a string stored in a `key_table`. Handles are as cheap to copy
+  // as a pointer, and two handles from the same table are equal exactly when
+  // they point to the same string. The table must outlive its handles.
+  class interned_string {
+  public:
+    constexpr interned_string() noexcept = default;
+
+    const char * data() const noexcept { return value_.data(); }
+    std::size_t size() const noexcept { return value_.size(); }
+    bool empty() const noexcept { return value_.empty(); }
+
+    std::string_view view() const noexcept { return value_; }
+    operator std::string_view() const noexcept { return value_; }
+
+    int compare(const interned_string &rhs) const noexcept {
+      if(data() == rhs.data() && size() == rhs.size())
+        return 0;
+      return value_.compare(rhs.value_);
+    }
+
+    int compare(std::string_view rhs) const noexcept {
+      return value_.compare(rhs);
+    }
+  private:
+    friend class key_table;
+    explicit interned_string(std::string_view value) noexcept
+      : value_(value) {}
+
+    std::string_view value_;
   };
 
-  template<typename Data, typename Iter>
-  Data basic_decode(Iter &begin, Iter end);
+  inline bool
+  operator ==(const interned_string &lhs, const interned_string &rhs) noexcept {
+    // Different strings from the same table never share storage, so we only
+    // need to look at the contents if the handles came from different tables.
+    if(lhs.data() == rhs.data())
+      return lhs.size() == rhs.size();
+    return lhs.view() == rhs.view();
+  }
 
-  namespace detail {
+  inline bool
+  operator !=(const interned_string &lhs, const interned_string &rhs) noexcept {
+    return !(lhs == rhs);
+  }
 
-    template<typename Integer>
-    inline void check_overflow(Integer value, Integer digit) {
-      using limits = std::numeric_limits<Integer>;
-      if((value > (limits::max)() / 10) ||
-         (value == (limits::max)() / 10 && digit > (limits::max)() % 10))
-        throw std::invalid_argument("integer overflow");
+#define BENCODE_INTERNED_STRING_RELOP(op)                                     \
+  inline bool operator op(const interned_string &lhs,                         \
+                          std::string_view rhs) noexcept {                    \
+    return lhs.compare(rhs) op 0;                                             \
+  }                                                                           \
+  inline bool operator op(std::string_view lhs,                               \
+                          const interned_string &rhs) noexcept {              \
+    return 0 op rhs.compare(lhs);                                             \
+  }
+
+  BENCODE_INTERNED_STRING_RELOP(==)
+  BENCODE_INTERNED_STRING_RELOP(!=)
+  BENCODE_INTERNED_STRING_RELOP(>=)
+  BENCODE_INTERNED_STRING_RELOP(<=)
+  BENCODE_INTERNED_STRING_RELOP(>)
+  BENCODE_INTERNED_STRING_RELOP(<)
+
+#define BENCODE_INTERNED_STRING_ORDER(op)                                     \
+  inline bool operator op(const interned_string &lhs,                         \
+                          const interned_string &rhs) noexcept {              \
+    return lhs.compare(rhs) op 0;                                             \
+  }
+
+  BENCODE_INTERNED_STRING_ORDER(>=)
+  BENCODE_INTERNED_STRING_ORDER(<=)
+  BENCODE_INTERNED_STRING_ORDER(>)
+  BENCODE_INTERNED_STRING_ORDER(<)
+
+  // A table of interned strings, used for the dict keys of `interned_data`.
+  // Each distinct key is only allocated the first time it's interned; after
+  // that, interning it again just returns a handle to the existing string.
+  // Tables aren't thread-safe, so either use one table per thread or fill a
+  // table ahead of time and then only call `find` on it from other threads.
+  class key_table {
+  public:
+    key_table() = default;
+    key_table(std::initializer_list<std::string_view> keys) {
+      for(auto &&i : keys)
+        intern(i);
     }
 
-    template<typename Integer>
-    inline void check_underflow(Integer value, Integer digit) {
-      using limits = std::numeric_limits<Integer>;
-      if((value < (limits::min)() / 10) ||
-         (value == (limits::min)() / 10 && digit < (limits::min)() % 10))
-        throw std::invalid_argument("integer underflow");
+    key_table(const key_table &) = delete;
+    key_table & operator =(const key_table &) = delete;
+
+    interned_string intern(std::string_view key) {
+      if(auto i = index_.find(key); i != index_.end())
+        return interned_string(*i);
+      auto &stored = storage_.emplace_back(key);
+      index_.insert(stored);
+      return interned_string(stored);
     }
 
-    template<typename Integer>
-    inline void
-    check_over_underflow(Integer value, Integer digit, Integer sgn) {
-      if(sgn == 1)
-        check_overflow(value, digit);
-      else
-        check_underflow(value, digit);
+    std::optional<interned_string> find(std::string_view key) const {
+      if(auto i = index_.find(key); i != index_.end())
+        return interned_string(*i);
+      return std::nullopt;
     }
 
-    template<typename Integer, typename Iter>
-    inline Integer
-    decode_digits(Iter &begin, Iter end, [[maybe_unused]] Integer sgn = 1) {
-      assert(sgn == 1 || (std::is_signed_v<Integer> &&
-                          std::make_signed_t<Integer>(sgn) == -1));
+    std::size_t size() const noexcept { return storage_.size(); }
+    bool empty() const noexcept { return storage_.empty(); }
+  private:
+    // A deque never moves its elements, so views of the stored strings (even
+    // those short enough to be stored inline) remain valid.
+    std::deque<std::string> storage_;
+    std::unordered_set<std::string_view> index_;
+  };
 
-      Integer value = 0;
+  template<typename Key, typename Value>
+  using interned_map_proxy = map_proxy<interned_string, Value>;
 
-      // For performance, decode as many digits as we know will fit within an
-      // `Integer` value, and then if there are any more beyond that, do
-      // proper overflow detection.
-      for(int i = 0; i != std::numeric_limits<Integer>::digits10; i++) {
-        if(begin == end)
-          throw std::invalid_argument("unexpected end of string");
-        if(!std::isdigit(*begin))
-          return value;
+  // A dict stored as a vector of key/value pairs sorted by key. Since bencoded
+  // dicts are already sorted, decoding can build this in linear time by
+  // appending each element, and lookups are a binary search over contiguous
+  // memory. Lookups can use any type comparable with `Key` (e.g. a
+  // `std::string_view` when `Key` is `std::string`).
+  template<typename Key, typename Value,
+           typename Allocator = std::allocator<std::pair<Key, Value>>>
+  class flat_dict {
+    using vector_type = std::vector<std::pair<Key, Value>, Allocator>;
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<Key, Value>;
+    using size_type = typename vector_type::size_type;
+    using difference_type = typename vector_type::difference_type;
+    using key_compare = std::less<>;
+    using allocator_type = Allocator;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using iterator = typename vector_type::iterator;
+    using const_iterator = typename vector_type::const_iterator;
+    using reverse_iterator = typename vector_type::reverse_iterator;
+    using const_reverse_iterator =
+      typename vector_type::const_reverse_iterator;
 
-        if constexpr(std::is_signed_v<Integer>)
-          value = value * 10 + (*begin++ - '0') * sgn;
-        else
-          value = value * 10 + (*begin++ - '0');
-      }
-      if(begin == end)
-        throw std::invalid_argument("unexpected end of string");
+    // Construction
+    flat_dict() = default;
+    explicit flat_dict(const allocator_type &alloc) : items_(alloc) {}
+    flat_dict(std::initializer_list<value_type> i,
+              const allocator_type &alloc = allocator_type())
+      : items_(alloc) {
+      for(auto &&j : i)
+        insert(j);
+    }
 
-      // We're approaching the limits of what `Integer` can hold. Check for
-      // overflow.
-      if(std::isdigit(*begin)) {
-        Integer digit;
-        if constexpr(std::is_signed_v<Integer>) {
-          digit = (*begin++ - '0') * sgn;
-          check_over_underflow(value, digit, sgn);
-        } else {
-          digit = (*begin++ - '0');
-          check_overflow(value, digit);
-        }
-        value = value * 10 + digit;
-      }
+    allocator_type get_allocator() const { return items_.get_allocator(); }
 
-      // Still more digits? That's too many!
-      if(std::isdigit(*begin)) {
-        if(sgn == 1)
-          throw std::invalid_argument("integer overflow");
-        else
-          throw std::invalid_argument("integer underflow");
-      }
+    // Element access
+    template<typename K>
+    mapped_type & at(const K &key) {
+      return const_cast<mapped_type &>(std::as_const(*this).at(key));
+    }
 
-      return value;
+    template<typename K>
+    const mapped_type & at(const K &key) const {
+      auto i = find(key);
+      if(i == end())
+        detail::throw_exception<std::out_of_range>("flat_dict::at");
+      return i->second;
     }
 
-    template<typename Integer, typename Iter>
-    Integer decode_int(Iter &begin, Iter end) {
-      assert(*begin == 'i');
-      ++begin;
-      Integer sgn = 1;
-      if(*begin == '-') {
-        if constexpr(std::is_unsigned_v<Integer>) {
-          throw std::invalid_argument("expected unsigned integer");
-        } else {
-          sgn = -1;
-          ++begin;
-        }
-      }
+    mapped_type & operator [](const key_type &key) {
+      return try_emplace(key).first->second;
+    }
+    mapped_type & operator [](key_type &&key) {
+      return try_emplace(std::move(key)).first->second;
+    }
 
-      Integer value = decode_digits<Integer>(begin, end, sgn);
-      if(*begin != 'e')
-        throw std::invalid_argument("expected 'e'");
+    // Iterators
+    iterator begin() noexcept { return items_.begin(); }
+    const_iterator begin() const noexcept { return items_.begin(); }
+    const_iterator cbegin() const noexcept { return items_.cbegin(); }
+    iterator end() noexcept { return items_.end(); }
+    const_iterator end() const noexcept { return items_.end(); }
+    const_iterator cend() const noexcept { return items_.cend(); }
+    reverse_iterator rbegin() noexcept { return items_.rbegin(); }
+    const_reverse_iterator rbegin() const noexcept { return items_.rbegin(); }
+    const_reverse_iterator crbegin() const noexcept {
+      return items_.crbegin();
+    }
+    reverse_iterator rend() noexcept { return items_.rend(); }
+    const_reverse_iterator rend() const noexcept { return items_.rend(); }
+    const_reverse_iterator crend() const noexcept { return items_.crend(); }
+
+    // Capacity
+    bool empty() const noexcept { return items_.empty(); }
+    size_type size() const noexcept { return items_.size(); }
+    size_type max_size() const noexcept { return items_.max_size(); }
+    size_type capacity() const noexcept { return items_.capacity(); }
+    void reserve(size_type n) { items_.reserve(n); }
+    void shrink_to_fit() { items_.shrink_to_fit(); }
+
+    // Modifiers
+    void clear() noexcept { items_.clear(); }
+
+    std::pair<iterator, bool> insert(const value_type &value) {
+      return try_emplace(value.first, value.second);
+    }
+    std::pair<iterator, bool> insert(value_type &&value) {
+      return try_emplace(std::move(value.first), std::move(value.second));
+    }
+    iterator insert(const_iterator, const value_type &value) {
+      return insert(value).first;
+    }
+    iterator insert(const_iterator, value_type &&value) {
+      return insert(std::move(value)).first;
+    }
+
+    template<typename ...Args>
+    std::pair<iterator, bool> emplace(Args &&...args) {
+      return insert(value_type(std::forward<Args>(args)...));
+    }
+    template<typename ...Args>
+    iterator emplace_hint(const_iterator, Args &&...args) {
+      return emplace(std::forward<Args>(args)...).first;
+    }
+
+    template<typename ...Args>
+    std::pair<iterator, bool>
+    try_emplace(const key_type &key, Args &&...args) {
+      return try_emplace_impl(key, std::forward<Args>(args)...);
+    }
+    template<typename ...Args>
+    std::pair<iterator, bool> try_emplace(key_type &&key, Args &&...args) {
+      return try_emplace_impl(std::move(key), std::forward<Args>(args)...);
+    }
+    template<typename ...Args>
+    iterator try_emplace(const_iterator, const key_type &key,
+                         Args &&...args) {
+      return try_emplace_impl(key, std::forward<Args>(args)...).first;
+    }
+    template<typename ...Args>
+    iterator try_emplace(const_iterator, key_type &&key, Args &&...args) {
+      return try_emplace_impl(std::move(key),
+                              std::forward<Args>(args)...).first;
+    }
+
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+      auto i = try_emplace(key, std::forward<M>(obj));
+      if(!i.second)
+        i.first->second = std::forward<M>(obj);
+      return i;
+    }
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+      auto i = try_emplace(std::move(key), std::forward<M>(obj));
+      if(!i.second)
+        i.first->second = std::forward<M>(obj);
+      return i;
+    }
+
+    iterator erase(const_iterator pos) { return items_.erase(pos); }
+    iterator erase(iterator pos) { return items_.erase(pos); }
+    iterator erase(const_iterator first, const_iterator last) {
+      return items_.erase(first, last);
+    }
+    template<typename K, typename = std::enable_if_t<
+      !std::is_convertible_v<K, const_iterator>
+    >>
+    size_type erase(const K &key) {
+      auto i = find(key);
+      if(i == end())
+        return 0;
+      items_.erase(i);
+      return 1;
+    }
+
+    void swap(flat_dict &rhs) noexcept { items_.swap(rhs.items_); }
+
+    // Lookup
+    template<typename K>
+    iterator find(const K &key) {
+      auto i = lower_bound(key);
+      return i != end() && !(key < i->first) ? i : end();
+    }
+    template<typename K>
+    const_iterator find(const K &key) const {
+      auto i = lower_bound(key);
+      return i != end() && !(key < i->first) ? i : end();
+    }
+
+    template<typename K>
+    size_type count(const K &key) const { return find(key) != end(); }
+    template<typename K>
+    bool contains(const K &key) const { return find(key) != end(); }
+
+    template<typename K>
+    iterator lower_bound(const K &key) {
+      return std::lower_bound(begin(), end(), key, key_less());
+    }
+    template<typename K>
+    const_iterator lower_bound(const K &key) const {
+      return std::lower_bound(begin(), end(), key, key_less());
+    }
+
+    template<typename K>
+    iterator upper_bound(const K &key) {
+      return std::upper_bound(begin(), end(), key, key_less());
+    }
+    template<typename K>
+    const_iterator upper_bound(const K &key) const {
+      return std::upper_bound(begin(), end(), key, key_less());
+    }
+
+    template<typename K>
+    std::pair<iterator, iterator> equal_range(const K &key) {
+      return {lower_bound(key), upper_bound(key)};
+    }
+    template<typename K>
+    std::pair<const_iterator, const_iterator>
+    equal_range(const K &key) const {
+      return {lower_bound(key), upper_bound(key)};
+    }
+
+    key_compare key_comp() const { return key_compare(); }
+
+    friend bool operator ==(const flat_dict &lhs, const flat_dict &rhs) {
+      return lhs.items_ == rhs.items_;
+    }
+    friend bool operator !=(const flat_dict &lhs, const flat_dict &rhs) {
+      return lhs.items_ != rhs.items_;
+    }
+    friend bool operator <(const flat_dict &lhs, const flat_dict &rhs) {
+      return lhs.items_ < rhs.items_;
+    }
+    friend bool operator <=(const flat_dict &lhs, const flat_dict &rhs) {
+      return lhs.items_ <= rhs.items_;
+    }
+    friend bool operator >(const flat_dict &lhs, const flat_dict &rhs) {
+      return lhs.items_ > rhs.items_;
+    }
+    friend bool operator >=(const flat_dict &lhs, const flat_dict &rhs) {
+      return lhs.items_ >= rhs.items_;
+    }
+  private:
+    // Compare elements against keys in either order, for binary searches.
+    struct key_less {
+      template<typename K>
+      bool operator ()(const value_type &lhs, const K &rhs) const {
+        return lhs.first < rhs;
+      }
+      template<typename K>
+      bool operator ()(const K &lhs, const value_type &rhs) const {
+        return lhs < rhs.first;
+      }
+    };
+
+    template<typename K, typename ...Args>
+    std::pair<iterator, bool> try_emplace_impl(K &&key, Args &&...args) {
+      // Keys usually arrive in order, so check if this one belongs at the end
+      // before searching for it.
+      auto i = end();
+      if(!empty() && !(items_.back().first < key)) {
+        i = lower_bound(key);
+        if(!(key < i->first))
+          return {i, false};
+      }
+      i = items_.emplace(
+        i, std::piecewise_construct,
+        std::forward_as_tuple(std::forward<K>(key)),
+        std::forward_as_tuple(std::forward<Args>(args)...)
+      );
+      return {i, true};
+    }
+
+    vector_type items_;
+  };
+
+  namespace detail {
+    // Hash a dict key. Anything viewable as a string hashes the same way, so
+    // that lookups can use any string type; key literals carry their hash
+    // with them.
+    template<typename T>
+    inline std::size_t key_hash(const T &key) {
+      if constexpr(is_key_literal_v<T>)
+        return key.hash;
+      else if constexpr(std::is_convertible_v<const T &, std::string_view>)
+        return fnv1a(key);
+      else if constexpr(std::is_same_v<T, bytes_view>)
+        return fnv1a(key.chars());
+      else
+        return std::hash<T>{}(key);
+    }
+  }
+
+  // A dict stored as an open-addressing hash table, for large dicts where
+  // lookups are much more common than iteration. Elements are stored densely
+  // in insertion order, with a separate table of indices into them, and can
+  // be looked up by any type comparable with `Key`. When encoding, the
+  // elements are sorted by key; if `cache_order` is enabled, this sorted order
+  // is saved until the dict is next modified (in which case, even const
+  // member functions may not be called concurrently).
+  template<typename Key, typename Value,
+           typename Allocator = std::allocator<std::pair<Key, Value>>>
+  class hash_dict {
+    using vector_type = std::vector<std::pair<Key, Value>, Allocator>;
+    using index_type = std::uint32_t;
+    using index_allocator = typename std::allocator_traits<Allocator>
+      ::template rebind_alloc<index_type>;
+
+    struct slot {
+      index_type index;
+      index_type hash;
+    };
+    using slot_allocator = typename std::allocator_traits<Allocator>
+      ::template rebind_alloc<slot>;
+
+    static constexpr index_type npos = ~index_type(0);
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<Key, Value>;
+    using size_type = typename vector_type::size_type;
+    using difference_type = typename vector_type::difference_type;
+    using allocator_type = Allocator;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using iterator = typename vector_type::iterator;
+    using const_iterator = typename vector_type::const_iterator;
+
+    // Construction
+    hash_dict() = default;
+    explicit hash_dict(const allocator_type &alloc)
+      : items_(alloc), slots_(slot_allocator(alloc)),
+        order_(index_allocator(alloc)) {}
+    hash_dict(std::initializer_list<value_type> i,
+              const allocator_type &alloc = allocator_type())
+      : hash_dict(alloc) {
+      reserve(i.size());
+      for(auto &&j : i)
+        insert(j);
+    }
+
+    allocator_type get_allocator() const { return items_.get_allocator(); }
+
+    // Element access
+    template<typename K>
+    mapped_type & at(const K &key) {
+      return const_cast<mapped_type &>(std::as_const(*this).at(key));
+    }
+
+    template<typename K>
+    const mapped_type & at(const K &key) const {
+      auto i = find(key);
+      if(i == end())
+        detail::throw_exception<std::out_of_range>("hash_dict::at");
+      return i->second;
+    }
+
+    mapped_type & operator [](const key_type &key) {
+      return try_emplace(key).first->second;
+    }
+    mapped_type & operator [](key_type &&key) {
+      return try_emplace(std::move(key)).first->second;
+    }
+
+    // Iterators (in insertion order, except after erasing elements)
+    iterator begin() noexcept { return items_.begin(); }
+    const_iterator begin() const noexcept { return items_.begin(); }
+    const_iterator cbegin() const noexcept { return items_.cbegin(); }
+    iterator end() noexcept { return items_.end(); }
+    const_iterator end() const noexcept { return items_.end(); }
+    const_iterator cend() const noexcept { return items_.cend(); }
+
+    // Capacity
+    bool empty() const noexcept { return items_.empty(); }
+    size_type size() const noexcept { return items_.size(); }
+    size_type max_size() const noexcept { return npos - 1; }
+
+    void reserve(size_type n) {
+      items_.reserve(n);
+      if(n * 4 > slots_.size() * 3)
+        rehash(n);
+    }
+
+    // Modifiers
+    void clear() noexcept {
+      items_.clear();
+      std::fill(slots_.begin(), slots_.end(), slot{npos, 0});
+      order_valid_ = false;
+    }
+
+    std::pair<iterator, bool> insert(const value_type &value) {
+      return try_emplace(value.first, value.second);
+    }
+    std::pair<iterator, bool> insert(value_type &&value) {
+      return try_emplace(std::move(value.first), std::move(value.second));
+    }
+    iterator insert(const_iterator, const value_type &value) {
+      return insert(value).first;
+    }
+    iterator insert(const_iterator, value_type &&value) {
+      return insert(std::move(value)).first;
+    }
+
+    template<typename ...Args>
+    std::pair<iterator, bool> emplace(Args &&...args) {
+      return insert(value_type(std::forward<Args>(args)...));
+    }
+    template<typename ...Args>
+    iterator emplace_hint(const_iterator, Args &&...args) {
+      return emplace(std::forward<Args>(args)...).first;
+    }
+
+    template<typename ...Args>
+    std::pair<iterator, bool>
+    try_emplace(const key_type &key, Args &&...args) {
+      return try_emplace_impl(key, std::forward<Args>(args)...);
+    }
+    template<typename ...Args>
+    std::pair<iterator, bool> try_emplace(key_type &&key, Args &&...args) {
+      return try_emplace_impl(std::move(key), std::forward<Args>(args)...);
+    }
+    template<typename ...Args>
+    iterator try_emplace(const_iterator, const key_type &key,
+                         Args &&...args) {
+      return try_emplace_impl(key, std::forward<Args>(args)...).first;
+    }
+    template<typename ...Args>
+    iterator try_emplace(const_iterator, key_type &&key, Args &&...args) {
+      return try_emplace_impl(std::move(key),
+                              std::forward<Args>(args)...).first;
+    }
+
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+      auto i = try_emplace(key, std::forward<M>(obj));
+      if(!i.second)
+        i.first->second = std::forward<M>(obj);
+      return i;
+    }
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+      auto i = try_emplace(std::move(key), std::forward<M>(obj));
+      if(!i.second)
+        i.first->second = std::forward<M>(obj);
+      return i;
+    }
+
+    // Erase an element by moving the last element into its place. Thus, the
+    // returned iterator (which points to the same position as `pos`) refers
+    // to the next element that hasn't yet been visited.
+    iterator erase(const_iterator pos) {
+      auto index = static_cast<index_type>(pos - items_.cbegin());
+      erase_slot(find_slot(index));
+
+      auto last = static_cast<index_type>(items_.size() - 1);
+      if(index != last) {
+        slots_[find_slot(last)].index = index;
+        items_[index] = std::move(items_.back());
+      }
+      items_.pop_back();
+      order_valid_ = false;
+      return items_.begin() + index;
+    }
+
+    iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+
+    template<typename K, typename = std::enable_if_t<
+      !std::is_convertible_v<K, const_iterator>
+    >>
+    size_type erase(const K &key) {
+      auto i = find(key);
+      if(i == end())
+        return 0;
+      erase(i);
+      return 1;
+    }
+
+    void swap(hash_dict &rhs) noexcept {
+      using std::swap;
+      items_.swap(rhs.items_);
+      slots_.swap(rhs.slots_);
+      order_.swap(rhs.order_);
+      swap(order_valid_, rhs.order_valid_);
+      swap(cache_order_, rhs.cache_order_);
+    }
+
+    // Lookup
+    template<typename K>
+    iterator find(const K &key) {
+      return begin() + (std::as_const(*this).find(key) - cbegin());
+    }
+    template<typename K>
+    const_iterator find(const K &key) const {
+      if(slots_.empty())
+        return end();
+      auto &s = slots_[lookup(key, detail::key_hash(key))];
+      return s.index == npos ? end() : begin() + s.index;
+    }
+
+    template<typename K>
+    size_type count(const K &key) const { return find(key) != end(); }
+    template<typename K>
+    bool contains(const K &key) const { return find(key) != end(); }
+
+    // Sorted order
+    bool cache_order() const noexcept { return cache_order_; }
+    void cache_order(bool enable) {
+      cache_order_ = enable;
+      if(!enable) {
+        order_.clear();
+        order_.shrink_to_fit();
+        order_valid_ = false;
+      }
+    }
+
+    // Call `f` on each element in ascending order of their keys.
+    template<typename F>
+    void for_each_sorted(F &&f) const {
+      auto visit = [this, &f](const auto &order) {
+        for(auto i : order)
+          f(items_[i]);
+      };
+
+      if(cache_order_) {
+        if(!order_valid_) {
+          sort_into(order_);
+          order_valid_ = true;
+        }
+        visit(order_);
+      } else {
+        std::vector<index_type, index_allocator> order(
+          index_allocator(items_.get_allocator())
+        );
+        sort_into(order);
+        visit(order);
+      }
+    }
+
+    friend bool operator ==(const hash_dict &lhs, const hash_dict &rhs) {
+      if(lhs.size() != rhs.size())
+        return false;
+      for(auto &&i : lhs) {
+        auto j = rhs.find(i.first);
+        if(j == rhs.end() || !(j->second == i.second))
+          return false;
+      }
+      return true;
+    }
+    friend bool operator !=(const hash_dict &lhs, const hash_dict &rhs) {
+      return !(lhs == rhs);
+    }
+  private:
+    template<typename Vector>
+    void sort_into(Vector &order) const {
+      order.resize(items_.size());
+      for(index_type i = 0; i != order.size(); i++)
+        order[i] = i;
+      std::sort(order.begin(), order.end(), [this](auto a, auto b) {
+        return items_[a].first < items_[b].first;
+      });
+    }
+
+    std::size_t mask() const noexcept { return slots_.size() - 1; }
+
+    // Find the slot holding `key`, or the empty slot where it would go. The
+    // table must not be empty.
+    template<typename K>
+    std::size_t lookup(const K &key, std::size_t hash) const {
+      auto h = static_cast<index_type>(hash);
+      for(std::size_t i = h & mask(); ; i = (i + 1) & mask()) {
+        auto &s = slots_[i];
+        if(s.index == npos ||
+           (s.hash == h && items_[s.index].first == key))
+          return i;
+      }
+    }
+
+    // Find the slot pointing to the element at `index`.
+    std::size_t find_slot(index_type index) const {
+      auto h = static_cast<index_type>(
+        detail::key_hash(items_[index].first)
+      );
+      for(std::size_t i = h & mask(); ; i = (i + 1) & mask()) {
+        if(slots_[i].index == index)
+          return i;
+      }
+    }
+
+    // Empty a slot, shifting later slots in its probe sequence back so that
+    // lookups don't stop early.
+    void erase_slot(std::size_t i) {
+      for(std::size_t j = (i + 1) & mask(); slots_[j].index != npos;
+          j = (j + 1) & mask()) {
+        // Move the slot at `j` into the hole unless its ideal position lies
+        // cyclically within (i, j].
+        std::size_t ideal = slots_[j].hash & mask();
+        if(((j - ideal) & mask()) >= ((j - i) & mask())) {
+          slots_[i] = slots_[j];
+          i = j;
+        }
+      }
+      slots_[i] = slot{npos, 0};
+    }
+
+    // Resize the table of slots to fit at least `n` elements at a load
+    // factor of 3/4.
+    void rehash(std::size_t n) {
+      std::size_t count = 8;
+      while(count * 3 < n * 4)
+        count *= 2;
+      if(count <= slots_.size())
+        return;
+
+      std::vector<slot, slot_allocator> slots(count, slot{npos, 0},
+                                              slots_.get_allocator());
+      for(auto &&s : slots_) {
+        if(s.index == npos)
+          continue;
+        std::size_t i = s.hash & (count - 1);
+        while(slots[i].index != npos)
+          i = (i + 1) & (count - 1);
+        slots[i] = s;
+      }
+      slots_.swap(slots);
+    }
+
+    template<typename K, typename ...Args>
+    std::pair<iterator, bool> try_emplace_impl(K &&key, Args &&...args) {
+      if((items_.size() + 1) * 4 > slots_.size() * 3)
+        rehash(items_.size() + 1);
+
+      auto hash = detail::key_hash(key);
+      auto i = lookup(key, hash);
+      if(slots_[i].index != npos)
+        return {begin() + slots_[i].index, false};
+
+      items_.emplace_back(std::piecewise_construct,
+                          std::forward_as_tuple(std::forward<K>(key)),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+      slots_[i] = slot{static_cast<index_type>(items_.size() - 1),
+                       static_cast<index_type>(hash)};
+      order_valid_ = false;
+      return {std::prev(end()), true};
+    }
+
+    vector_type items_;
+    std::vector<slot, slot_allocator> slots_;
+    mutable std::vector<index_type, index_allocator> order_;
+    mutable bool order_valid_ = false;
+    bool cache_order_ = false;
+  };
+
+  // A list that stores homogeneous lists of integers or strings packed into
+  // contiguous arrays: integers in a vector of `long long`, and strings as a
+  // single buffer of characters plus the offset where each one ends. Any
+  // other list is stored as a vector of values. `basic_parser` packs lists as
+  // it decodes them, and `encode` writes packed lists straight from their
+  // arrays.
+  //
+  // Packed lists still support the usual vector interface, but accessing
+  // their elements that way through a non-const reference unpacks them into
+  // a vector of values first. Const access never unpacks (so reading a const
+  // packed list from multiple threads is safe), and the vector-style const
+  // accessors require the list to be unpacked already. To read a packed list
+  // without unpacking it, check `kind()` and then use `integers()` or
+  // `string_at()`.
+  template<typename Value, typename Allocator = std::allocator<Value>>
+  class packed_list {
+    template<typename T>
+    using rebind_alloc = typename std::allocator_traits<Allocator>
+      ::template rebind_alloc<T>;
+    using vector_type = std::vector<Value, Allocator>;
+  public:
+    using value_type = Value;
+    using size_type = typename vector_type::size_type;
+    using difference_type = typename vector_type::difference_type;
+    using allocator_type = Allocator;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using iterator = typename vector_type::iterator;
+    using const_iterator = typename vector_type::const_iterator;
+    using integer_vector = std::vector<long long, rebind_alloc<long long>>;
+
+    enum class packing { none, integers, strings };
+
+    // Construction
+    packed_list() = default;
+    explicit packed_list(const allocator_type &alloc)
+      : values_(alloc), integers_(alloc), chars_(alloc), ends_(alloc) {}
+    packed_list(std::initializer_list<value_type> i,
+                const allocator_type &alloc = allocator_type())
+      : values_(i, alloc), integers_(alloc), chars_(alloc), ends_(alloc) {}
+
+    allocator_type get_allocator() const { return values_.get_allocator(); }
+
+    // Packed access
+    packing kind() const noexcept { return kind_; }
+    bool is_packed() const noexcept { return kind_ != packing::none; }
+
+    const integer_vector & integers() const noexcept {
+      assert(kind_ == packing::integers);
+      return integers_;
+    }
+
+    std::string_view string_at(size_type i) const noexcept {
+      assert(kind_ == packing::strings && i < ends_.size());
+      size_type start = i ? ends_[i - 1] : 0;
+      return std::string_view(chars_.data() + start, ends_[i] - start);
+    }
+
+    // Whether an element can be appended to this list with the given
+    // packing without unpacking it first.
+    bool can_pack(packing p) const noexcept {
+      return kind_ == p || (kind_ == packing::none && values_.empty());
+    }
+
+    void push_integer(long long value) {
+      start_packing(packing::integers);
+      integers_.push_back(value);
+    }
+
+    void push_string(std::string_view value) {
+      start_packing(packing::strings);
+      chars_.append(value.data(), value.size());
+      ends_.push_back(chars_.size());
+    }
+
+    // Convert a packed list into a vector of values.
+    void unpack() {
+      if(kind_ == packing::none) {
+        if(hint_) {
+          values_.reserve(hint_);
+          hint_ = 0;
+        }
+        return;
+      }
+
+      values_.reserve(size());
+      if(kind_ == packing::integers) {
+        for(auto i : integers_)
+          values_.emplace_back(i);
+      } else {
+        using string = typename Value::string;
+        for(size_type i = 0; i != ends_.size(); i++)
+          values_.emplace_back(string(string_at(i)));
+      }
+
+      integers_.clear();
+      chars_.clear();
+      ends_.clear();
+      kind_ = packing::none;
+    }
+
+    // Element access
+    reference at(size_type i) { unpack(); return values_.at(i); }
+    const_reference at(size_type i) const { return unpacked().at(i); }
+    reference operator [](size_type i) { unpack(); return values_[i]; }
+    const_reference operator [](size_type i) const { return unpacked()[i]; }
+    reference front() { unpack(); return values_.front(); }
+    const_reference front() const { return unpacked().front(); }
+    reference back() { unpack(); return values_.back(); }
+    const_reference back() const { return unpacked().back(); }
+
+    // Iterators
+    iterator begin() { unpack(); return values_.begin(); }
+    const_iterator begin() const { return unpacked().begin(); }
+    const_iterator cbegin() const { return unpacked().cbegin(); }
+    iterator end() { unpack(); return values_.end(); }
+    const_iterator end() const { return unpacked().end(); }
+    const_iterator cend() const { return unpacked().cend(); }
+
+    // Capacity
+    bool empty() const noexcept { return size() == 0; }
+    size_type size() const noexcept {
+      switch(kind_) {
+      case packing::integers:
+        return integers_.size();
+      case packing::strings:
+        return ends_.size();
+      default:
+        return values_.size();
+      }
+    }
+
+    // Reserve space for `n` elements. If the list is empty, we don't know
+    // yet whether it will be packed, so just remember `n` until we do.
+    void reserve(size_type n) {
+      switch(kind_) {
+      case packing::integers:
+        integers_.reserve(n);
+        break;
+      case packing::strings:
+        ends_.reserve(n);
+        break;
+      default:
+        if(values_.empty())
+          hint_ = n;
+        else
+          values_.reserve(n);
+      }
+    }
+
+    // Modifiers
+    void clear() noexcept {
+      values_.clear();
+      integers_.clear();
+      chars_.clear();
+      ends_.clear();
+      kind_ = packing::none;
+      hint_ = 0;
+    }
+
+    template<typename ...Args>
+    reference emplace_back(Args &&...args) {
+      unpack();
+      return values_.emplace_back(std::forward<Args>(args)...);
+    }
+
+    void push_back(const value_type &value) { emplace_back(value); }
+    void push_back(value_type &&value) { emplace_back(std::move(value)); }
+    void pop_back() { unpack(); values_.pop_back(); }
+
+    template<typename ...Args>
+    iterator emplace(const_iterator pos, Args &&...args) {
+      unpack();
+      return values_.emplace(pos, std::forward<Args>(args)...);
+    }
+
+    iterator insert(const_iterator pos, const value_type &value) {
+      return emplace(pos, value);
+    }
+    iterator insert(const_iterator pos, value_type &&value) {
+      return emplace(pos, std::move(value));
+    }
+
+    iterator erase(const_iterator pos) {
+      unpack();
+      return values_.erase(pos);
+    }
+    iterator erase(const_iterator first, const_iterator last) {
+      unpack();
+      return values_.erase(first, last);
+    }
+
+    void resize(size_type n) {
+      unpack();
+      values_.resize(n);
+    }
+
+    void swap(packed_list &rhs) noexcept {
+      using std::swap;
+      swap(values_, rhs.values_);
+      swap(integers_, rhs.integers_);
+      swap(chars_, rhs.chars_);
+      swap(ends_, rhs.ends_);
+      swap(kind_, rhs.kind_);
+      swap(hint_, rhs.hint_);
+    }
+  private:
+    const vector_type & unpacked() const noexcept {
+      assert(kind_ == packing::none);
+      return values_;
+    }
+
+    void start_packing(packing p) {
+      assert(can_pack(p));
+      if(kind_ == p)
+        return;
+      kind_ = p;
+      if(p == packing::integers)
+        integers_.reserve(hint_);
+      else
+        ends_.reserve(hint_);
+      hint_ = 0;
+    }
+
+    vector_type values_;
+    integer_vector integers_;
+    std::basic_string<char, std::char_traits<char>, rebind_alloc<char>> chars_;
+    std::vector<size_type, rebind_alloc<size_type>> ends_;
+    packing kind_ = packing::none;
+    size_type hint_ = 0;
+  };
+
+  template<typename Value, typename Allocator>
+  inline void swap(packed_list<Value, Allocator> &lhs,
+                   packed_list<Value, Allocator> &rhs) noexcept {
+    lhs.swap(rhs);
+  }
+
+  namespace detail {
+    template<bool Equality, typename List>
+    int compare_packed(const List &lhs, const List &rhs);
+  }
+
+  template<typename Value, typename Allocator>
+  bool operator ==(const packed_list<Value, Allocator> &lhs,
+                   const packed_list<Value, Allocator> &rhs) {
+    if(lhs.size() != rhs.size())
+      return false;
+    if(lhs.is_packed() || rhs.is_packed())
+      return detail::compare_packed<true>(lhs, rhs) == 0;
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin());
+  }
+
+  template<typename Value, typename Allocator>
+  bool operator !=(const packed_list<Value, Allocator> &lhs,
+                   const packed_list<Value, Allocator> &rhs) {
+    return !(lhs == rhs);
+  }
+
+  // An integer of any size. Values that fit in a `long long` are stored
+  // inline, and larger ones as their decimal digits (either owned, or with
+  // `std::string_view`, pointing into the decoded buffer), so that they can be
+  // encoded again exactly.
+  template<typename String>
+  class basic_big_integer {
+  public:
+    using string_type = String;
+
+    basic_big_integer() = default;
+    basic_big_integer(long long value) noexcept : small_(value) {}
+
+    basic_big_integer & operator =(long long value) noexcept {
+      small_ = value;
+      digits_ = String();
+      return *this;
+    }
+
+    // Create an integer from the decimal digits of its absolute value, which
+    // mustn't have any leading zeros.
+    basic_big_integer(bool negative, String digits) {
+      assert(!digits.empty() && (digits[0] != '0' || digits.size() == 1));
+      using limits = std::numeric_limits<long long>;
+      long long value = 0;
+      for(char c : digits) {
+        long long digit = c - '0';
+        if(negative ? value < ((limits::min)() + digit) / 10 :
+                      value > ((limits::max)() - digit) / 10) {
+          negative_ = negative;
+          digits_ = std::move(digits);
+          return;
+        }
+        value = negative ? value * 10 - digit : value * 10 + digit;
+      }
+      small_ = value;
+    }
+
+    // Whether the value fits in a `long long`.
+    bool is_small() const noexcept { return digits_.empty(); }
+    bool negative() const noexcept {
+      return is_small() ? small_ < 0 : negative_;
+    }
+
+    // The value as a `long long`; only valid if `is_small()`.
+    long long small() const noexcept {
+      assert(is_small());
+      return small_;
+    }
+
+    // The decimal digits of the absolute value, if it's not small.
+    const String & digits() const noexcept { return digits_; }
+
+    // The value as an `Integer`, or nothing if it's out of range.
+    template<typename Integer>
+    std::optional<Integer> as() const noexcept {
+      using limits = std::numeric_limits<Integer>;
+      if(is_small()) {
+        if constexpr(std::is_signed_v<Integer>) {
+          if(small_ < (limits::min)() || small_ > (limits::max)())
+            return std::nullopt;
+        } else {
+          if(small_ < 0 || static_cast<unsigned long long>(small_) >
+                           (limits::max)())
+            return std::nullopt;
+        }
+        return static_cast<Integer>(small_);
+      }
+
+      if(std::is_unsigned_v<Integer> && negative_)
+        return std::nullopt;
+      Integer value = 0;
+      for(char c : digits_) {
+        Integer digit = c - '0';
+        if(negative_) {
+          if(value < ((limits::min)() + digit) / 10)
+            return std::nullopt;
+          value = value * 10 - digit;
+        } else {
+          if(value > ((limits::max)() - digit) / 10)
+            return std::nullopt;
+          value = value * 10 + digit;
+        }
+      }
+      return value;
+    }
+
+    std::string to_string() const {
+      if(is_small())
+        return std::to_string(small_);
+      std::string result(negative_ ? "-" : "");
+      result.append(digits_.data(), digits_.size());
+      return result;
+    }
+
+    friend bool
+    operator ==(const basic_big_integer &lhs, const basic_big_integer &rhs) {
+      if(lhs.is_small() || rhs.is_small()) {
+        return lhs.is_small() && rhs.is_small() && lhs.small_ == rhs.small_;
+      }
+      return lhs.negative_ == rhs.negative_ && lhs.digits_ == rhs.digits_;
+    }
+
+    friend bool
+    operator !=(const basic_big_integer &lhs, const basic_big_integer &rhs) {
+      return !(lhs == rhs);
+    }
+
+    friend bool
+    operator <(const basic_big_integer &lhs, const basic_big_integer &rhs) {
+      if(lhs.is_small() && rhs.is_small())
+        return lhs.small_ < rhs.small_;
+      if(lhs.negative() != rhs.negative())
+        return lhs.negative();
+
+      // A big value is larger in magnitude than any small one; otherwise,
+      // compare the magnitudes by length and then digit by digit.
+      bool less_magnitude;
+      if(lhs.is_small() || rhs.is_small()) {
+        less_magnitude = lhs.is_small();
+      } else if(lhs.digits_.size() != rhs.digits_.size()) {
+        less_magnitude = lhs.digits_.size() < rhs.digits_.size();
+      } else {
+        std::string_view l(lhs.digits_.data(), lhs.digits_.size()),
+                         r(rhs.digits_.data(), rhs.digits_.size());
+        if(l == r)
+          return false;
+        less_magnitude = l < r;
+      }
+      return lhs.negative() ? !less_magnitude : less_magnitude;
+    }
+
+    friend bool
+    operator >(const basic_big_integer &lhs, const basic_big_integer &rhs) {
+      return rhs < lhs;
+    }
+
+    friend bool
+    operator <=(const basic_big_integer &lhs, const basic_big_integer &rhs) {
+      return !(rhs < lhs);
+    }
+
+    friend bool
+    operator >=(const basic_big_integer &lhs, const basic_big_integer &rhs) {
+      return !(lhs < rhs);
+    }
+  private:
+    long long small_ = 0;
+    bool negative_ = false;
+    String digits_;
+  };
+
+  using big_integer = basic_big_integer<std::string>;
+  using big_integer_view = basic_big_integer<std::string_view>;
+
+  namespace detail {
+    template<typename T>
+    inline constexpr bool is_big_integer_v = false;
+    template<typename String>
+    inline constexpr bool is_big_integer_v<basic_big_integer<String>> = true;
+  }
+
+  using data = basic_data<std::variant, long long, std::string, std::vector,
+                          map_proxy>;
+  using data_view = basic_data<std::variant, long long, std::string_view,
+                               std::vector, map_proxy>;
+  using byte_data_view = basic_data<std::variant, long long, bytes_view,
+                                    std::vector, map_proxy>;
+  using interned_data = basic_data<std::variant, long long, std::string,
+                                   std::vector, interned_map_proxy>;
+  using flat_dict_data = basic_data<std::variant, long long, std::string,
+                                    std::vector, flat_dict>;
+  using flat_dict_data_view = basic_data<std::variant, long long,
+                                         std::string_view, std::vector,
+                                         flat_dict>;
+  using hash_dict_data = basic_data<std::variant, long long, std::string,
+                                    std::vector, hash_dict>;
+  using hash_dict_data_view = basic_data<std::variant, long long,
+                                         std::string_view, std::vector,
+                                         hash_dict>;
+  using packed_data = basic_data<std::variant, long long, std::string,
+                                 packed_list, map_proxy>;
+  using big_data = basic_data<std::variant, big_integer, std::string,
+                              std::vector, map_proxy>;
+  using big_data_view = basic_data<std::variant, big_integer_view,
+                                   std::string_view, std::vector, map_proxy>;
+
+#ifdef BENCODE_HAS_PMR
+  template<typename Key, typename Value>
+  using pmr_map_proxy = map_proxy<
+    Key, Value, std::pmr::polymorphic_allocator<std::pair<const Key, Value>>
+  >;
+
+  using pmr_data = basic_data<std::variant, long long, std::pmr::string,
+                              std::pmr::vector, pmr_map_proxy>;
+  using pmr_data_view = basic_data<std::variant, long long, std::string_view,
+                                   std::pmr::vector, pmr_map_proxy>;
+#endif
+
+#ifdef BENCODE_HAS_BOOST
+  using boost_data = basic_data<boost::variant, long long, std::string,
+                                std::vector, map_proxy>;
+  using boost_data_view = basic_data<boost::variant, long long,
+                                     std::string_view, std::vector, map_proxy>;
+
+  template<>
+  struct variant_traits<boost::variant> {
+    template<typename Visitor, typename ...Variants>
+    static decltype(auto)
+    visit(Visitor &&visitor, Variants &&...variants) {
+      return boost::apply_visitor(std::forward<Visitor>(visitor),
+                                  std::forward<Variants>(variants).base()...);
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get_if(Variant *variant) {
+      return boost::get<Type>(variant);
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get_if(const Variant *variant) {
+      return boost::get<Type>(variant);
+    }
+
+    template<typename Variant>
+    inline static auto index(const Variant &variant) {
+      return variant.which();
+    }
+  };
+#endif
+
+  namespace detail {
+    // The tag stored in the last byte of a `compact_data` (and of a
+    // `compact_string`, which shares that byte with its owner).
+    enum class compact_tag : unsigned char {
+      integer, small_string, large_string, list, dict
+    };
+
+    inline constexpr std::size_t compact_tag_offset = 15;
+  }
+
+  // A string stored in 16 bytes, used as the string type of `compact_data`.
+  // Strings of up to 14 characters are stored inline; longer ones are stored
+  // on the heap, with their capacity kept in front of the characters. The
+  // last byte is a tag saying which representation is in use.
+  class compact_string {
+  public:
+    using value_type = char;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = char &;
+    using const_reference = const char &;
+    using pointer = char *;
+    using const_pointer = const char *;
+    using iterator = char *;
+    using const_iterator = const char *;
+
+    static constexpr size_type max_inline = 14;
+
+    compact_string() noexcept { set_small_size(0); }
+    compact_string(std::string_view s) : compact_string() {
+      assign(s.data(), s.size());
+    }
+    compact_string(const char *s) : compact_string(std::string_view(s)) {}
+    compact_string(const compact_string &rhs) : compact_string() {
+      assign(rhs.data(), rhs.size());
+    }
+    compact_string(compact_string &&rhs) noexcept {
+      std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+      rhs.set_small_size(0);
+    }
+
+    ~compact_string() { release(); }
+
+    compact_string & operator =(const compact_string &rhs) {
+      if(this != &rhs)
+        assign(rhs.data(), rhs.size());
+      return *this;
+    }
+
+    compact_string & operator =(compact_string &&rhs) noexcept {
+      if(this != &rhs) {
+        release();
+        std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+        rhs.set_small_size(0);
+      }
+      return *this;
+    }
+
+    compact_string & operator =(std::string_view s) {
+      return assign(s.data(), s.size());
+    }
+
+    compact_string & operator =(const char *s) {
+      return *this = std::string_view(s);
+    }
+
+    compact_string & assign(const char *s, size_type n) {
+      if(n > capacity()) {
+        compact_string tmp;
+        tmp.grow(n);
+        std::memcpy(tmp.data(), s, n);
+        tmp.set_size(n);
+        swap(tmp);
+      } else {
+        // `s` may point into our own storage, so use `memmove`.
+        if(n)
+          std::memmove(data(), s, n);
+        set_size(n);
+      }
+      return *this;
+    }
+
+    compact_string & assign(size_type n, char c) {
+      clear();
+      reserve(n);
+      std::memset(data(), c, n);
+      set_size(n);
+      return *this;
+    }
+
+    template<typename Iter, typename = std::enable_if_t<
+      !std::is_integral_v<Iter>
+    >>
+    compact_string & assign(Iter first, Iter last) {
+      auto n = static_cast<size_type>(std::distance(first, last));
+      clear();
+      reserve(n);
+      std::copy(first, last, data());
+      set_size(n);
+      return *this;
+    }
+
+    compact_string & append(const char *s, size_type n) {
+      auto old = size();
+      if(old + n > capacity())
+        reserve((std::max)(old + n, capacity() * 2));
+      std::memcpy(data() + old, s, n);
+      set_size(old + n);
+      return *this;
+    }
+
+    void reserve(size_type n) {
+      if(n <= capacity())
+        return;
+      compact_string tmp;
+      tmp.grow(n);
+      std::memcpy(tmp.data(), data(), size());
+      tmp.set_size(size());
+      swap(tmp);
+    }
+
+    void clear() noexcept { set_size(0); }
+
+    void swap(compact_string &rhs) noexcept {
+      char tmp[sizeof(bytes_)];
+      std::memcpy(tmp, bytes_, sizeof(bytes_));
+      std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+      std::memcpy(rhs.bytes_, tmp, sizeof(bytes_));
+    }
+
+    char * data() noexcept { return is_inline() ? bytes_ : heap_chars(); }
+    const char * data() const noexcept {
+      return is_inline() ? bytes_ : heap_chars();
+    }
+
+    size_type size() const noexcept {
+      if(is_inline())
+        return static_cast<unsigned char>(bytes_[max_inline]);
+      std::uint32_t n;
+      std::memcpy(&n, bytes_ + sizeof(char *), sizeof(n));
+      return n;
+    }
+
+    size_type length() const noexcept { return size(); }
+    bool empty() const noexcept { return size() == 0; }
+
+    size_type capacity() const noexcept {
+      if(is_inline())
+        return max_inline;
+      size_type n;
+      std::memcpy(&n, heap_chars() - sizeof(size_type), sizeof(n));
+      return n;
+    }
+
+    static constexpr size_type max_size() noexcept {
+      return (std::numeric_limits<std::uint32_t>::max)();
+    }
+
+    // Whether this string is short enough to be stored inline.
+    bool is_inline() const noexcept {
+      return tag() == detail::compact_tag::small_string;
+    }
+
+    iterator begin() noexcept { return data(); }
+    const_iterator begin() const noexcept { return data(); }
+    iterator end() noexcept { return data() + size(); }
+    const_iterator end() const noexcept { return data() + size(); }
+
+    char & operator [](size_type i) noexcept { return data()[i]; }
+    const char & operator [](size_type i) const noexcept {
+      return data()[i];
+    }
+
+    std::string_view view() const noexcept { return {data(), size()}; }
+    operator std::string_view() const noexcept { return view(); }
+
+    int compare(std::string_view rhs) const noexcept {
+      return view().compare(rhs);
+    }
+  private:
+    detail::compact_tag tag() const noexcept {
+      return static_cast<detail::compact_tag>(
+        bytes_[detail::compact_tag_offset]
+      );
+    }
+
+    void set_tag(detail::compact_tag tag) noexcept {
+      bytes_[detail::compact_tag_offset] = static_cast<char>(tag);
+    }
+
+    void set_small_size(size_type n) noexcept {
+      bytes_[max_inline] = static_cast<char>(n);
+      set_tag(detail::compact_tag::small_string);
+    }
+
+    void set_size(size_type n) noexcept {
+      if(is_inline()) {
+        bytes_[max_inline] = static_cast<char>(n);
+      } else {
+        auto n32 = static_cast<std::uint32_t>(n);
+        std::memcpy(bytes_ + sizeof(char *), &n32, sizeof(n32));
+      }
+    }
+
+    char * heap_chars() const noexcept {
+      char *p;
+      std::memcpy(&p, bytes_, sizeof(p));
+      return p;
+    }
+
+    // Switch an empty string to heap storage able to hold `n` characters.
+    void grow(size_type n) {
+      assert(empty() && is_inline());
+      if(n > max_size())
+        detail::throw_exception<std::length_error>("string too long");
+      char *block = new char[sizeof(size_type) + n];
+      std::memcpy(block, &n, sizeof(n));
+      char *p = block + sizeof(size_type);
+      std::memcpy(bytes_, &p, sizeof(p));
+      set_tag(detail::compact_tag::large_string);
+      set_size(0);
+    }
+
+    void release() noexcept {
+      if(!is_inline())
+        delete[] (heap_chars() - sizeof(size_type));
+    }
+
+    alignas(char *) char bytes_[16];
+  };
+
+  inline void swap(compact_string &lhs, compact_string &rhs) noexcept {
+    lhs.swap(rhs);
+  }
+
+#define BENCODE_COMPACT_STRING_RELOP(op)                                      \
+  inline bool operator op(const compact_string &lhs,                          \
+                          const compact_string &rhs) noexcept {               \
+    return lhs.compare(rhs) op 0;                                             \
+  }                                                                           \
+  inline bool operator op(const compact_string &lhs,                          \
+                          std::string_view rhs) noexcept {                    \
+    return lhs.compare(rhs) op 0;                                             \
+  }                                                                           \
+  inline bool operator op(std::string_view lhs,                               \
+                          const compact_string &rhs) noexcept {               \
+    return 0 op rhs.compare(lhs);                                             \
+  }                                                                           \
+  inline bool operator op(const compact_string &lhs,                          \
+                          const char *rhs) noexcept {                         \
+    return lhs.compare(rhs) op 0;                                             \
+  }                                                                           \
+  inline bool operator op(const char *lhs,                                    \
+                          const compact_string &rhs) noexcept {               \
+    return 0 op rhs.compare(lhs);                                             \
+  }
+
+  BENCODE_COMPACT_STRING_RELOP(==)
+  BENCODE_COMPACT_STRING_RELOP(!=)
+  BENCODE_COMPACT_STRING_RELOP(>=)
+  BENCODE_COMPACT_STRING_RELOP(<=)
+  BENCODE_COMPACT_STRING_RELOP(>)
+  BENCODE_COMPACT_STRING_RELOP(<)
+
+  // A bencode value packed into 16 bytes: a union of an integer, a
+  // `compact_string`, or a pointer to a heap-allocated list or dict, with a
+  // tag in the last byte. This is less than half the size of `data`, so a
+  // decoded document uses much less memory, and since the tag is read
+  // directly, visiting a node is a single `switch`. Like `data`, this can be
+  // used with `basic_parser` and `encode`.
+  class compact_data {
+  public:
+    using integer = long long;
+    using string = compact_string;
+    using list = std::vector<compact_data>;
+    using dict = map_proxy<compact_string, compact_data>;
+
+    compact_data() noexcept : integer_(0) {
+      set_tag(detail::compact_tag::integer);
+    }
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    compact_data(T value) noexcept : integer_(value) {
+      set_tag(detail::compact_tag::integer);
+    }
+
+    compact_data(string value) noexcept : string_(std::move(value)) {}
+    compact_data(std::string_view value) : string_(value) {}
+    compact_data(const std::string &value)
+      : string_(std::string_view(value)) {}
+    compact_data(const char *value) : string_(value) {}
+
+    compact_data(list value) : list_(new list(std::move(value))) {
+      set_tag(detail::compact_tag::list);
+    }
+
+    compact_data(dict value) : dict_(new dict(std::move(value))) {
+      set_tag(detail::compact_tag::dict);
+    }
+
+    // As with `basic_data`, copying and destroying nested lists and dicts
+    // switch to an explicit stack past `detail::max_recursion`, so
+    // deeply-nested data doesn't overflow the stack.
+    compact_data(const compact_data &rhs) {
+      switch(rhs.tag()) {
+      case detail::compact_tag::integer:
+        integer_ = rhs.integer_;
+        break;
+      case detail::compact_tag::list:
+      case detail::compact_tag::dict:
+        if(detail::recursion_guard guard;
+           guard.exceeded() && rhs.nested()) {
+          compact_data tmp = copy_nested(rhs);
+          take(tmp);
+          return;
+        } else if(rhs.tag() == detail::compact_tag::list) {
+          list_ = new list(*rhs.list_);
+        } else {
+          dict_ = new dict(*rhs.dict_);
+        }
+        break;
+      default:
+        new (&string_) string(rhs.string_);
+        return;
+      }
+      set_tag(rhs.tag());
+    }
+
+    compact_data(compact_data &&rhs) noexcept { take(rhs); }
+
+    ~compact_data() { destroy(); }
+
+    compact_data & operator =(const compact_data &rhs) {
+      if(this != &rhs) {
+        compact_data tmp(rhs);
+        destroy();
+        take(tmp);
+      }
+      return *this;
+    }
+
+    compact_data & operator =(compact_data &&rhs) noexcept {
+      if(this != &rhs) {
+        // `rhs` might be owned by us, so move it out before destroying our
+        // contents.
+        compact_data tmp(std::move(rhs));
+        destroy();
+        take(tmp);
+      }
+      return *this;
+    }
+
+    compact_data & operator =(integer value) noexcept {
+      destroy();
+      integer_ = value;
+      set_tag(detail::compact_tag::integer);
+      return *this;
+    }
+
+    void swap(compact_data &rhs) noexcept {
+      compact_data tmp(std::move(rhs));
+      rhs = std::move(*this);
+      *this = std::move(tmp);
+    }
+
+    // The index of the type held, in the same order as `data`: integer,
+    // string, list, and dict.
+    std::size_t index() const noexcept {
+      switch(tag()) {
+      case detail::compact_tag::integer:
+        return 0;
+      case detail::compact_tag::list:
+        return 2;
+      case detail::compact_tag::dict:
+        return 3;
+      default:
+        return 1;
+      }
+    }
+
+    template<typename T>
+    T * get_if() noexcept {
+      return const_cast<T *>(std::as_const(*this).get_if<T>());
+    }
+
+    template<typename T>
+    const T * get_if() const noexcept {
+      if constexpr(std::is_same_v<T, integer>) {
+        return tag() == detail::compact_tag::integer ? &integer_ : nullptr;
+      } else if constexpr(std::is_same_v<T, string>) {
+        auto t = tag();
+        return t == detail::compact_tag::small_string ||
+               t == detail::compact_tag::large_string ? &string_ : nullptr;
+      } else if constexpr(std::is_same_v<T, list>) {
+        return tag() == detail::compact_tag::list ? list_ : nullptr;
+      } else {
+        static_assert(std::is_same_v<T, dict>, "invalid type for data");
+        return tag() == detail::compact_tag::dict ? dict_ : nullptr;
+      }
+    }
+
+    template<typename T>
+    T & get() {
+      return const_cast<T &>(std::as_const(*this).get<T>());
+    }
+
+    template<typename T>
+    const T & get() const {
+      if(auto p = get_if<T>())
+        return *p;
+      detail::throw_exception<std::bad_variant_access>();
+    }
+
+    template<typename Visitor>
+    decltype(auto) visit(Visitor &&visitor) {
+      switch(tag()) {
+      case detail::compact_tag::integer:
+        return std::forward<Visitor>(visitor)(integer_);
+      case detail::compact_tag::list:
+        return std::forward<Visitor>(visitor)(*list_);
+      case detail::compact_tag::dict:
+        return std::forward<Visitor>(visitor)(*dict_);
+      default:
+        return std::forward<Visitor>(visitor)(string_);
+      }
+    }
+
+    template<typename Visitor>
+    decltype(auto) visit(Visitor &&visitor) const {
+      switch(tag()) {
+      case detail::compact_tag::integer:
+        return std::forward<Visitor>(visitor)(integer_);
+      case detail::compact_tag::list:
+        return std::forward<Visitor>(visitor)(std::as_const(*list_));
+      case detail::compact_tag::dict:
+        return std::forward<Visitor>(visitor)(std::as_const(*dict_));
+      default:
+        return std::forward<Visitor>(visitor)(string_);
+      }
+    }
+  private:
+    // The tag lives in the last byte of the union. For strings, it's part of
+    // `string_` itself; otherwise, it's past the end of the active member.
+    detail::compact_tag tag() const noexcept {
+      return static_cast<detail::compact_tag>(
+        reinterpret_cast<const unsigned char *>(this)
+        [detail::compact_tag_offset]
+      );
+    }
+
+    void set_tag(detail::compact_tag tag) noexcept {
+      reinterpret_cast<unsigned char *>(this)[detail::compact_tag_offset] =
+        static_cast<unsigned char>(tag);
+    }
+
+    // Take the contents of `rhs`, which is left holding the integer 0. Our
+    // current contents must already have been destroyed.
+    void take(compact_data &rhs) noexcept {
+      switch(rhs.tag()) {
+      case detail::compact_tag::integer:
+        integer_ = rhs.integer_;
+        break;
+      case detail::compact_tag::list:
+        list_ = rhs.list_;
+        break;
+      case detail::compact_tag::dict:
+        dict_ = rhs.dict_;
+        break;
+      default:
+        new (&string_) string(std::move(rhs.string_));
+        rhs.string_.~string();
+        rhs.integer_ = 0;
+        rhs.set_tag(detail::compact_tag::integer);
+        return;
+      }
+      set_tag(rhs.tag());
+      rhs.integer_ = 0;
+      rhs.set_tag(detail::compact_tag::integer);
+    }
+
+    void destroy() noexcept {
+      switch(tag()) {
+      case detail::compact_tag::integer:
+        break;
+      case detail::compact_tag::list:
+      case detail::compact_tag::dict: {
+        detail::recursion_guard guard;
+        if(guard.exceeded())
+          destroy_nested();
+        if(tag() == detail::compact_tag::list)
+          delete list_;
+        else
+          delete dict_;
+        break;
+      }
+      default:
+        string_.~string();
+        break;
+      }
+    }
+
+    // Whether this is a non-empty list or dict, i.e. whether copying or
+    // destroying it could recurse.
+    bool nested() const noexcept {
+      switch(tag()) {
+      case detail::compact_tag::list:
+        return !list_->empty();
+      case detail::compact_tag::dict:
+        return !dict_->empty();
+      default:
+        return false;
+      }
+    }
+
+    // Copy a list or dict without recursing, like `detail::copy_data`: each
+    // nested list or dict gets a frame on our stack, and once all of a
+    // frame's children are copied, its result is moved into its parent's.
+    static compact_data copy_nested(const compact_data &value) {
+      struct frame {
+        const compact_data *source;
+        const string *key;
+        compact_data result;
+        list::const_iterator list_pos;
+        decltype(std::declval<const dict &>().begin()) dict_pos;
+      };
+
+      std::vector<frame> stack;
+      auto push = [&stack](const compact_data &source, const string *key) {
+        auto &f = stack.emplace_back();
+        f.source = &source;
+        f.key = key;
+        if(source.tag() == detail::compact_tag::list) {
+          list result;
+          result.reserve(source.list_->size());
+          f.result = std::move(result);
+          f.list_pos = source.list_->begin();
+        } else {
+          f.result = dict();
+          f.dict_pos = source.dict_->begin();
+        }
+      };
+      auto add = [](frame &f, const string *key, compact_data &&child) {
+        if(f.result.tag() == detail::compact_tag::list)
+          f.result.list_->push_back(std::move(child));
+        else
+          f.result.dict_->emplace_hint(f.result.dict_->end(), *key,
+                                       std::move(child));
+      };
+
+      push(value, nullptr);
+      while(true) {
+        auto &top = stack.back();
+        const string *key = nullptr;
+        const compact_data *child = nullptr;
+        if(top.source->tag() == detail::compact_tag::list) {
+          if(top.list_pos != top.source->list_->end())
+            child = &*top.list_pos++;
+        } else if(top.dict_pos != top.source->dict_->end()) {
+          key = &top.dict_pos->first;
+          child = &top.dict_pos->second;
+          ++top.dict_pos;
+        }
+
+        if(child && child->nested()) {
+          push(*child, key);
+        } else if(child) {
+          add(top, key, compact_data(*child));
+        } else {
+          compact_data done = std::move(top.result);
+          key = top.key;
+          stack.pop_back();
+          if(stack.empty())
+            return done;
+          add(stack.back(), key, std::move(done));
+        }
+      }
+    }
+
+    // Move our nested lists and dicts onto a stack and take them apart one
+    // at a time, like `detail::destroy_data`.
+    void destroy_nested() noexcept {
+      std::vector<compact_data> stack;
+      auto take_children = [&stack](compact_data &v) {
+        if(v.tag() == detail::compact_tag::list) {
+          for(auto &i : *v.list_) {
+            if(i.nested())
+              stack.push_back(std::move(i));
+          }
+        } else if(v.tag() == detail::compact_tag::dict) {
+          for(auto &i : *v.dict_) {
+            if(i.second.nested())
+              stack.push_back(std::move(i.second));
+          }
+        }
+      };
+
+      take_children(*this);
+      while(!stack.empty()) {
+        compact_data v = std::move(stack.back());
+        stack.pop_back();
+        take_children(v);
+      }
+    }
+
+    union {
+      integer integer_;
+      list *list_;
+      dict *dict_;
+      string string_;
+    };
+  };
+
+  inline void swap(compact_data &lhs, compact_data &rhs) noexcept {
+    lhs.swap(rhs);
+  }
+
+  template<>
+  struct variant_traits_for<compact_data> {
+    template<typename Visitor, typename Data>
+    inline static decltype(auto) visit(Visitor &&visitor, Data &&data) {
+      return data.visit(std::forward<Visitor>(visitor));
+    }
+
+    template<typename Type, typename Data>
+    inline static auto get_if(Data *data) {
+      return data->template get_if<Type>();
+    }
+
+    inline static auto index(const compact_data &data) {
+      return data.index();
+    }
+  };
+
+  // Like `basic_data`, this compares without recursing past
+  // `detail::max_recursion`.
+  inline bool operator ==(const compact_data &lhs, const compact_data &rhs) {
+    return detail::compare_data<true>(lhs, rhs) == 0;
+  }
+
+  inline bool operator !=(const compact_data &lhs, const compact_data &rhs) {
+    return !(lhs == rhs);
+  }
+
+  using compact_list = compact_data::list;
+  using compact_dict = compact_data::dict;
+
+  using integer = data::integer;
+  using string = data::string;
+  using list = data::list;
+  using dict = data::dict;
+
+  using integer_view = data_view::integer;
+  using string_view = data_view::string;
+  using list_view = data_view::list;
+  using dict_view = data_view::dict;
+
+  using list_byte_view = byte_data_view::list;
+  using dict_byte_view = byte_data_view::dict;
+
+  using interned_list = interned_data::list;
+  using interned_dict = interned_data::dict;
+
+#ifdef BENCODE_HAS_PMR
+  using pmr_list = pmr_data::list;
+  using pmr_dict = pmr_data::dict;
+
+  using pmr_list_view = pmr_data_view::list;
+  using pmr_dict_view = pmr_data_view::dict;
+#endif
+
+  enum eof_behavior {
+    check_eof,
+    no_check_eof
+  };
+
+  // In strict mode, only canonically-encoded data is accepted: dict keys must
+  // be in ascending order, and integers (and string lengths) may not have
+  // leading zeros or be negative zero.
+  enum decode_mode {
+    lenient,
+    strict
+  };
+
+  // How `basic_parser` allocates storage for lists (and dicts, if they can
+  // reserve space). By default, each list grows as its elements are decoded.
+  // With `presized`, the parser first makes a quick pass over the input to
+  // count the elements of every list and dict so that each can be allocated
+  // exactly once; this requires forward iterators.
+  enum allocation_mode {
+    incremental,
+    presized
+  };
+
+  // The reasons decoding can fail. `basic_decode` reports these by throwing
+  // `std::invalid_argument`; `try_basic_decode` returns them directly.
+  enum class decode_errc {
+    ok = 0,
+    unexpected_eos,
+    unexpected_type,
+    unexpected_e,
+    expected_e,
+    expected_colon,
+    expected_string,
+    expected_unsigned,
+    expected_digit,
+    integer_overflow,
+    integer_underflow,
+    leading_zero,
+    negative_zero,
+    duplicated_key,
+    unsorted_keys,
+    out_of_capacity,
+    missing_key,
+    nesting_too_deep
+  };
+
+  inline const char * error_message(decode_errc e) noexcept {
+    switch(e) {
+    case decode_errc::ok:                return "success";
+    case decode_errc::unexpected_eos:    return "unexpected end of string";
+    case decode_errc::unexpected_type:   return "unexpected type";
+    case decode_errc::unexpected_e:      return "unexpected e";
+    case decode_errc::expected_e:        return "expected 'e'";
+    case decode_errc::expected_colon:    return "expected ':'";
+    case decode_errc::expected_string:   return "expected string token";
+    case decode_errc::expected_unsigned: return "expected unsigned integer";
+    case decode_errc::expected_digit:    return "expected digit";
+    case decode_errc::integer_overflow:  return "integer overflow";
+    case decode_errc::integer_underflow: return "integer underflow";
+    case decode_errc::leading_zero:      return "unexpected leading zero";
+    case decode_errc::negative_zero:     return "unexpected negative zero";
+    case decode_errc::duplicated_key:    return "duplicated key in dict";
+    case decode_errc::unsorted_keys:     return "dict keys not sorted";
+    case decode_errc::out_of_capacity:   return "out of node capacity";
+    case decode_errc::missing_key:       return "key not found";
+    case decode_errc::nesting_too_deep:  return "nesting too deep";
+    }
+    return "unknown error";
+  }
+
+  // The result of a non-throwing decode. On success, this holds the decoded
+  // value; on failure, it holds the error code. In either case, `offset()`
+  // is the number of bytes consumed before decoding stopped.
+  template<typename T>
+  class decode_result {
+  public:
+    using value_type = T;
+
+    decode_result(T value, std::size_t offset)
+      : value_(std::move(value)), offset_(offset) {}
+    decode_result(decode_errc error, std::size_t offset)
+      : error_(error), offset_(offset) {}
+
+    bool has_value() const noexcept { return error_ == decode_errc::ok; }
+    explicit operator bool() const noexcept { return has_value(); }
+
+    decode_errc error() const noexcept { return error_; }
+    std::size_t offset() const noexcept { return offset_; }
+
+    T & value() & { assert(has_value()); return value_; }
+    const T & value() const & { assert(has_value()); return value_; }
+    T && value() && { assert(has_value()); return std::move(value_); }
+
+    T & operator *() & { return value(); }
+    const T & operator *() const & { return value(); }
+    T && operator *() && { return std::move(*this).value(); }
+    T * operator ->() { return &value(); }
+    const T * operator ->() const { return &value(); }
+  private:
+    T value_;
+    decode_errc error_ = decode_errc::ok;
+    std::size_t offset_;
+  };
+
+  // The result of a non-throwing decode into an existing object.
+  template<>
+  class decode_result<void> {
+  public:
+    using value_type = void;
+
+    decode_result(decode_errc error, std::size_t offset)
+      : error_(error), offset_(offset) {}
+
+    bool has_value() const noexcept { return error_ == decode_errc::ok; }
+    explicit operator bool() const noexcept { return has_value(); }
+
+    decode_errc error() const noexcept { return error_; }
+    std::size_t offset() const noexcept { return offset_; }
+  private:
+    decode_errc error_;
+    std::size_t offset_;
+  };
+
+  // The storage needed to decode a value, as computed by `measure`.
+  struct decode_size {
+    // The number of values, including the root but not including dict keys.
+    std::size_t values = 0;
+    // The total length of every string, including dict keys.
+    std::size_t string_bytes = 0;
+  };
+
+  // The iterator category for `segmented_buffer::iterator`. This lets the
+  // decoder read strings a segment at a time instead of byte by byte.
+  struct segmented_iterator_tag : std::forward_iterator_tag {};
+
+  // A chain of buffer segments (e.g. as received from the network) which can
+  // be decoded as though it were one contiguous buffer. When decoding as a
+  // view, strings that fit in one segment point directly into it; strings that
+  // straddle segments are copied into storage owned by the `segmented_buffer`.
+  // Thus, both the segments and the `segmented_buffer` itself must outlive the
+  // decoded data.
+  class segmented_buffer {
+  public:
+    class iterator {
+    public:
+      using iterator_category = segmented_iterator_tag;
+      using value_type = char;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const char *;
+      using reference = const char &;
+
+      iterator() = default;
+
+      reference operator *() const { return *pos_; }
+      pointer operator ->() const { return pos_; }
+
+      iterator & operator ++() {
+        if(++pos_ == segment_end_)
+          next_segment();
+        return *this;
+      }
+
+      iterator operator ++(int) {
+        iterator tmp = *this;
+        ++*this;
+        return tmp;
+      }
+
+      bool operator ==(const iterator &rhs) const {
+        return pos_ == rhs.pos_ && segment_ == rhs.segment_;
+      }
+
+      bool operator !=(const iterator &rhs) const {
+        return !(*this == rhs);
+      }
+
+      // The number of bytes between the start of the buffer and here.
+      std::size_t offset() const {
+        if(segment_ == buffer_->segments_.size())
+          return buffer_->size_;
+        return buffer_->starts_[segment_] +
+               (pos_ - buffer_->segments_[segment_].data());
+      }
+
+      // The bytes from here to the end of the current segment.
+      std::string_view contiguous() const {
+        return std::string_view(pos_, segment_end_ - pos_);
+      }
+
+      // Advance by `n` bytes, where `n <= contiguous().size()`.
+      void skip(std::size_t n) {
+        assert(n <= contiguous().size());
+        pos_ += n;
+        if(n && pos_ == segment_end_)
+          next_segment();
+      }
+
+      const segmented_buffer & buffer() const { return *buffer_; }
+    private:
+      friend class segmented_buffer;
+
+      iterator(const segmented_buffer *buffer, std::size_t segment)
+        : buffer_(buffer), segment_(segment) {
+        settle();
+      }
+
+      void next_segment() {
+        ++segment_;
+        settle();
+      }
+
+      // Move to the first non-empty segment at or after the current one.
+      void settle() {
+        auto &segments = buffer_->segments_;
+        for(; segment_ != segments.size(); ++segment_) {
+          if(!segments[segment_].empty()) {
+            pos_ = segments[segment_].data();
+            segment_end_ = pos_ + segments[segment_].size();
+            return;
+          }
+        }
+        pos_ = segment_end_ = nullptr;
+      }
+
+      const segmented_buffer *buffer_ = nullptr;
+      std::size_t segment_ = 0;
+      const char *pos_ = nullptr;
+      const char *segment_end_ = nullptr;
+    };
+
+    using const_iterator = iterator;
+
+    segmented_buffer() = default;
+
+    segmented_buffer(std::initializer_list<std::string_view> segments) {
+      for(auto &&i : segments)
+        append(i);
+    }
+
+    template<typename Iter>
+    segmented_buffer(Iter first, Iter last) {
+      for(; first != last; ++first)
+        append(*first);
+    }
+
+    void append(std::string_view segment) {
+      starts_.push_back(size_);
+      segments_.push_back(segment);
+      size_ += segment.size();
+    }
+
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    std::size_t segment_count() const noexcept { return segments_.size(); }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, segments_.size()); }
+
+    // Take ownership of a string which straddled a segment boundary, returning
+    // a view of it that lives as long as this buffer.
+    std::string_view stash(std::string value) const {
+      return stash_.emplace_back(std::move(value));
+    }
+  private:
+    std::vector<std::string_view> segments_;
+    std::vector<std::size_t> starts_;
+    std::size_t size_ = 0;
+    mutable std::deque<std::string> stash_;
+  };
+
+  template<typename Data, typename Iter>
+  Data basic_decode(Iter &begin, Iter end, decode_mode mode = lenient);
+
+  namespace detail {
+    template<typename Integer>
+    inline bool overflows(Integer value, Integer digit) {
+      using limits = std::numeric_limits<Integer>;
+      return (value > (limits::max)() / 10) ||
+             (value == (limits::max)() / 10 && digit > (limits::max)() % 10);
+    }
+
+    template<typename Integer>
+    inline bool underflows(Integer value, Integer digit) {
+      using limits = std::numeric_limits<Integer>;
+      return (value < (limits::min)() / 10) ||
+             (value == (limits::min)() / 10 && digit < (limits::min)() % 10);
+    }
+
+    template<typename Integer>
+    inline decode_errc out_of_range_error(Integer sgn) {
+      return sgn == 1 ? decode_errc::integer_overflow :
+                        decode_errc::integer_underflow;
+    }
+
+    template<typename Integer, typename Iter>
+    inline decode_errc
+    decode_digits(Iter &begin, Iter end, Integer &value,
+                  [[maybe_unused]] Integer sgn = 1) {
+      assert(sgn == 1 || (std::is_signed_v<Integer> &&
+                          std::make_signed_t<Integer>(sgn) == -1));
+
+      value = 0;
+
+      // For performance, decode as many digits as we know will fit within an
+      // `Integer` value, and then if there are any more beyond that, do
+      // proper overflow detection.
+      for(int i = 0; i != std::numeric_limits<Integer>::digits10; i++) {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+        if(!std::isdigit(*begin))
+          return decode_errc::ok;
+
+        if constexpr(std::is_signed_v<Integer>)
+          value = value * 10 + (*begin++ - '0') * sgn;
+        else
+          value = value * 10 + (*begin++ - '0');
+      }
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+
+      // We're approaching the limits of what `Integer` can hold. Check for
+      // overflow.
+      if(std::isdigit(*begin)) {
+        Integer digit;
+        if constexpr(std::is_signed_v<Integer>) {
+          digit = (*begin++ - '0') * sgn;
+          if(sgn == 1 ? overflows(value, digit) : underflows(value, digit))
+            return out_of_range_error(sgn);
+        } else {
+          digit = (*begin++ - '0');
+          if(overflows(value, digit))
+            return decode_errc::integer_overflow;
+        }
+        value = value * 10 + digit;
+      }
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+
+      // Still more digits? That's too many!
+      if(std::isdigit(*begin))
+        return out_of_range_error(sgn);
+
+      return decode_errc::ok;
+    }
+
+    // Like `decode_digits`, but only accept canonical numbers: there must be at
+    // least one digit, and zero must be written as a lone "0".
+    template<typename Integer, typename Iter>
+    inline decode_errc
+    decode_canonical_digits(Iter &begin, Iter end, Integer &value,
+                            Integer sgn = 1) {
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+      if(!std::isdigit(*begin))
+        return decode_errc::expected_digit;
+      if(*begin != '0')
+        return decode_digits<Integer>(begin, end, value, sgn);
+
+      if(sgn != 1)
+        return decode_errc::negative_zero;
+      ++begin;
+      value = 0;
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+      if(std::isdigit(*begin))
+        return decode_errc::leading_zero;
+      return decode_errc::ok;
+    }
+
+    template<bool Strict, typename Integer, typename Iter>
+    inline decode_errc
+    decode_number(Iter &begin, Iter end, Integer &value, Integer sgn = 1) {
+      if constexpr(Strict)
+        return decode_canonical_digits<Integer>(begin, end, value, sgn);
+      else
+        return decode_digits<Integer>(begin, end, value, sgn);
+    }
+
+    template<bool Strict, typename String, typename Iter>
+    decode_errc decode_big_int(Iter &begin, Iter end,
+                               basic_big_integer<String> &value);
+
+    template<typename Integer, bool Strict = false, typename Iter>
+    decode_errc decode_int(Iter &begin, Iter end, Integer &value) {
+      if constexpr(is_big_integer_v<Integer>) {
+        return decode_big_int<Strict>(begin, end, value);
+      } else {
+        assert(*begin == 'i');
+        ++begin;
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+
+        Integer sgn = 1;
+        if(*begin == '-') {
+          if constexpr(std::is_unsigned_v<Integer>) {
+            return decode_errc::expected_unsigned;
+          } else {
+            sgn = -1;
+            ++begin;
+          }
+        }
+
+        if(auto ec = decode_number<Strict, Integer>(begin, end, value, sgn);
+           ec != decode_errc::ok)
+          return ec;
+        if(*begin != 'e')
+          return decode_errc::expected_e;
+
+        ++begin;
+        return decode_errc::ok;
+      }
+    }
+
+    template<typename Iter>
+    inline constexpr bool is_segmented_iterator_v = std::is_base_of_v<
+      segmented_iterator_tag,
+      typename std::iterator_traits<Iter>::iterator_category
+    >;
+
+    // The distance between two iterators, without walking the whole range for
+    // segmented buffers.
+    template<typename Iter>
+    inline std::size_t iter_distance(const Iter &first, const Iter &last) {
+      if constexpr(is_segmented_iterator_v<Iter>)
+        return last.offset() - first.offset();
+      else
+        return std::distance(first, last);
+    }
+
+    // Advance `begin` by `n`, returning false if we'd pass `end`. Unlike
+    // checking `std::distance(begin, end)` first, this is O(n) rather than
+    // O(end - begin) for non-random-access iterators.
+    template<typename Iter, typename Size>
+    inline bool advance_checked(Iter &begin, Iter end, Size n) {
+      using category = typename std::iterator_traits<Iter>::iterator_category;
+      if constexpr(std::is_base_of_v<std::random_access_iterator_tag,
+                                     category>) {
+        if(end - begin < static_cast<std::ptrdiff_t>(n))
+          return false;
+        begin += n;
+      } else {
+        for(; n != 0; --n, ++begin) {
+          if(begin == end)
+            return false;
+        }
+      }
+      return true;
+    }
+
+    template<typename String>
+    class str_reader {
+    public:
+      template<typename Iter, typename Size>
+      inline decode_errc
+      operator ()(Iter &begin, Iter end, Size len, String &value) {
+        return call(
+          begin, end, len, value,
+          typename std::iterator_traits<Iter>::iterator_category()
+        );
+      }
+    private:
+      template<typename Iter, typename Size>
+      decode_errc call(Iter &begin, Iter end, Size len, String &value,
+                       segmented_iterator_tag) {
+        auto orig = begin;
+        value.clear();
+        value.reserve(len);
+        while(len != 0) {
+          if(begin == end) {
+            begin = orig;
+            return decode_errc::unexpected_eos;
+          }
+          auto chunk = begin.contiguous();
+          auto n = (std::min)(chunk.size(), static_cast<std::size_t>(len));
+          value.append(chunk.data(), n);
+          begin.skip(n);
+          len -= n;
+        }
+        return decode_errc::ok;
+      }
+
+      template<typename Iter, typename Size>
+      decode_errc call(Iter &begin, Iter end, Size len, String &value,
+                       std::forward_iterator_tag) {
+        auto orig = begin;
+        if(!advance_checked(begin, end, len)) {
+          begin = orig;
+          return decode_errc::unexpected_eos;
+        }
+        value.assign(orig, begin);
+        return decode_errc::ok;
+      }
+
+      template<typename Iter, typename Size>
+      decode_errc call(Iter &begin, Iter end, Size len, String &value,
+                       std::input_iterator_tag) {
+        value.assign(len, 0);
+        for(Size i = 0; i < len; i++) {
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+          value[i] = *begin++;
+        }
+        return decode_errc::ok;
+      }
+    };
+
+    template<>
+    class str_reader<std::string_view> {
+    public:
+      template<typename Iter, typename Size>
+      inline decode_errc operator ()(Iter &begin, Iter end, Size len,
+                                     std::string_view &value) {
+        return call(
+          begin, end, len, value,
+          typename std::iterator_traits<Iter>::iterator_category()
+        );
+      }
+    private:
+      template<typename Iter, typename Size>
+      decode_errc call(Iter &begin, Iter end, Size len,
+                       std::string_view &value, segmented_iterator_tag) {
+        // If the whole string is in this segment, just point to it; otherwise,
+        // copy it into storage owned by the buffer.
+        if(auto chunk = begin.contiguous(); chunk.size() >= len) {
+          value = chunk.substr(0, len);
+          begin.skip(len);
+          return decode_errc::ok;
+        }
+
+        std::string copy;
+        if(auto ec = str_reader<std::string>{}(begin, end, len, copy);
+           ec != decode_errc::ok)
+          return ec;
+        value = begin.buffer().stash(std::move(copy));
+        return decode_errc::ok;
+      }
+
+      template<typename Iter, typename Size>
+      decode_errc call(Iter &begin, Iter end, Size len,
+                       std::string_view &value, std::forward_iterator_tag) {
+        auto orig = begin;
+        if(!advance_checked(begin, end, len)) {
+          begin = orig;
+          return decode_errc::unexpected_eos;
+        }
+        value = len ? std::string_view(&*orig, len) : std::string_view();
+        return decode_errc::ok;
+      }
+    };
+
+    template<>
+    class str_reader<bytes_view> {
+    public:
+      template<typename Iter, typename Size>
+      inline decode_errc operator ()(Iter &begin, Iter end, Size len,
+                                     bytes_view &value) {
+        std::string_view chars;
+        if(auto ec = str_reader<std::string_view>{}(begin, end, len, chars);
+           ec != decode_errc::ok)
+          return ec;
+        value = bytes_view(chars);
+        return decode_errc::ok;
+      }
+    };
+
+    // Read the digits of an integer too big for a `long long`. `begin` points
+    // to the first digit (after any sign).
+    template<typename String, typename Iter>
+    decode_errc decode_big_digits(Iter &begin, Iter end,
+                                  basic_big_integer<String> &value,
+                                  bool negative) {
+      // Leading zeros are only possible in lenient mode; skip them.
+      while(*begin == '0') {
+        auto next = std::next(begin);
+        if(next == end || !std::isdigit(*next))
+          break;
+        begin = next;
+      }
+
+      auto start = begin;
+      std::size_t len = 0;
+      for(; begin != end && std::isdigit(*begin); ++begin)
+        len++;
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+
+      begin = start;
+      String digits;
+      if(auto ec = str_reader<String>{}(begin, end, len, digits);
+         ec != decode_errc::ok)
+        return ec;
+      value = basic_big_integer<String>(negative, std::move(digits));
+      return decode_errc::ok;
+    }
+
+    // Decode an integer of any size. Values that fit in a `long long` are
+    // decoded just as quickly as an ordinary `long long`; only if that
+    // overflows do we go back and collect the digits.
+    template<bool Strict, typename String, typename Iter>
+    decode_errc decode_big_int(Iter &begin, Iter end,
+                               basic_big_integer<String> &value) {
+      assert(*begin == 'i');
+      ++begin;
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+
+      bool negative = *begin == '-';
+      if(negative)
+        ++begin;
+
+      using category = typename std::iterator_traits<Iter>::iterator_category;
+      if constexpr(std::is_base_of_v<std::forward_iterator_tag, category>) {
+        auto digits = begin;
+        long long small;
+        auto ec = decode_number<Strict, long long>(begin, end, small,
+                                                   negative ? -1 : 1);
+        if(ec == decode_errc::integer_overflow ||
+           ec == decode_errc::integer_underflow) {
+          begin = digits;
+          ec = decode_big_digits(begin, end, value, negative);
+        } else if(ec == decode_errc::ok) {
+          value = small;
+        }
+        if(ec != decode_errc::ok)
+          return ec;
+      } else {
+        // We can't go back over single-pass input, so copy the digits (and
+        // a terminator) and decode those instead.
+        static_assert(!std::is_same_v<String, std::string_view>,
+                      "big_integer_view requires forward iterators");
+        std::string text;
+        for(; begin != end && std::isdigit(*begin); ++begin)
+          text.push_back(*begin);
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+        text.push_back(*begin);
+
+        const char *b = text.data(), *e = text.data() + text.size();
+        long long small;
+        auto ec = decode_number<Strict, long long>(b, e, small,
+                                                   negative ? -1 : 1);
+        if(ec == decode_errc::integer_overflow ||
+           ec == decode_errc::integer_underflow) {
+          b = text.data();
+          ec = decode_big_digits(b, e, value, negative);
+        } else if(ec == decode_errc::ok) {
+          value = small;
+        }
+        if(ec != decode_errc::ok)
+          return ec;
+      }
+
+      if(*begin != 'e')
+        return decode_errc::expected_e;
+      ++begin;
+      return decode_errc::ok;
+    }
+
+    template<bool Strict = false, typename String, typename Iter>
+    decode_errc decode_str(Iter &begin, Iter end, String &value) {
+      assert(std::isdigit(*begin));
+      std::size_t len;
+      if(auto ec = decode_number<Strict, std::size_t>(begin, end, len);
+         ec != decode_errc::ok)
+        return ec;
+      if(*begin != ':')
+        return decode_errc::expected_colon;
+      ++begin;
+
+      return str_reader<String>{}(begin, end, len, value);
+    }
+
+    template<typename T, typename = void>
+    struct node_type_of {
+      using type = std::nullptr_t;
+    };
+
+    template<typename T>
+    struct node_type_of<T, std::void_t<typename T::node_type>> {
+      using type = typename T::node_type;
+    };
+
+    // Whether a dict type supports extracting and reinserting its nodes.
+    template<typename T>
+    inline constexpr bool has_node_type_v = !std::is_same_v<
+      typename node_type_of<T>::type, std::nullptr_t
+    >;
+
+    template<typename T, typename = void>
+    struct allocator_of {
+      using type = std::allocator<T>;
+    };
+
+    template<typename T>
+    struct allocator_of<T, std::void_t<typename T::allocator_type>> {
+      using type = typename T::allocator_type;
+    };
+
+    // The allocator used by a container type, or `std::allocator` if it
+    // doesn't say.
+    template<typename T>
+    using allocator_of_t = typename allocator_of<T>::type;
+
+    // Create an empty `T`, passing it `alloc` if it's allocator-aware.
+    template<typename T, typename Alloc>
+    inline T make_with_allocator([[maybe_unused]] const Alloc &alloc) {
+      if constexpr(std::uses_allocator_v<T, Alloc>)
+        return T(alloc);
+      else
+        return T();
+    }
+
+    template<typename T, typename = void>
+    inline constexpr bool has_reserve_v = false;
+
+    template<typename T>
+    inline constexpr bool has_reserve_v<T, std::void_t<
+      decltype(std::declval<T &>().reserve(std::size_t()))
+    >> = true;
+
+    template<typename T>
+    inline constexpr bool is_packed_list_v = false;
+
+    template<typename Value, typename Allocator>
+    inline constexpr bool is_packed_list_v<packed_list<Value, Allocator>> =
+      true;
+
+    template<typename T>
+    inline constexpr bool is_hash_dict_v = false;
+
+    template<typename Key, typename Value, typename Allocator>
+    inline constexpr bool is_hash_dict_v<hash_dict<Key, Value, Allocator>> =
+      true;
+
+    template<typename T>
+    inline constexpr bool is_basic_string_v = false;
+
+    template<typename Char, typename Traits, typename Alloc>
+    inline constexpr bool is_basic_string_v<
+      std::basic_string<Char, Traits, Alloc>
+    > = true;
+
+    template<typename Iter>
+    inline constexpr bool is_byte_pointer_v = std::is_pointer_v<Iter> && (
+      std::is_same_v<std::remove_cv_t<std::remove_pointer_t<Iter>>,
+                     std::byte> ||
+      std::is_same_v<std::remove_cv_t<std::remove_pointer_t<Iter>>,
+                     unsigned char>
+    );
+
+    // Whether copying or destroying a value could recurse, i.e. whether it's
+    // a non-empty list or dict. Packed lists only hold scalars, so they can't.
+    template<typename Data>
+    inline bool has_nested(const Data &value) {
+      using Traits = variant_traits_for<Data>;
+      using list = typename Data::list;
+      using dict = typename Data::dict;
+
+      if(auto *l = Traits::template get_if<list>(&value)) {
+        if constexpr(is_packed_list_v<list>) {
+          if(l->is_packed())
+            return false;
+        }
+        return !l->empty();
+      }
+      if(auto *d = Traits::template get_if<dict>(&value))
+        return !d->empty();
+      return false;
+    }
+
+    // Create an empty container with the allocator that a copy of `c` would
+    // get.
+    template<typename T>
+    inline T make_empty_copy([[maybe_unused]] const T &c) {
+      using alloc_type = allocator_of_t<T>;
+      if constexpr(std::uses_allocator_v<T, alloc_type>) {
+        return T(std::allocator_traits<alloc_type>
+                 ::select_on_container_copy_construction(c.get_allocator()));
+      } else {
+        return T();
+      }
+    }
+
+    // Copy a value without recursing, for use past `max_recursion`. Each list
+    // or dict gets a frame on our stack; once all of a frame's children are
+    // copied, its result is moved into its parent's.
+    template<typename Data>
+    typename Data::base_type copy_data(const Data &value) {
+      using Traits = variant_traits_for<Data>;
+      using list = typename Data::list;
+      using dict = typename Data::dict;
+      using key_type = typename dict::key_type;
+
+      if(!has_nested(value))
+        return value.base();
+
+      struct frame {
+        const Data *source;
+        const key_type *key;
+        Data result;
+        decltype(std::declval<const list &>().begin()) list_pos;
+        decltype(std::declval<const dict &>().begin()) dict_pos;
+      };
+
+      std::vector<frame> stack;
+      auto push = [&stack](const Data &source, const key_type *key) {
+        auto &f = stack.emplace_back();
+        f.source = &source;
+        f.key = key;
+        if(auto *l = Traits::template get_if<list>(&source)) {
+          auto result = make_empty_copy(*l);
+          if constexpr(has_reserve_v<list>)
+            result.reserve(l->size());
+          f.result = std::move(result);
+          f.list_pos = l->begin();
+        } else {
+          auto *d = Traits::template get_if<dict>(&source);
+          f.result = make_empty_copy(*d);
+          f.dict_pos = d->begin();
+        }
+      };
+      auto add = [](frame &f, const key_type *key, Data &&child) {
+        if(auto *l = Traits::template get_if<list>(&f.result))
+          l->emplace_back(std::move(child));
+        else
+          Traits::template get_if<dict>(&f.result)->emplace(
+            *key, std::move(child)
+          );
+      };
+
+      push(value, nullptr);
+      while(true) {
+        auto &top = stack.back();
+        const key_type *key = nullptr;
+        const Data *child = nullptr;
+        if(auto *l = Traits::template get_if<list>(top.source)) {
+          if(top.list_pos != l->end())
+            child = &*top.list_pos++;
+        } else {
+          auto *d = Traits::template get_if<dict>(top.source);
+          if(top.dict_pos != d->end()) {
+            key = &top.dict_pos->first;
+            child = &top.dict_pos->second;
+            ++top.dict_pos;
+          }
+        }
+
+        if(child && has_nested(*child)) {
+          push(*child, key);
+        } else if(child) {
+          add(top, key, Data(*child));
+        } else {
+          Data done = std::move(top.result);
+          key = top.key;
+          stack.pop_back();
+          if(stack.empty())
+            return std::move(done.base());
+          add(stack.back(), key, std::move(done));
+        }
+      }
+    }
+
+    // Destroy the children of a value. Past `max_recursion`, we move any
+    // nested lists or dicts onto our stack instead and take them apart one
+    // at a time.
+    template<typename Data>
+    void destroy_data(Data &value) noexcept {
+      using Traits = variant_traits_for<Data>;
+      using list = typename Data::list;
+      using dict = typename Data::dict;
+
+      auto *l = Traits::template get_if<list>(&value);
+      auto *d = Traits::template get_if<dict>(&value);
+      if(!l && !d)
+        return;
+      if(recursion_guard guard; !guard.exceeded()) {
+        if(l)
+          l->clear();
+        else
+          d->clear();
+        return;
+      }
+      if(!has_nested(value))
+        return;
+
+      std::vector<Data> stack;
+      auto take_children = [&stack](Data &v) {
+        if(auto *l = Traits::template get_if<list>(&v)) {
+          if constexpr(is_packed_list_v<list>) {
+            if(l->is_packed())
+              return;
+          }
+          for(auto &i : *l) {
+            if(has_nested(i))
+              stack.push_back(std::move(i));
+          }
+        } else if(auto *d = Traits::template get_if<dict>(&v)) {
+          for(auto &i : *d) {
+            if(has_nested(i.second))
+              stack.push_back(std::move(i.second));
+          }
+        }
+      };
+
+      take_children(value);
+      while(!stack.empty()) {
+        Data v = std::move(stack.back());
+        stack.pop_back();
+        take_children(v);
+      }
+    }
+
+    // Check that a value is canonically encoded without building anything.
+    // Unlike `basic_parser`, integers may have any number of digits here.
+    template<typename Iter>
+    decode_errc scan_canonical(Iter &begin, Iter end) {
+      // Each list or dict we're currently inside of, along with the last key
+      // seen if it's a dict.
+      struct frame {
+        bool is_dict;
+        bool has_key;
+        std::string_view last_key;
+      };
+      std::vector<frame> state;
+
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+
+        if(*begin == 'e') {
+          if(state.empty())
+            return decode_errc::unexpected_e;
+          ++begin;
+          state.pop_back();
+          continue;
+        }
+
+        if(!state.empty() && state.back().is_dict) {
+          if(!std::isdigit(*begin))
+            return decode_errc::expected_string;
+          std::string_view key;
+          if(auto ec = decode_str<true>(begin, end, key);
+             ec != decode_errc::ok)
+            return ec;
+          auto &top = state.back();
+          if(top.has_key && !(top.last_key < key)) {
+            return top.last_key == key ? decode_errc::duplicated_key :
+                                         decode_errc::unsorted_keys;
+          }
+          top.has_key = true;
+          top.last_key = key;
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+        }
+
+        if(*begin == 'i') {
+          ++begin;
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+          bool negative = *begin == '-';
+          if(negative && ++begin == end)
+            return decode_errc::unexpected_eos;
+          if(!std::isdigit(*begin))
+            return decode_errc::expected_digit;
+          if(*begin == '0') {
+            if(negative)
+              return decode_errc::negative_zero;
+            ++begin;
+          } else {
+            while(begin != end && std::isdigit(*begin))
+              ++begin;
+          }
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+          if(std::isdigit(*begin))
+            return decode_errc::leading_zero;
+          if(*begin != 'e')
+            return decode_errc::expected_e;
+          ++begin;
+        } else if(*begin == 'l' || *begin == 'd') {
+          state.push_back({*begin == 'd', false, {}});
+          ++begin;
+        } else if(std::isdigit(*begin)) {
+          std::string_view value;
+          if(auto ec = decode_str<true>(begin, end, value);
+             ec != decode_errc::ok)
+            return ec;
+        } else {
+          return decode_errc::unexpected_type;
+        }
+      } while(!state.empty());
+
+      return decode_errc::ok;
+    }
+
+    // Check the keys of a dict as they're read. In strict mode, they must be
+    // sorted. In lenient mode, they only have to be unique; since they're
+    // usually sorted anyway, we only search for duplicates once we've seen
+    // one out of order, like `flat_document` does. For that, each key is also
+    // pushed onto `seen`, a stack of the keys of every open dict.
+    struct key_order {
+      bool has_key = false;
+      bool unsorted = false;
+      std::string_view last_key;
+      std::size_t first = 0;
+
+      decode_errc check(std::string_view key) {
+        if(has_key && !(last_key < key)) {
+          return last_key == key ? decode_errc::duplicated_key :
+                                   decode_errc::unsorted_keys;
+        }
+        has_key = true;
+        last_key = key;
+        return decode_errc::ok;
+      }
+
+      decode_errc check_unique(std::string_view key,
+                               std::vector<std::string_view> &seen) {
+        if(!has_key) {
+          first = seen.size();
+        } else if(!(last_key < key)) {
+          if(last_key == key)
+            return decode_errc::duplicated_key;
+          unsorted = true;
+        }
+        if(unsorted && std::find(seen.begin() + first, seen.end(), key) !=
+                       seen.end())
+          return decode_errc::duplicated_key;
+        seen.push_back(key);
+        has_key = true;
+        last_key = key;
+        return decode_errc::ok;
+      }
+
+      // Pop this dict's keys from `seen` once it's closed.
+      template<bool Strict>
+      void close(std::vector<std::string_view> &seen) const noexcept {
+        if(!Strict && has_key)
+          seen.resize(first);
+      }
+    };
+
+    // Read a dict key, checking its order in strict mode or that it's not
+    // duplicated in lenient mode.
+    template<bool Strict>
+    decode_errc read_key(const char *&begin, const char *end,
+                         key_order &order, std::string_view &key,
+                         std::vector<std::string_view> &seen) {
+      if(!std::isdigit(*begin))
+        return decode_errc::expected_string;
+      if(auto ec = decode_str<Strict>(begin, end, key); ec != decode_errc::ok)
+        return ec;
+      if(auto ec = Strict ? order.check(key) : order.check_unique(key, seen);
+         ec != decode_errc::ok)
+        return ec;
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+      return decode_errc::ok;
+    }
+
+    struct skip_frame {
+      bool is_dict;
+      key_order keys;
+    };
+
+    // Scratch space for `skip_value`: the lists and dicts it has open, and
+    // the keys read so far from every open dict (see `key_order`). Callers
+    // walking dicts of their own can share `keys` with it.
+    struct skip_state {
+      std::vector<skip_frame> frames;
+      std::vector<std::string_view> keys;
+    };
+
+    // Skip over one value, checking that it's valid (and canonical, if
+    // `Strict`) without building anything.
+    template<bool Strict>
+    decode_errc skip_value(const char *&begin, const char *end,
+                           skip_state &state) {
+      auto &frames = state.frames;
+      frames.clear();
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+
+        if(*begin == 'e') {
+          if(frames.empty())
+            return decode_errc::unexpected_e;
+          ++begin;
+          frames.back().keys.template close<Strict>(state.keys);
+          frames.pop_back();
+          continue;
+        }
+
+        if(!frames.empty() && frames.back().is_dict) {
+          std::string_view key;
+          if(auto ec = read_key<Strict>(begin, end, frames.back().keys, key,
+                                        state.keys);
+             ec != decode_errc::ok)
+            return ec;
+        }
+
+        if(*begin == 'i') {
+          long long value;
+          if(auto ec = decode_int<long long, Strict>(begin, end, value);
+             ec != decode_errc::ok)
+            return ec;
+        } else if(*begin == 'l' || *begin == 'd') {
+          frames.push_back({*begin == 'd', {}});
+          ++begin;
+        } else if(std::isdigit(*begin)) {
+          std::string_view value;
+          if(auto ec = decode_str<Strict>(begin, end, value);
+             ec != decode_errc::ok)
+            return ec;
+        } else {
+          return decode_errc::unexpected_type;
+        }
+      } while(!frames.empty());
+
+      return decode_errc::ok;
+    }
+
+    // Count the values in some bencoded data without decoding them. This
+    // fills `lengths` with the number of elements in each list and dict, in
+    // the order they're opened; `open` is scratch space. Only the structure of
+    // the data is checked, so a successful count doesn't guarantee that
+    // decoding will succeed.
+    template<typename Iter>
+    decode_errc count_values(Iter &begin, Iter end, decode_size &size,
+                             std::vector<std::size_t> &lengths,
+                             std::vector<std::size_t> &open) {
+      size = decode_size();
+      lengths.clear();
+      open.clear();
+
+      // Each entry in `open` is an index into `lengths`, shifted left by one
+      // with the low bit set for dicts. For dicts, we count keys and values
+      // separately until the dict is closed.
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+
+        if(*begin == 'e') {
+          if(open.empty())
+            return decode_errc::unexpected_e;
+          ++begin;
+          if(auto i = open.back(); i & 1) {
+            lengths[i >> 1] /= 2;
+            size.values -= lengths[i >> 1];
+          }
+          open.pop_back();
+          continue;
+        }
+
+        if(!open.empty())
+          lengths[open.back() >> 1]++;
+        size.values++;
+
+        if(*begin == 'i') {
+          do {
+            if(++begin == end)
+              return decode_errc::unexpected_eos;
+          } while(*begin != 'e');
+          ++begin;
+        } else if(*begin == 'l' || *begin == 'd') {
+          open.push_back((lengths.size() << 1) | (*begin == 'd'));
+          lengths.push_back(0);
+          ++begin;
+        } else if(std::isdigit(*begin)) {
+          std::size_t len;
+          if(auto ec = decode_digits(begin, end, len); ec != decode_errc::ok)
+            return ec;
+          if(*begin != ':')
+            return decode_errc::expected_colon;
+          ++begin;
+          if(!advance_checked(begin, end, len))
+            return decode_errc::unexpected_eos;
+          size.string_bytes += len;
+        } else {
+          return decode_errc::unexpected_type;
+        }
+      } while(!open.empty());
+
+      return decode_errc::ok;
+    }
+
+    template<typename String>
+    [[noreturn]] void throw_decode_error(decode_errc e, const String &key) {
+      if(e == decode_errc::duplicated_key || e == decode_errc::missing_key) {
+        throw_exception<std::invalid_argument>(
+          std::string(error_message(e)) + ": " + std::string(key)
+        );
+      }
+      throw_exception<std::invalid_argument>(error_message(e));
+    }
+
+    [[noreturn]] inline void
+    throw_decode_error(decode_errc e, const bytes_view &key) {
+      throw_decode_error(e, key.chars());
+    }
+
+  }
+
+  namespace detail {
+    // A stack whose first `N` elements are stored inline, for walking nested
+    // values without recursing. Most values are shallow enough that this
+    // never allocates.
+    template<typename T, std::size_t N = 8>
+    class small_stack {
+    public:
+      small_stack() = default;
+      small_stack(const small_stack &) = delete;
+      small_stack & operator =(const small_stack &) = delete;
+
+      ~small_stack() {
+        while(!empty())
+          pop();
+      }
+
+      bool empty() const noexcept { return size_ == 0; }
+
+      T & back() noexcept {
+        return size_ <= N ? *inline_at(size_ - 1) : overflow_.back();
+      }
+
+      // Push a default-initialized element.
+      T & push() {
+        if(size_ < N) {
+          auto *p = ::new(static_cast<void *>(inline_ + size_ * sizeof(T))) T;
+          size_++;
+          return *p;
+        }
+        overflow_.emplace_back();
+        size_++;
+        return overflow_.back();
+      }
+
+      void pop() noexcept {
+        if(size_ > N)
+          overflow_.pop_back();
+        else
+          inline_at(size_ - 1)->~T();
+        size_--;
+      }
+    private:
+      T * inline_at(std::size_t i) noexcept {
+        return std::launder(reinterpret_cast<T *>(inline_ + i * sizeof(T)));
+      }
+
+      alignas(T) unsigned char inline_[N * sizeof(T)];
+      std::vector<T> overflow_;
+      std::size_t size_ = 0;
+    };
+
+    // View a string (or dict key) of any of our string types as characters.
+    template<typename String>
+    inline std::string_view chars_of(const String &s) {
+      if constexpr(std::is_same_v<String, bytes_view>)
+        return s.chars();
+      else
+        return std::string_view(s.data(), s.size());
+    }
+
+    // Compare two scalars or dict keys, returning <0, 0, or >0. If `Equality`
+    // is set, we only care whether they're equal.
+    template<bool Equality, typename T>
+    inline int compare_value(const T &lhs, const T &rhs) {
+      if constexpr(Equality) {
+        return lhs == rhs ? 0 : 1;
+      } else if constexpr(std::is_arithmetic_v<T> || is_big_integer_v<T>) {
+        return lhs < rhs ? -1 : rhs < lhs ? 1 : 0;
+      } else if constexpr(std::is_same_v<T, interned_string>) {
+        return lhs.compare(rhs);
+      } else {
+        return chars_of(lhs).compare(chars_of(rhs));
+      }
+    }
+
+    // An element of a packed list, or of an unpacked list being compared
+    // against one: its type's index (as in `data`), and its value if it's an
+    // integer or string.
+    struct packed_element {
+      std::size_t index;
+      long long integer;
+      std::string_view string;
+    };
+
+    template<typename List>
+    packed_element packed_element_at(const List &l, std::size_t i) {
+      using packing = typename List::packing;
+      using Value = typename List::value_type;
+      using Traits = variant_traits_for<Value>;
+
+      if(l.kind() == packing::integers)
+        return {0, l.integers()[i], {}};
+      if(l.kind() == packing::strings)
+        return {1, 0, l.string_at(i)};
+
+      auto &v = l[i];
+      if(auto *n = Traits::template get_if<typename Value::integer>(&v))
+        return {0, *n, {}};
+      if(auto *s = Traits::template get_if<typename Value::string>(&v))
+        return {1, 0, chars_of(*s)};
+      return {Traits::index(v), 0, {}};
+    }
+
+    // Compare two lists, at least one of which is packed. Packed lists only
+    // hold integers and strings, so this never has to look any deeper, and
+    // it reads the packed arrays directly rather than unpacking them.
+    template<bool Equality, typename List>
+    int compare_packed(const List &lhs, const List &rhs) {
+      using packing = typename List::packing;
+      if(lhs.kind() == packing::integers && rhs.kind() == packing::integers) {
+        auto &l = lhs.integers(), &r = rhs.integers();
+        if constexpr(Equality)
+          return l == r ? 0 : 1;
+        else
+          return l < r ? -1 : r < l ? 1 : 0;
+      }
+
+      auto n = (std::min)(lhs.size(), rhs.size());
+      for(std::size_t i = 0; i != n; i++) {
+        auto a = packed_element_at(lhs, i), b = packed_element_at(rhs, i);
+        if(a.index != b.index)
+          return a.index < b.index ? -1 : 1;
+        if(int r = a.index == 0 ? compare_value<Equality>(a.integer, b.integer)
+                                : compare_value<Equality>(a.string, b.string))
+          return r;
+      }
+      return lhs.size() < rhs.size() ? -1 : rhs.size() < lhs.size() ? 1 : 0;
+    }
+
+    // Compare two values as far as we can without looking at their children,
+    // returning <0, 0, or >0. If they're lists or dicts whose children need
+    // comparing, set `nested`.
+    template<bool Equality, typename Data>
+    int compare_shallow(const Data &a, const Data &b, bool &nested) {
+      using Traits = variant_traits_for<Data>;
+      using integer = typename Data::integer;
+      using string = typename Data::string;
+      using list = typename Data::list;
+      using dict = typename Data::dict;
+
+      nested = false;
+      auto ai = Traits::index(a), bi = Traits::index(b);
+      if(ai != bi)
+        return ai < bi ? -1 : 1;
+
+      if(auto *x = Traits::template get_if<integer>(&a))
+        return compare_value<Equality>(
+          *x, *Traits::template get_if<integer>(&b)
+        );
+      if(auto *x = Traits::template get_if<string>(&a))
+        return compare_value<Equality>(
+          *x, *Traits::template get_if<string>(&b)
+        );
+
+      if(auto *x = Traits::template get_if<list>(&a)) {
+        auto *y = Traits::template get_if<list>(&b);
+        if(Equality && x->size() != y->size())
+          return 1;
+        if constexpr(is_packed_list_v<list>) {
+          if(x->is_packed() || y->is_packed())
+            return compare_packed<Equality>(*x, *y);
+        }
+        nested = !x->empty() || !y->empty();
+        return 0;
+      }
+
+      auto *x = Traits::template get_if<dict>(&a);
+      auto *y = Traits::template get_if<dict>(&b);
+      if(Equality && x->size() != y->size())
+        return 1;
+      nested = !x->empty() || !y->empty();
+      return 0;
+    }
+
+    template<bool Equality, typename Data>
+    int compare_nested(const Data &lhs, const Data &rhs);
+
+    // Compare two values, returning <0, 0, or >0, in the same order as
+    // `std::variant` (integers, then strings, then lists, then dicts, with
+    // lists and dicts compared lexicographically), and stopping at the first
+    // difference. If `Equality` is set, we only care whether the values are
+    // equal, so lists and dicts of different sizes can be skipped entirely.
+    // Past `max_recursion`, we switch to `compare_nested`.
+    template<bool Equality, typename Data>
+    int compare_data(const Data &lhs, const Data &rhs, std::size_t depth) {
+      using Traits = variant_traits_for<Data>;
+      using list = typename Data::list;
+      using dict = typename Data::dict;
+      static_assert(Equality || !is_hash_dict_v<dict>,
+                    "hash_dict can only be compared for equality");
+
+      bool nested;
+      if(int r = compare_shallow<Equality>(lhs, rhs, nested); r || !nested)
+        return r;
+      if(depth == max_recursion)
+        return compare_nested<Equality>(lhs, rhs);
+
+      auto compare_range = [depth](auto i, auto iend, auto j, auto jend) {
+        for(; i != iend && j != jend; ++i, ++j) {
+          if constexpr(!std::is_same_v<decltype(*i), const Data &>) {
+            if(int r = compare_value<Equality>(i->first, j->first))
+              return r;
+            if(int r = compare_data<Equality>(i->second, j->second, depth + 1))
+              return r;
+          } else {
+            if(int r = compare_data<Equality>(*i, *j, depth + 1))
+              return r;
+          }
+        }
+        return i != iend ? 1 : j != jend ? -1 : 0;
+      };
+
+      if(auto *x = Traits::template get_if<list>(&lhs)) {
+        auto *y = Traits::template get_if<list>(&rhs);
+        return compare_range(x->begin(), x->end(), y->begin(), y->end());
+      }
+
+      auto *x = Traits::template get_if<dict>(&lhs);
+      auto *y = Traits::template get_if<dict>(&rhs);
+      if constexpr(is_hash_dict_v<dict>) {
+        // hash_dicts are unordered, so look up each key instead.
+        for(auto &i : *x) {
+          auto j = y->find(i.first);
+          if(j == y->end())
+            return 1;
+          if(int r = compare_data<Equality>(i.second, j->second, depth + 1))
+            return r;
+        }
+        return 0;
+      } else {
+        return compare_range(x->begin(), x->end(), y->begin(), y->end());
+      }
+    }
+
+    // Compare two lists or dicts like `compare_data`, but without recursing:
+    // each pair of lists or dicts gets a frame on our stack.
+    template<bool Equality, typename Data>
+    int compare_nested(const Data &lhs, const Data &rhs) {
+      using Traits = variant_traits_for<Data>;
+      using list = typename Data::list;
+      using dict = typename Data::dict;
+
+      struct frame {
+        const Data *rhs;
+        decltype(std::declval<const list &>().begin()) li, lend, ri, rend;
+        decltype(std::declval<const dict &>().begin()) di, dend, dj, djend;
+        bool is_list;
+      };
+
+      small_stack<frame> stack;
+      auto push = [&stack](const Data &a, const Data &b) {
+        auto &f = stack.push();
+        f.rhs = &b;
+        if(auto *x = Traits::template get_if<list>(&a)) {
+          auto *y = Traits::template get_if<list>(&b);
+          f.is_list = true;
+          f.li = x->begin(); f.lend = x->end();
+          f.ri = y->begin(); f.rend = y->end();
+        } else {
+          auto *dx = Traits::template get_if<dict>(&a);
+          auto *dy = Traits::template get_if<dict>(&b);
+          f.is_list = false;
+          f.di = dx->begin(); f.dend = dx->end();
+          f.dj = dy->begin(); f.djend = dy->end();
+        }
+      };
+
+      push(lhs, rhs);
+      while(!stack.empty()) {
+        auto &f = stack.back();
+        const Data *a, *b;
+        if(f.is_list) {
+          if(f.li == f.lend || f.ri == f.rend) {
+            if(f.li != f.lend || f.ri != f.rend)
+              return f.li != f.lend ? 1 : -1;
+            stack.pop();
+            continue;
+          }
+          a = &*f.li++;
+          b = &*f.ri++;
+        } else if constexpr(is_hash_dict_v<dict>) {
+          if(f.di == f.dend) {
+            stack.pop();
+            continue;
+          }
+          auto *y = Traits::template get_if<dict>(f.rhs);
+          auto j = y->find(f.di->first);
+          if(j == y->end())
+            return 1;
+          a = &f.di->second;
+          b = &j->second;
+          ++f.di;
+        } else {
+          if(f.di == f.dend || f.dj == f.djend) {
+            if(f.di != f.dend || f.dj != f.djend)
+              return f.di != f.dend ? 1 : -1;
+            stack.pop();
+            continue;
+          }
+          if(int r = compare_value<Equality>(f.di->first, f.dj->first))
+            return r;
+          a = &f.di->second;
+          b = &f.dj->second;
+          ++f.di;
+          ++f.dj;
+        }
+
+        bool nested;
+        if(int r = compare_shallow<Equality>(*a, *b, nested))
+          return r;
+        if(nested)
+          push(*a, *b);
+      }
+      return 0;
+    }
+
+    // Format an integer at the end of `buf`, returning the digits.
+    template<typename Integer, std::size_t N>
+    inline std::string_view format_integer(char (&buf)[N], Integer value) {
+      static_assert(N >= std::numeric_limits<Integer>::digits10 + 2);
+      char *p = buf + N;
+      auto n = static_cast<std::make_unsigned_t<Integer>>(value);
+      if(value < 0)
+        n = 0 - n;
+      do {
+        *--p = static_cast<char>('0' + n % 10);
+        n /= 10;
+      } while(n);
+      if(value < 0)
+        *--p = '-';
+      return std::string_view(p, buf + N - p);
+    }
+
+    // Hash a value with FNV-1a over its canonical encoding, so that it's
+    // equal to the `canonical_hash` of the encoded value. As with
+    // `compare_data`, lists and dicts get a frame on our stack.
+    template<typename Data>
+    std::size_t hash_data(const Data &value) {
+      using Traits = variant_traits_for<Data>;
+      using integer = typename Data::integer;
+      using string = typename Data::string;
+      using list = typename Data::list;
+      using dict = typename Data::dict;
+      using dict_item = typename dict::value_type;
+
+      struct frame {
+        decltype(std::declval<const list &>().begin()) li, lend;
+        decltype(std::declval<const dict &>().begin()) di, dend;
+        // The items of a hash_dict, sorted by key.
+        std::conditional_t<is_hash_dict_v<dict>,
+                           std::vector<const dict_item *>,
+                           std::nullptr_t> order;
+        std::size_t pos;
+        bool is_list;
+      };
+
+      std::uint64_t h = fnv1a_basis;
+      auto add_integer = [&h](auto i) {
+        char buf[std::numeric_limits<long long>::digits10 + 2];
+        h = fnv1a_update(h, "i");
+        h = fnv1a_update(h, format_integer(buf, i));
+        h = fnv1a_update(h, "e");
+      };
+      auto add_string = [&h](std::string_view s) {
+        char buf[std::numeric_limits<std::size_t>::digits10 + 2];
+        h = fnv1a_update(h, format_integer(buf, s.size()));
+        h = fnv1a_update(h, ":");
+        h = fnv1a_update(h, s);
+      };
+
+      small_stack<frame> stack;
+      auto start = [&](const Data &v) {
+        if(auto *i = Traits::template get_if<integer>(&v)) {
+          if constexpr(is_big_integer_v<integer>) {
+            if(i->is_small()) {
+              add_integer(i->small());
+            } else {
+              h = fnv1a_update(h, i->negative() ? "i-" : "i");
+              h = fnv1a_update(h, chars_of(i->digits()));
+              h = fnv1a_update(h, "e");
+            }
+          } else {
+            add_integer(*i);
+          }
+        } else if(auto *s = Traits::template get_if<string>(&v)) {
+          add_string(chars_of(*s));
+        } else if(auto *l = Traits::template get_if<list>(&v)) {
+          h = fnv1a_update(h, "l");
+          if constexpr(is_packed_list_v<list>) {
+            using packing = typename list::packing;
+            if(l->kind() == packing::integers) {
+              for(auto i : l->integers())
+                add_integer(i);
+              h = fnv1a_update(h, "e");
+              return;
+            } else if(l->kind() == packing::strings) {
+              for(std::size_t i = 0; i != l->size(); i++)
+                add_string(l->string_at(i));
+              h = fnv1a_update(h, "e");
+              return;
+            }
+          }
+          auto &f = stack.push();
+          f.is_list = true;
+          f.li = l->begin();
+          f.lend = l->end();
+        } else {
+          auto *d = Traits::template get_if<dict>(&v);
+          h = fnv1a_update(h, "d");
+          auto &f = stack.push();
+          f.is_list = false;
+          if constexpr(is_hash_dict_v<dict>) {
+            f.order.reserve(d->size());
+            d->for_each_sorted([&f](auto &&i) { f.order.push_back(&i); });
+            f.pos = 0;
+          } else {
+            f.di = d->begin();
+            f.dend = d->end();
+          }
+        }
+      };
+
+      start(value);
+      while(!stack.empty()) {
+        auto &f = stack.back();
+        const Data *child = nullptr;
+        if(f.is_list) {
+          if(f.li != f.lend)
+            child = &*f.li++;
+        } else if constexpr(is_hash_dict_v<dict>) {
+          if(f.pos != f.order.size()) {
+            add_string(chars_of(f.order[f.pos]->first));
+            child = &f.order[f.pos++]->second;
+          }
+        } else if(f.di != f.dend) {
+          add_string(chars_of(f.di->first));
+          child = &f.di->second;
+          ++f.di;
+        }
+
+        if(child) {
+          start(*child);
+        } else {
+          h = fnv1a_update(h, "e");
+          stack.pop();
+        }
+      }
+      return static_cast<std::size_t>(h);
+    }
+
+    template<typename T>
+    inline constexpr bool is_basic_data_v = false;
+
+    template<template<typename ...> typename Variant, typename I, typename S,
+             template<typename ...> typename L,
+             template<typename ...> typename D>
+    inline constexpr bool is_basic_data_v<basic_data<Variant, I, S, L, D>> =
+      true;
+
+    template<typename T>
+    inline constexpr bool is_string_view_v =
+      std::is_same_v<T, std::string_view> || std::is_same_v<T, bytes_view>;
+
+    // Pass `value` along as an rvalue if we're converting from an rvalue and
+    // it's not const (like the keys of a `std::map`).
+    template<bool Move, typename T>
+    inline decltype(auto) forward_if(T &value) {
+      if constexpr(Move && !std::is_const_v<T>)
+        return std::move(value);
+      else
+        return std::as_const(value);
+    }
+
+    template<typename To, typename From>
+    To convert_integer(const From &value) {
+      if constexpr(std::is_same_v<To, From>) {
+        return value;
+      } else if constexpr(is_big_integer_v<From>) {
+        if constexpr(is_big_integer_v<To>) {
+          if(value.is_small())
+            return To(value.small());
+          using string = typename To::string_type;
+          return To(value.negative(), string(chars_of(value.digits())));
+        } else {
+          if(auto n = value.template as<To>())
+            return *n;
+          throw_exception<std::out_of_range>("integer out of range");
+        }
+      } else {
+        return To(value);
+      }
+    }
+
+    template<typename To, typename From>
+    To convert_string(From &&value) {
+      static_assert(!std::is_same_v<To, interned_string>,
+                    "interned keys can only be created by a key_table");
+      if constexpr(std::is_same_v<To, std::decay_t<From>>)
+        return std::forward<From>(value);
+      else
+        return To(chars_of(value));
+    }
+
+    // Convert a value with no lists or dicts inside it to convert (i.e. a
+    // scalar, a packed list, or an empty list or dict).
+    template<typename To, bool Move, typename Source>
+    To convert_flat(Source &value) {
+      using Traits = variant_traits_for<std::remove_const_t<Source>>;
+      using integer = typename std::remove_const_t<Source>::integer;
+      using string = typename std::remove_const_t<Source>::string;
+      using list = typename std::remove_const_t<Source>::list;
+      using to_list = typename To::list;
+
+      if(auto *i = Traits::template get_if<integer>(&value))
+        return To(convert_integer<typename To::integer>(*i));
+      if(auto *s = Traits::template get_if<string>(&value))
+        return To(convert_string<typename To::string>(forward_if<Move>(*s)));
+
+      if(auto *l = Traits::template get_if<list>(&value)) {
+        to_list result;
+        if constexpr(is_packed_list_v<list>) {
+          if(l->is_packed()) {
+            if constexpr(has_reserve_v<to_list>)
+              result.reserve(l->size());
+            if(l->kind() == list::packing::integers) {
+              for(auto n : l->integers()) {
+                if constexpr(is_packed_list_v<to_list>)
+                  result.push_integer(n);
+                else
+                  result.emplace_back(
+                    convert_integer<typename To::integer>(n)
+                  );
+              }
+            } else {
+              for(std::size_t i = 0; i != l->size(); i++) {
+                if constexpr(is_packed_list_v<to_list>)
+                  result.push_string(l->string_at(i));
+                else
+                  result.emplace_back(
+                    convert_string<typename To::string>(l->string_at(i))
+                  );
+              }
+            }
+          }
+        }
+        return To(std::move(result));
+      }
+      return To(typename To::dict());
+    }
+
+    template<typename To, bool Move, typename Source>
+    To convert_nested(Source &value);
+
+    // Convert a value to another data type, reserving each list and dict at
+    // its final size. If `Move` is set, strings are moved instead of copied
+    // where the types allow. Past `max_recursion`, we switch to
+    // `convert_nested`.
+    template<typename To, bool Move, typename Source>
+    To convert_data(Source &value, std::size_t depth = 0) {
+      using Traits = variant_traits_for<std::remove_const_t<Source>>;
+      using list = typename std::remove_const_t<Source>::list;
+      using dict = typename std::remove_const_t<Source>::dict;
+      using to_list = typename To::list;
+      using to_dict = typename To::dict;
+      using to_key = typename to_dict::key_type;
+
+      if(!has_nested(value))
+        return convert_flat<To, Move>(value);
+      if(depth == max_recursion)
+        return convert_nested<To, Move>(value);
+
+      if(auto *l = Traits::template get_if<list>(&value)) {
+        to_list result;
+        if constexpr(has_reserve_v<to_list>)
+          result.reserve(l->size());
+        for(auto &i : *l)
+          result.emplace_back(convert_data<To, Move>(i, depth + 1));
+        return To(std::move(result));
+      }
+
+      auto *d = Traits::template get_if<dict>(&value);
+      to_dict result;
+      if constexpr(has_reserve_v<to_dict>)
+        result.reserve(d->size());
+      for(auto &i : *d) {
+        auto key = convert_string<to_key>(forward_if<Move>(i.first));
+        result.try_emplace(result.end(), std::move(key),
+                           convert_data<To, Move>(i.second, depth + 1));
+      }
+      return To(std::move(result));
+    }
+
+    // Convert a list or dict like `convert_data`, but without recursing: as
+    // with `copy_data`, each list or dict gets a frame on our stack, and once
+    // all of a frame's children are converted, its result is moved into its
+    // parent's.
+    template<typename To, bool Move, typename Source>
+    To convert_nested(Source &value) {
+      using Data = std::remove_const_t<Source>;
+      using Traits = variant_traits_for<Data>;
+      using ToTraits = variant_traits_for<To>;
+      using list = std::conditional_t<Move, typename Data::list,
+                                      const typename Data::list>;
+      using dict = std::conditional_t<Move, typename Data::dict,
+                                      const typename Data::dict>;
+      using to_list = typename To::list;
+      using to_dict = typename To::dict;
+      using to_key = typename to_dict::key_type;
+
+      struct frame {
+        Source *value;
+        to_key key;
+        To result;
+        decltype(std::declval<list &>().begin()) list_pos;
+        decltype(std::declval<dict &>().begin()) dict_pos;
+      };
+
+      small_stack<frame> stack;
+      auto push = [&stack](Source &v, to_key key) {
+        auto &f = stack.push();
+        f.value = &v;
+        f.key = std::move(key);
+        if(auto *l = Traits::template get_if<typename Data::list>(&v)) {
+          to_list result;
+          if constexpr(has_reserve_v<to_list>)
+            result.reserve(l->size());
+          f.result = std::move(result);
+          f.list_pos = l->begin();
+        } else {
+          auto *d = Traits::template get_if<typename Data::dict>(&v);
+          to_dict result;
+          if constexpr(has_reserve_v<to_dict>)
+            result.reserve(d->size());
+          f.result = std::move(result);
+          f.dict_pos = d->begin();
+        }
+      };
+      auto add = [](frame &f, to_key &&key, To &&child) {
+        if(auto *l = ToTraits::template get_if<to_list>(&f.result)) {
+          l->emplace_back(std::move(child));
+        } else {
+          auto *d = ToTraits::template get_if<to_dict>(&f.result);
+          d->try_emplace(d->end(), std::move(key), std::move(child));
+        }
+      };
+
+      push(value, to_key());
+      while(true) {
+        auto &top = stack.back();
+        to_key key{};
+        Source *child = nullptr;
+        if(auto *l = Traits::template get_if<typename Data::list>(top.value)) {
+          if(top.list_pos != l->end())
+            child = &*top.list_pos++;
+        } else {
+          auto *d = Traits::template get_if<typename Data::dict>(top.value);
+          if(top.dict_pos != d->end()) {
+            key = convert_string<to_key>(forward_if<Move>(top.dict_pos->first));
+            child = &top.dict_pos->second;
+            ++top.dict_pos;
+          }
+        }
+
+        if(child && has_nested(*child)) {
+          push(*child, std::move(key));
+        } else if(child) {
+          add(top, std::move(key), convert_flat<To, Move>(*child));
+        } else {
+          To done = std::move(top.result);
+          key = std::move(top.key);
+          stack.pop();
+          if(stack.empty())
+            return done;
+          add(stack.back(), std::move(key), std::move(done));
+        }
+      }
+    }
+  }
+
+  // Convert a value from one data type to another, e.g. to keep an owned copy
+  // of a `data_view` or to pass `data` to code using `boost_data`. This reads
+  // each string once and builds each list and dict at its final size, so it's
+  // much faster than encoding the value and decoding it again. If `value` is
+  // an rvalue, its strings are moved into the result where possible.
+  template<typename To, typename From>
+  std::enable_if_t<
+    detail::is_basic_data_v<To> &&
+    detail::is_basic_data_v<std::remove_cv_t<std::remove_reference_t<From>>>,
+    To
+  > convert(From &&value) {
+    using Source = std::remove_cv_t<std::remove_reference_t<From>>;
+    constexpr bool move = !std::is_lvalue_reference_v<From> &&
+                          !std::is_const_v<std::remove_reference_t<From>>;
+    static_assert(!move || (
+      (!detail::is_string_view_v<typename To::string> ||
+       detail::is_string_view_v<typename Source::string>) &&
+      (!detail::is_string_view_v<typename To::dict::key_type> ||
+       detail::is_string_view_v<typename Source::dict::key_type>)
+    ), "converting an rvalue to views would leave them dangling");
+
+    if constexpr(std::is_same_v<To, Source>)
+      return std::forward<From>(value);
+    else if constexpr(move)
+      return detail::convert_data<To, true>(value);
+    else
+      return detail::convert_data<To, false>(std::as_const(value));
+  }
+
+  // A reusable decoder. This holds onto the scratch state used while decoding
+  // (the stack of open lists/dicts, the current dict key, and any dict nodes
+  // awaiting reuse), so decoding many messages with one parser avoids
+  // reallocating that state each time. In addition, `decode_into` reuses the
+  // storage already held by its target: existing list elements, dict nodes,
+  // and string capacity are overwritten in place where possible. Any new
+  // strings, lists, and dicts are created with the parser's allocator.
+  template<typename Data>
+  class basic_parser {
+  public:
+    using data_type = Data;
+    using integer = typename Data::integer;
+    using string  = typename Data::string;
+    using list    = typename Data::list;
+    using dict    = typename Data::dict;
+    using key_type = typename dict::key_type;
+    using allocator_type = detail::allocator_of_t<list>;
+
+    basic_parser(allocation_mode allocation = incremental,
+                 const allocator_type &alloc = allocator_type())
+      : allocation_(allocation), alloc_(alloc),
+        dict_key_(make<string>()) {}
+
+    explicit basic_parser(const allocator_type &alloc,
+                          allocation_mode allocation = incremental)
+      : basic_parser(allocation, alloc) {}
+
+    // Create a parser for data whose dict keys are `interned_string`s, which
+    // will be interned in `keys`.
+    explicit basic_parser(key_table &keys,
+                          allocation_mode allocation = incremental,
+                          const allocator_type &alloc = allocator_type())
+      : basic_parser(allocation, alloc) {
+      keys_ = &keys;
+    }
+
+    allocation_mode allocation() const noexcept { return allocation_; }
+    void allocation(allocation_mode allocation) noexcept {
+      allocation_ = allocation;
+    }
+
+    allocator_type get_allocator() const { return alloc_; }
+
+    // Decode a value into `target`. On failure, `begin` points to where
+    // decoding stopped and the contents of `target` are unspecified.
+    template<typename Iter>
+    decode_errc
+    parse(Iter &begin, Iter end, Data &target, decode_mode mode = lenient) {
+      if constexpr(detail::is_byte_pointer_v<Iter>) {
+        // Decode raw bytes as characters so that we can compare them against
+        // our tokens directly.
+        auto orig = reinterpret_cast<const char *>(begin);
+        auto b = orig;
+        auto ec = parse(b, reinterpret_cast<const char *>(end), target, mode);
+        begin += b - orig;
+        return ec;
+      } else {
+        presize(begin, end);
+        return mode == strict ? parse_impl<true>(begin, end, target) :
+                                parse_impl<false>(begin, end, target);
+      }
+    }
+
+    // If the last call to `parse` failed with `duplicated_key`, the
+    // offending key.
+    const string & key() const noexcept { return dict_key_; }
+
+    template<typename Iter>
+    void decode_into(Data &target, Iter &begin, Iter end,
+                     decode_mode mode = lenient) {
+      if(auto ec = parse(begin, end, target, mode); ec != decode_errc::ok)
+        detail::throw_decode_error(ec, dict_key_);
+    }
+
+    template<typename Iter>
+    inline void decode_into(Data &target, const Iter &begin, Iter end,
+                            decode_mode mode = lenient) {
+      Iter b(begin);
+      decode_into(target, b, end, mode);
+    }
+
+    inline void decode_into(Data &target, const string_view &s,
+                            decode_mode mode = lenient) {
+      decode_into(target, s.begin(), s.end(), mode);
+    }
+
+    inline void decode_into(Data &target, const segmented_buffer &s,
+                            decode_mode mode = lenient) {
+      decode_into(target, s.begin(), s.end(), mode);
+    }
+
+    template<typename Iter>
+    decode_result<void> try_decode_into(Data &target, Iter &begin, Iter end,
+                                        decode_mode mode = lenient) {
+      static_assert(std::is_base_of_v<
+        std::forward_iterator_tag,
+        typename std::iterator_traits<Iter>::iterator_category
+      >, "non-throwing decoding requires forward iterators");
+
+      Iter orig = begin;
+      auto ec = parse(begin, end, target, mode);
+      return decode_result<void>(ec, detail::iter_distance(orig, begin));
+    }
+
+    template<typename Iter>
+    inline decode_result<void>
+    try_decode_into(Data &target, const Iter &begin, Iter end,
+                    decode_mode mode = lenient) {
+      Iter b(begin);
+      return try_decode_into(target, b, end, mode);
+    }
+
+    inline decode_result<void>
+    try_decode_into(Data &target, const string_view &s,
+                    decode_mode mode = lenient) {
+      return try_decode_into(target, s.begin(), s.end(), mode);
+    }
+
+    inline decode_result<void>
+    try_decode_into(Data &target, const segmented_buffer &s,
+                    decode_mode mode = lenient) {
+      return try_decode_into(target, s.begin(), s.end(), mode);
+    }
+  private:
+    using Traits = variant_traits_for<Data>;
+    static constexpr bool recycle_nodes = detail::has_node_type_v<dict>;
+    using node_type = typename detail::node_type_of<dict>::type;
+
+    // Each list or dict we're currently inside of. For lists, we track the
+    // index of the next element to write; for dicts, where this dict's
+    // reusable nodes start in `nodes_`.
+    struct frame {
+      Data *node;
+      std::size_t index;
+    };
+
+    static constexpr bool interned_keys = std::is_same_v<key_type,
+                                                         interned_string>;
+
+    // Whether to pack homogeneous lists of integers or strings. Strings are
+    // only packed when they'd be copied anyway (i.e. not for views).
+    static constexpr bool pack_integers = detail::is_packed_list_v<list> &&
+      std::is_same_v<integer, long long>;
+    static constexpr bool pack_strings = detail::is_packed_list_v<list> &&
+      detail::is_basic_string_v<string>;
+
+    // Store `dict_key_` into an existing key, reusing its storage if
+    // possible.
+    void assign_key(key_type &key) {
+      if constexpr(interned_keys) {
+        assert(keys_ && "parser has no key table");
+        key = keys_->intern(dict_key_);
+      } else {
+        key = dict_key_;
+      }
+    }
+
+    // Take `dict_key_` for use as a new key.
+    decltype(auto) take_key() {
+      if constexpr(interned_keys) {
+        assert(keys_ && "parser has no key table");
+        return keys_->intern(dict_key_);
+      } else {
+        return std::move(dict_key_);
+      }
+    }
+
+    // If requested, count the elements of every list and dict ahead of time.
+    // If counting fails, just decode normally and let that report the error.
+    template<typename Iter>
+    void presize(Iter begin, Iter end) {
+      lengths_.clear();
+      next_length_ = 0;
+      if constexpr(std::is_base_of_v<
+        std::forward_iterator_tag,
+        typename std::iterator_traits<Iter>::iterator_category
+      >) {
+        decode_size size;
+        if(allocation_ == presized &&
+           detail::count_values(begin, end, size, lengths_, open_) !=
+           decode_errc::ok)
+          lengths_.clear();
+      }
+    }
+
+    // Reserve space for the next list or dict, if we know its length.
+    template<typename T>
+    void reserve(T &container) {
+      if(next_length_ < lengths_.size()) {
+        if constexpr(detail::has_reserve_v<T>)
+          container.reserve(lengths_[next_length_]);
+        ++next_length_;
+      }
+    }
+
+    // Get the value of type `T` held by `node`, replacing its contents with
+    // an empty `T` if it holds something else.
+    template<typename T>
+    T make() const {
+      return detail::make_with_allocator<T>(alloc_);
+    }
+
+    template<typename T>
+    T & ensure(Data &node) {
+      if(auto p = Traits::template get_if<T>(&node))
+        return *p;
+      node = make<T>();
+      return *Traits::template get_if<T>(&node);
+    }
+
+    // Open a list or dict inside of `node`. Any existing elements are kept
+    // around to be overwritten by the new ones.
+    void open_list(Data &node) {
+      auto &l = ensure<list>(node);
+      if constexpr(detail::is_packed_list_v<list>) {
+        // Packed elements can't be overwritten in place, so start over.
+        if(l.is_packed())
+          l.clear();
+      }
+      reserve(l);
+      state_.push_back({&node, 0});
+    }
+
+    void open_dict(Data &node) {
+      auto &d = ensure<dict>(node);
+      reserve(d);
+      state_.push_back({&node, nodes_.size()});
+      if constexpr(recycle_nodes) {
+        // Extract nodes from the back so that popping from `nodes_` gives
+        // them to us in their original order.
+        while(!d.empty())
+          nodes_.push_back(d.extract(std::prev(d.end())));
+      } else {
+        d.clear();
+      }
+    }
+
+    // Close the innermost list or dict, discarding any leftover elements.
+    void close() {
+      auto &top = state_.back();
+      if(auto l = Traits::template get_if<list>(top.node)) {
+        if(top.index < l->size())
+          l->erase(l->begin() + top.index, l->end());
+      } else if constexpr(recycle_nodes) {
+        nodes_.erase(nodes_.begin() + top.index, nodes_.end());
+      }
+      state_.pop_back();
+    }
+
+    // Get the node the next list element should be written to.
+    Data * list_slot(frame &top, list &l) {
+      Data *slot;
+      if(top.index < l.size()) {
+        slot = &l[top.index];
+      } else {
+        l.emplace_back();
+        slot = &l.back();
+      }
+      ++top.index;
+      return slot;
+    }
+
+    // If the next element of `l` is an integer or string that can be packed,
+    // append it to the list's packed storage and return true; `ec` holds the
+    // result of decoding it. A list is only packed if its first element is.
+    template<bool Strict, typename Iter>
+    bool pack_element(frame &top, list &l, Iter &begin, Iter end,
+                      decode_errc &ec) {
+      if constexpr(pack_integers) {
+        if(*begin == 'i' && start_packing(top, l, list::packing::integers)) {
+          integer value;
+          ec = detail::decode_int<integer, Strict>(begin, end, value);
+          if(ec == decode_errc::ok) {
+            l.push_integer(value);
+            ++top.index;
+          }
+          return true;
+        }
+      }
+      if constexpr(pack_strings) {
+        if(std::isdigit(*begin) &&
+           start_packing(top, l, list::packing::strings)) {
+          ec = detail::decode_str<Strict>(begin, end, dict_key_);
+          if(ec == decode_errc::ok) {
+            l.push_string(dict_key_);
+            ++top.index;
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+
+    template<typename Packing>
+    bool start_packing(const frame &top, list &l, Packing p) {
+      if(l.can_pack(p))
+        return true;
+      if(top.index != 0)
+        return false;
+      // Discard the old unpacked elements so we can pack this list.
+      l.clear();
+      return true;
+    }
+
+    // Insert `dict_key_` and get the node its value should be written to.
+    // If the key was already in the dict, return null.
+    template<bool Strict>
+    Data * dict_slot(frame &top, dict &d) {
+      if constexpr(recycle_nodes) {
+        if(nodes_.size() > top.index) {
+          auto nh = std::move(nodes_.back());
+          nodes_.pop_back();
+          assign_key(nh.key());
+          if constexpr(Strict) {
+            return &d.insert(d.end(), std::move(nh))->second;
+          } else {
+            auto i = d.insert(std::move(nh));
+            return i.inserted ? &i.position->second : nullptr;
+          }
+        }
+      }
+
+      if constexpr(Strict) {
+        // We've already checked that this key sorts after the previous one,
+        // so it always belongs at the end.
+        return &d.try_emplace(d.end(), take_key())->second;
+      } else {
+        auto i = d.try_emplace(take_key());
+        return i.second ? &i.first->second : nullptr;
+      }
+    }
+
+    template<bool Strict, typename Iter>
+    decode_errc parse_impl(Iter &begin, Iter end, Data &target) {
+      state_.clear();
+      if constexpr(recycle_nodes)
+        nodes_.clear();
+
+      // The node that the next value we parse will be written to.
+      Data *slot = &target;
+
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+
+        if(*begin == 'e') {
+          if(state_.empty())
+            return decode_errc::unexpected_e;
+          ++begin;
+          close();
+          continue;
+        }
+
+        if(!state_.empty()) {
+          auto &top = state_.back();
+          if(auto l = Traits::template get_if<list>(top.node)) {
+            if constexpr(pack_integers || pack_strings) {
+              decode_errc ec;
+              if(pack_element<Strict>(top, *l, begin, end, ec)) {
+                if(ec != decode_errc::ok)
+                  return ec;
+                continue;
+              }
+            }
+            slot = list_slot(top, *l);
+          } else {
+            if(!std::isdigit(*begin))
+              return decode_errc::expected_string;
+            if(auto ec = detail::decode_str<Strict>(begin, end, dict_key_);
+               ec != decode_errc::ok)
+              return ec;
+            auto d = Traits::template get_if<dict>(top.node);
+            if constexpr(Strict) {
+              // Each key must sort after the previous one, so the previous
+              // key is always the last one in the dict.
+              if(!d->empty()) {
+                auto &last = std::prev(d->end())->first;
+                if(!(last < dict_key_)) {
+                  return last == dict_key_ ? decode_errc::duplicated_key :
+                                             decode_errc::unsorted_keys;
+                }
+              }
+            }
+            if(begin == end)
+              return decode_errc::unexpected_eos;
+
+            if(!(slot = dict_slot<Strict>(top, *d)))
+              return decode_errc::duplicated_key;
+          }
+        }
+
+        if(*begin == 'i') {
+          if constexpr(detail::is_big_integer_v<integer>) {
+            // Big integers may hold a string, so decode in place to reuse
+            // it.
+            if(auto ec = detail::decode_int<integer, Strict>(
+                 begin, end, ensure<integer>(*slot)
+               ); ec != decode_errc::ok)
+              return ec;
+          } else {
+            integer value;
+            if(auto ec = detail::decode_int<integer, Strict>(begin, end,
+                                                             value);
+               ec != decode_errc::ok)
+              return ec;
+            *slot = value;
+          }
+        } else if(*begin == 'l') {
+          ++begin;
+          open_list(*slot);
+        } else if(*begin == 'd') {
+          ++begin;
+          open_dict(*slot);
+        } else if(std::isdigit(*begin)) {
+          if(auto ec = detail::decode_str<Strict>(begin, end,
+                                                  ensure<string>(*slot));
+             ec != decode_errc::ok)
+            return ec;
+        } else {
+          return decode_errc::unexpected_type;
+        }
+      } while(!state_.empty());
+
+      return decode_errc::ok;
+    }
+
+    allocation_mode allocation_;
+    allocator_type alloc_;
+    key_table *keys_ = nullptr;
+    std::vector<frame> state_;
+    string dict_key_;
+    std::vector<node_type> nodes_;
+    std::vector<std::size_t> lengths_, open_;
+    std::size_t next_length_ = 0;
+  };
+
+  using parser = basic_parser<data>;
+  using parser_view = basic_parser<data_view>;
+  using interned_parser = basic_parser<interned_data>;
+  using compact_parser = basic_parser<compact_data>;
+
+#ifdef BENCODE_HAS_PMR
+  using pmr_parser = basic_parser<pmr_data>;
+  using pmr_parser_view = basic_parser<pmr_data_view>;
+#endif
+
+  template<typename Data, typename Iter>
+  inline void decode_into(Data &target, Iter &begin, Iter end,
+                          decode_mode mode = lenient) {
+    basic_parser<Data>{}.decode_into(target, begin, end, mode);
+  }
+
+  template<typename Data, typename Iter>
+  inline void decode_into(Data &target, const Iter &begin, Iter end,
+                          decode_mode mode = lenient) {
+    basic_parser<Data>{}.decode_into(target, begin, end, mode);
+  }
+
+  template<typename Data>
+  inline void decode_into(Data &target, const string_view &s,
+                          decode_mode mode = lenient) {
+    basic_parser<Data>{}.decode_into(target, s, mode);
+  }
+
+  template<typename Data>
+  inline void decode_into(Data &target, const segmented_buffer &s,
+                          decode_mode mode = lenient) {
+    basic_parser<Data>{}.decode_into(target, s, mode);
+  }
+
+  template<typename Data, typename Iter>
+  inline decode_result<void>
+  try_decode_into(Data &target, Iter &begin, Iter end,
+                  decode_mode mode = lenient) {
+    return basic_parser<Data>{}.try_decode_into(target, begin, end, mode);
+  }
+
+  template<typename Data, typename Iter>
+  inline decode_result<void>
+  try_decode_into(Data &target, const Iter &begin, Iter end,
+                  decode_mode mode = lenient) {
+    return basic_parser<Data>{}.try_decode_into(target, begin, end, mode);
+  }
+
+  template<typename Data>
+  inline decode_result<void>
+  try_decode_into(Data &target, const string_view &s,
+                  decode_mode mode = lenient) {
+    return basic_parser<Data>{}.try_decode_into(target, s, mode);
+  }
+
+  template<typename Data>
+  inline decode_result<void>
+  try_decode_into(Data &target, const segmented_buffer &s,
+                  decode_mode mode = lenient) {
+    return basic_parser<Data>{}.try_decode_into(target, s, mode);
+  }
+
+  template<typename Data, typename Iter>
+  Data basic_decode(Iter &begin, Iter end, decode_mode mode) {
+    Data result;
+    basic_parser<Data>{}.decode_into(result, begin, end, mode);
+    return result;
+  }
+
+  template<typename Data, typename Iter>
+  inline Data
+  basic_decode(const Iter &begin, Iter end, decode_mode mode = lenient) {
+    Iter b(begin);
+    return basic_decode<Data>(b, end, mode);
+  }
+
+  template<typename Data>
+  inline Data basic_decode(const string_view &s, decode_mode mode = lenient) {
+    return basic_decode<Data>(s.begin(), s.end(), mode);
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode(const segmented_buffer &s, decode_mode mode = lenient) {
+    return basic_decode<Data>(s.begin(), s.end(), mode);
+  }
+
+  template<typename Data, typename Iter>
+  Data basic_decode(Iter &begin, Iter end,
+                    const typename basic_parser<Data>::allocator_type &alloc,
+                    decode_mode mode = lenient) {
+    Data result;
+    basic_parser<Data>(alloc).decode_into(result, begin, end, mode);
+    return result;
+  }
+
+  template<typename Data, typename Iter>
+  inline Data
+  basic_decode(const Iter &begin, Iter end,
+               const typename basic_parser<Data>::allocator_type &alloc,
+               decode_mode mode = lenient) {
+    Iter b(begin);
+    return basic_decode<Data>(b, end, alloc, mode);
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode(const string_view &s,
+               const typename basic_parser<Data>::allocator_type &alloc,
+               decode_mode mode = lenient) {
+    return basic_decode<Data>(s.begin(), s.end(), alloc, mode);
+  }
+
+  template<typename Data, typename Iter>
+  Data basic_decode(Iter &begin, Iter end, key_table &keys,
+                    decode_mode mode = lenient) {
+    Data result;
+    basic_parser<Data>(keys).decode_into(result, begin, end, mode);
+    return result;
+  }
+
+  template<typename Data, typename Iter>
+  inline Data basic_decode(const Iter &begin, Iter end, key_table &keys,
+                           decode_mode mode = lenient) {
+    Iter b(begin);
+    return basic_decode<Data>(b, end, keys, mode);
+  }
+
+  template<typename Data>
+  inline Data basic_decode(const string_view &s, key_table &keys,
+                           decode_mode mode = lenient) {
+    return basic_decode<Data>(s.begin(), s.end(), keys, mode);
+  }
+
+  template<typename Data>
+  Data basic_decode(std::istream &s, eof_behavior e = check_eof,
+                    decode_mode mode = lenient) {
+    static_assert(!std::is_same_v<typename Data::string, std::string_view> &&
+                  !std::is_same_v<typename Data::string, bytes_view>,
+                  "reading from stream not supported for data views");
+
+    std::istreambuf_iterator<char> begin(s), end;
+    auto result = basic_decode<Data>(begin, end, mode);
+    // If we hit EOF, update the parent stream.
+    if(e == check_eof && begin == end)
+      s.setstate(std::ios_base::eofbit);
+    return result;
+  }
+
+  template<typename T>
+  inline data decode(T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<data>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline data decode(const T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<data>(begin, end, mode);
+  }
+
+  inline data decode(const string_view &s, decode_mode mode = lenient) {
+    return basic_decode<data>(s.begin(), s.end(), mode);
+  }
+
+  inline data decode(const segmented_buffer &s, decode_mode mode = lenient) {
+    return basic_decode<data>(s.begin(), s.end(), mode);
+  }
+
+  inline data decode(std::istream &s, eof_behavior e = check_eof,
+                     decode_mode mode = lenient) {
+    return basic_decode<data>(s, e, mode);
+  }
+
+  template<typename T>
+  inline data_view decode_view(T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<data_view>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline data_view
+  decode_view(const T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<data_view>(begin, end, mode);
+  }
+
+  inline data_view
+  decode_view(const string_view &s, decode_mode mode = lenient) {
+    return basic_decode<data_view>(s.begin(), s.end(), mode);
+  }
+
+  inline data_view
+  decode_view(const segmented_buffer &s, decode_mode mode = lenient) {
+    return basic_decode<data_view>(s.begin(), s.end(), mode);
+  }
+
+  template<typename T>
+  inline interned_data interned_decode(T &begin, T end, key_table &keys,
+                                       decode_mode mode = lenient) {
+    return basic_decode<interned_data>(begin, end, keys, mode);
+  }
+
+  template<typename T>
+  inline interned_data interned_decode(const T &begin, T end, key_table &keys,
+                                       decode_mode mode = lenient) {
+    return basic_decode<interned_data>(begin, end, keys, mode);
+  }
+
+  inline interned_data interned_decode(const string_view &s, key_table &keys,
+                                       decode_mode mode = lenient) {
+    return basic_decode<interned_data>(s.begin(), s.end(), keys, mode);
+  }
+
+  template<typename T>
+  inline compact_data
+  compact_decode(T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<compact_data>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline compact_data
+  compact_decode(const T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<compact_data>(begin, end, mode);
+  }
+
+  inline compact_data
+  compact_decode(const string_view &s, decode_mode mode = lenient) {
+    return basic_decode<compact_data>(s.begin(), s.end(), mode);
+  }
+
+#ifdef BENCODE_HAS_PMR
+  template<typename T>
+  inline pmr_data pmr_decode(T &begin, T end, std::pmr::memory_resource *r,
+                             decode_mode mode = lenient) {
+    return basic_decode<pmr_data>(begin, end, r, mode);
+  }
+
+  template<typename T>
+  inline pmr_data
+  pmr_decode(const T &begin, T end, std::pmr::memory_resource *r,
+             decode_mode mode = lenient) {
+    return basic_decode<pmr_data>(begin, end, r, mode);
+  }
+
+  inline pmr_data pmr_decode(const string_view &s, std::pmr::memory_resource *r,
+                             decode_mode mode = lenient) {
+    return basic_decode<pmr_data>(s.begin(), s.end(), r, mode);
+  }
+
+  template<typename T>
+  inline pmr_data_view
+  pmr_decode_view(T &begin, T end, std::pmr::memory_resource *r,
+                  decode_mode mode = lenient) {
+    return basic_decode<pmr_data_view>(begin, end, r, mode);
+  }
+
+  template<typename T>
+  inline pmr_data_view
+  pmr_decode_view(const T &begin, T end, std::pmr::memory_resource *r,
+                  decode_mode mode = lenient) {
+    return basic_decode<pmr_data_view>(begin, end, r, mode);
+  }
+
+  inline pmr_data_view
+  pmr_decode_view(const string_view &s, std::pmr::memory_resource *r,
+                  decode_mode mode = lenient) {
+    return basic_decode<pmr_data_view>(s.begin(), s.end(), r, mode);
+  }
+#endif
+
+#ifdef BENCODE_HAS_BOOST
+  template<typename T>
+  inline boost_data boost_decode(T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<boost_data>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline boost_data
+  boost_decode(const T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<boost_data>(begin, end, mode);
+  }
+
+  inline boost_data
+  boost_decode(const string_view &s, decode_mode mode = lenient) {
+    return basic_decode<boost_data>(s.begin(), s.end(), mode);
+  }
+
+  inline boost_data boost_decode(std::istream &s, eof_behavior e = check_eof,
+                                 decode_mode mode = lenient) {
+    return basic_decode<boost_data>(s, e, mode);
+  }
+
+  template<typename T>
+  inline boost_data_view
+  boost_decode_view(T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<boost_data_view>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline boost_data_view
+  boost_decode_view(const T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<boost_data_view>(begin, end, mode);
+  }
+
+  inline boost_data_view
+  boost_decode_view(const string_view &s, decode_mode mode = lenient) {
+    return basic_decode<boost_data_view>(s.begin(), s.end(), mode);
+  }
+#endif
+
+  template<typename Data, typename Iter>
+  decode_result<Data>
+  try_basic_decode(Iter &begin, Iter end, decode_mode mode = lenient) {
+    static_assert(std::is_base_of_v<
+      std::forward_iterator_tag,
+      typename std::iterator_traits<Iter>::iterator_category
+    >, "non-throwing decoding requires forward iterators");
+
+    Iter orig = begin;
+    Data result;
+    auto ec = basic_parser<Data>{}.parse(begin, end, result, mode);
+    std::size_t offset = detail::iter_distance(orig, begin);
+    if(ec != decode_errc::ok)
+      return decode_result<Data>(ec, offset);
+    return decode_result<Data>(std::move(result), offset);
+  }
+
+  template<typename Data, typename Iter>
+  inline decode_result<Data>
+  try_basic_decode(const Iter &begin, Iter end, decode_mode mode = lenient) {
+    Iter b(begin);
+    return try_basic_decode<Data>(b, end, mode);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  try_basic_decode(const string_view &s, decode_mode mode = lenient) {
+    return try_basic_decode<Data>(s.begin(), s.end(), mode);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  try_basic_decode(const segmented_buffer &s, decode_mode mode = lenient) {
+    return try_basic_decode<Data>(s.begin(), s.end(), mode);
+  }
+
+  template<typename T>
+  inline decode_result<data>
+  try_decode(T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<data>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline decode_result<data>
+  try_decode(const T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<data>(begin, end, mode);
+  }
+
+  inline decode_result<data>
+  try_decode(const string_view &s, decode_mode mode = lenient) {
+    return try_basic_decode<data>(s.begin(), s.end(), mode);
+  }
+
+  inline decode_result<data>
+  try_decode(const segmented_buffer &s, decode_mode mode = lenient) {
+    return try_basic_decode<data>(s.begin(), s.end(), mode);
+  }
+
+  template<typename T>
+  inline decode_result<data_view>
+  try_decode_view(T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<data_view>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline decode_result<data_view>
+  try_decode_view(const T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<data_view>(begin, end, mode);
+  }
+
+  inline decode_result<data_view>
+  try_decode_view(const string_view &s, decode_mode mode = lenient) {
+    return try_basic_decode<data_view>(s.begin(), s.end(), mode);
+  }
+
+  inline decode_result<data_view>
+  try_decode_view(const segmented_buffer &s, decode_mode mode = lenient) {
+    return try_basic_decode<data_view>(s.begin(), s.end(), mode);
+  }
+
+#ifdef BENCODE_HAS_BOOST
+  template<typename T>
+  inline decode_result<boost_data>
+  try_boost_decode(T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<boost_data>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline decode_result<boost_data>
+  try_boost_decode(const T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<boost_data>(begin, end, mode);
+  }
+
+  inline decode_result<boost_data>
+  try_boost_decode(const string_view &s, decode_mode mode = lenient) {
+    return try_basic_decode<boost_data>(s.begin(), s.end(), mode);
+  }
+
+  template<typename T>
+  inline decode_result<boost_data_view>
+  try_boost_decode_view(T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<boost_data_view>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline decode_result<boost_data_view>
+  try_boost_decode_view(const T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<boost_data_view>(begin, end, mode);
+  }
+
+  inline decode_result<boost_data_view>
+  try_boost_decode_view(const string_view &s, decode_mode mode = lenient) {
+    return try_basic_decode<boost_data_view>(s.begin(), s.end(), mode);
+  }
+#endif
+
+  template<typename T>
+  inline byte_data_view
+  decode_byte_view(T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<byte_data_view>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline byte_data_view
+  decode_byte_view(const T &begin, T end, decode_mode mode = lenient) {
+    return basic_decode<byte_data_view>(begin, end, mode);
+  }
+
+  inline byte_data_view
+  decode_byte_view(const string_view &s, decode_mode mode = lenient) {
+    return basic_decode<byte_data_view>(s.begin(), s.end(), mode);
+  }
+
+  inline byte_data_view
+  decode_byte_view(const segmented_buffer &s, decode_mode mode = lenient) {
+    return basic_decode<byte_data_view>(s.begin(), s.end(), mode);
+  }
+
+  template<typename T>
+  inline decode_result<byte_data_view>
+  try_decode_byte_view(T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<byte_data_view>(begin, end, mode);
+  }
+
+  template<typename T>
+  inline decode_result<byte_data_view>
+  try_decode_byte_view(const T &begin, T end, decode_mode mode = lenient) {
+    return try_basic_decode<byte_data_view>(begin, end, mode);
+  }
+
+  inline decode_result<byte_data_view>
+  try_decode_byte_view(const string_view &s, decode_mode mode = lenient) {
+    return try_basic_decode<byte_data_view>(s.begin(), s.end(), mode);
+  }
+
+#ifdef BENCODE_HAS_SPAN
+  namespace detail {
+    template<typename Byte>
+    inline std::string_view as_chars(std::span<const Byte> s) {
+      return std::string_view(reinterpret_cast<const char *>(s.data()),
+                              s.size());
+    }
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode(std::span<const std::byte> s, decode_mode mode = lenient) {
+    return basic_decode<Data>(detail::as_chars(s), mode);
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode(std::span<const std::uint8_t> s, decode_mode mode = lenient) {
+    return basic_decode<Data>(detail::as_chars(s), mode);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  try_basic_decode(std::span<const std::byte> s, decode_mode mode = lenient) {
+    return try_basic_decode<Data>(detail::as_chars(s), mode);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  try_basic_decode(std::span<const std::uint8_t> s,
+                   decode_mode mode = lenient) {
+    return try_basic_decode<Data>(detail::as_chars(s), mode);
+  }
+
+  inline data decode(std::span<const std::byte> s, decode_mode mode = lenient) {
+    return basic_decode<data>(detail::as_chars(s), mode);
+  }
+
+  inline data
+  decode(std::span<const std::uint8_t> s, decode_mode mode = lenient) {
+    return basic_decode<data>(detail::as_chars(s), mode);
+  }
+
+  inline data_view
+  decode_view(std::span<const std::byte> s, decode_mode mode = lenient) {
+    return basic_decode<data_view>(detail::as_chars(s), mode);
+  }
+
+  inline data_view
+  decode_view(std::span<const std::uint8_t> s, decode_mode mode = lenient) {
+    return basic_decode<data_view>(detail::as_chars(s), mode);
+  }
+
+  inline byte_data_view
+  decode_byte_view(std::span<const std::byte> s, decode_mode mode = lenient) {
+    return basic_decode<byte_data_view>(detail::as_chars(s), mode);
+  }
+
+  inline byte_data_view
+  decode_byte_view(std::span<const std::uint8_t> s,
+                   decode_mode mode = lenient) {
+    return basic_decode<byte_data_view>(detail::as_chars(s), mode);
+  }
+
+  inline decode_result<data>
+  try_decode(std::span<const std::byte> s, decode_mode mode = lenient) {
+    return try_basic_decode<data>(detail::as_chars(s), mode);
+  }
+
+  inline decode_result<data>
+  try_decode(std::span<const std::uint8_t> s, decode_mode mode = lenient) {
+    return try_basic_decode<data>(detail::as_chars(s), mode);
+  }
+
+  inline decode_result<data_view>
+  try_decode_view(std::span<const std::byte> s, decode_mode mode = lenient) {
+    return try_basic_decode<data_view>(detail::as_chars(s), mode);
+  }
+
+  inline decode_result<data_view>
+  try_decode_view(std::span<const std::uint8_t> s,
+                  decode_mode mode = lenient) {
+    return try_basic_decode<data_view>(detail::as_chars(s), mode);
+  }
+
+  inline decode_result<byte_data_view>
+  try_decode_byte_view(std::span<const std::byte> s,
+                       decode_mode mode = lenient) {
+    return try_basic_decode<byte_data_view>(detail::as_chars(s), mode);
+  }
+
+  inline decode_result<byte_data_view>
+  try_decode_byte_view(std::span<const std::uint8_t> s,
+                       decode_mode mode = lenient) {
+    return try_basic_decode<byte_data_view>(detail::as_chars(s), mode);
+  }
+#endif
+
+  // A decoded value which owns the buffer it was decoded from. The input is
+  // moved in (or copied once), and every string in the decoded data is a view
+  // into that buffer, so building a `document` costs about as much as
+  // `decode_view`, but the result is as safe to store as `data`. The buffer
+  // lives on the heap, so moving a document leaves its views intact.
+  class document {
+  public:
+    document() = default;
+
+    explicit document(std::string buffer, decode_mode mode = lenient) {
+      decode(std::move(buffer), mode);
+    }
+
+    // Copies get their own buffer, so they re-decode it to point into it.
+    document(const document &rhs) {
+      if(rhs.buffer_)
+        decode(*rhs.buffer_);
+    }
+    document(document &&) = default;
+
+    document & operator =(const document &rhs) {
+      if(this != &rhs)
+        *this = document(rhs);
+      return *this;
+    }
+    document & operator =(document &&) = default;
+
+    bool empty() const noexcept { return !buffer_; }
+
+    void clear() {
+      root_ = data_view();
+      buffer_.reset();
+    }
+
+    const data_view & root() const {
+      assert(!empty());
+      return root_;
+    }
+
+    const data_view & operator *() const { return root(); }
+    const data_view * operator ->() const { return &root(); }
+
+    // The owned input, including anything after the decoded value.
+    std::string_view buffer() const noexcept {
+      return buffer_ ? std::string_view(*buffer_) : std::string_view();
+    }
+
+    // Decode a value, replacing the current contents of this document. On
+    // failure, this document is left unchanged.
+    void decode(std::string buffer, decode_mode mode = lenient) {
+      basic_parser<data_view> parser;
+      auto buf = std::make_unique<std::string>(std::move(buffer));
+      data_view root;
+      if(auto result = parse(parser, *buf, root, mode); !result)
+        detail::throw_decode_error(result.error(), parser.key());
+      reset(std::move(buf), std::move(root));
+    }
+
+    decode_result<void>
+    try_decode(std::string buffer, decode_mode mode = lenient) {
+      basic_parser<data_view> parser;
+      auto buf = std::make_unique<std::string>(std::move(buffer));
+      data_view root;
+      auto result = parse(parser, *buf, root, mode);
+      if(result)
+        reset(std::move(buf), std::move(root));
+      return result;
+    }
+  private:
+    static decode_result<void>
+    parse(basic_parser<data_view> &parser, const std::string &buf,
+          data_view &root, decode_mode mode) {
+      const char *begin = buf.data();
+      auto ec = parser.parse(begin, buf.data() + buf.size(), root, mode);
+      return decode_result<void>(ec, begin - buf.data());
+    }
+
+    void reset(std::unique_ptr<std::string> buf, data_view root) {
+      // Replace the views before the buffer they point into.
+      root_ = std::move(root);
+      buffer_ = std::move(buf);
+    }
+
+    std::unique_ptr<std::string> buffer_;
+    data_view root_;
+  };
+
+  // A handle to a value in an immutable `document` that's shared between
+  // handles with an atomic reference count. Copying a handle never copies the
+  // buffer or the decoded data, so handles can be passed to other threads
+  // freely. `slice` makes a handle to a sub-value, which keeps the whole
+  // document alive.
+  class shared_document {
+  public:
+    shared_document() = default;
+
+    explicit shared_document(std::string buffer, decode_mode mode = lenient)
+      : shared_document(document(std::move(buffer), mode)) {}
+
+    explicit shared_document(document doc) {
+      if(!doc.empty()) {
+        doc_ = std::make_shared<const document>(std::move(doc));
+        value_ = &doc_->root();
+      }
+    }
+
+    bool empty() const noexcept { return !doc_; }
+    long use_count() const noexcept { return doc_.use_count(); }
+
+    const data_view & root() const {
+      assert(!empty());
+      return *value_;
+    }
+
+    const data_view & operator *() const { return root(); }
+    const data_view * operator ->() const { return &root(); }
+
+    // The whole buffer of the underlying document.
+    std::string_view buffer() const noexcept {
+      return doc_ ? doc_->buffer() : std::string_view();
+    }
+
+    // Make a handle to `value`, which must be part of this document.
+    shared_document slice(const data_view &value) const {
+      assert(!empty());
+      return shared_document(doc_, &value);
+    }
+  private:
+    shared_document(std::shared_ptr<const document> doc,
+                    const data_view *value)
+      : doc_(std::move(doc)), value_(value) {}
+
+    std::shared_ptr<const document> doc_;
+    const data_view *value_ = nullptr;
+  };
+
+  namespace detail {
+    enum class pooled_tag : unsigned char { integer, string, list, dict };
+
+    // A bump allocator for trivially-destructible objects that live as long
+    // as the arena itself. Allocations too big to share a chunk get one of
+    // their own.
+    class arena {
+    public:
+      static constexpr std::size_t chunk_size = 16384;
+
+      arena() = default;
+      arena(const arena &) = delete;
+      arena & operator =(const arena &) = delete;
+
+      void * allocate(std::size_t size, std::size_t align) {
+        auto offset = static_cast<std::size_t>(
+          -reinterpret_cast<std::uintptr_t>(pos_) & (align - 1)
+        );
+        if(!pos_ || size + offset > static_cast<std::size_t>(end_ - pos_)) {
+          if(size > chunk_size / 4)
+            return new_chunk(size);
+          pos_ = new_chunk(chunk_size);
+          end_ = pos_ + chunk_size;
+          offset = 0;
+        }
+        auto p = pos_ + offset;
+        pos_ = p + size;
+        return p;
+      }
+
+      template<typename T>
+      T * allocate(std::size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+      }
+
+      // The total size of every chunk allocated so far.
+      std::size_t capacity() const noexcept { return capacity_; }
+    private:
+      char * new_chunk(std::size_t size) {
+        auto n = (size + sizeof(std::max_align_t) - 1) /
+                 sizeof(std::max_align_t);
+        auto &chunk = chunks_.emplace_back(new std::max_align_t[n]);
+        capacity_ += n * sizeof(std::max_align_t);
+        return reinterpret_cast<char *>(chunk.get());
+      }
+
+      std::vector<std::unique_ptr<std::max_align_t[]>> chunks_;
+      char *pos_ = nullptr, *end_ = nullptr;
+      std::size_t capacity_ = 0;
+    };
+  }
+
+  class pooled_list;
+  class pooled_dict;
+  class value_pool;
+
+  // A handle to an immutable value stored in a `value_pool`: either an
+  // integer or a pointer to the pool's only copy of a string, list, or dict.
+  // Handles are 16 bytes and trivially copyable, and must not outlive their
+  // pool. Like `data`, this can be used with `encode`.
+  class pooled_data {
+  public:
+    using integer = long long;
+    using string = std::string_view;
+    using list = pooled_list;
+    using dict = pooled_dict;
+
+    pooled_data() noexcept : integer_(0), tag_(detail::pooled_tag::integer) {}
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    pooled_data(T value) noexcept
+      : integer_(value), tag_(detail::pooled_tag::integer) {}
+
+    // The index of the type held, in the same order as `data`: integer,
+    // string, list, and dict.
+    std::size_t index() const noexcept {
+      return static_cast<std::size_t>(tag_);
+    }
+
+    template<typename T>
+    const T * get_if() const noexcept {
+      if constexpr(std::is_same_v<T, integer>) {
+        return tag_ == detail::pooled_tag::integer ? &integer_ : nullptr;
+      } else if constexpr(std::is_same_v<T, string>) {
+        return tag_ == detail::pooled_tag::string ? string_ : nullptr;
+      } else if constexpr(std::is_same_v<T, list>) {
+        return tag_ == detail::pooled_tag::list ? list_ : nullptr;
+      } else {
+        static_assert(std::is_same_v<T, dict>, "invalid type for data");
+        return tag_ == detail::pooled_tag::dict ? dict_ : nullptr;
+      }
+    }
+
+    template<typename T>
+    const T & get() const {
+      if(auto p = get_if<T>())
+        return *p;
+      detail::throw_exception<std::bad_variant_access>();
+    }
+
+    template<typename Visitor>
+    decltype(auto) visit(Visitor &&visitor) const {
+      switch(tag_) {
+      case detail::pooled_tag::integer:
+        return std::forward<Visitor>(visitor)(integer_);
+      case detail::pooled_tag::string:
+        return std::forward<Visitor>(visitor)(*string_);
+      case detail::pooled_tag::list:
+        return std::forward<Visitor>(visitor)(*list_);
+      default:
+        return std::forward<Visitor>(visitor)(*dict_);
+      }
+    }
+
+    // Whether this is the same handle as `rhs`. Since a pool only stores one
+    // copy of each value, this is equivalent to `==` for handles from the
+    // same pool.
+    bool is(const pooled_data &rhs) const noexcept {
+      return tag_ == rhs.tag_ && bits() == rhs.bits();
+    }
+  private:
+    friend class value_pool;
+
+    explicit pooled_data(const string *s) noexcept
+      : string_(s), tag_(detail::pooled_tag::string) {}
+    explicit pooled_data(const list *l) noexcept
+      : list_(l), tag_(detail::pooled_tag::list) {}
+    explicit pooled_data(const dict *d) noexcept
+      : dict_(d), tag_(detail::pooled_tag::dict) {}
+
+    std::uint64_t bits() const noexcept {
+      switch(tag_) {
+      case detail::pooled_tag::integer:
+        return static_cast<std::uint64_t>(integer_);
+      case detail::pooled_tag::string:
+        return reinterpret_cast<std::uintptr_t>(string_);
+      case detail::pooled_tag::list:
+        return reinterpret_cast<std::uintptr_t>(list_);
+      default:
+        return reinterpret_cast<std::uintptr_t>(dict_);
+      }
+    }
+
+    union {
+      integer integer_;
+      const string *string_;
+      const list *list_;
+      const dict *dict_;
+    };
+    detail::pooled_tag tag_;
+  };
+
+  // An immutable list of values in a `value_pool`.
+  class pooled_list {
+  public:
+    using value_type = pooled_data;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = const pooled_data &;
+    using const_reference = const pooled_data &;
+    using iterator = const pooled_data *;
+    using const_iterator = const pooled_data *;
+
+    pooled_list() = default;
+
+    const_reference at(size_type i) const {
+      if(i >= size_)
+        detail::throw_exception<std::out_of_range>("pooled_list::at");
+      return data_[i];
+    }
+    const_reference operator [](size_type i) const noexcept {
+      assert(i < size_);
+      return data_[i];
+    }
+    const_reference front() const noexcept { return (*this)[0]; }
+    const_reference back() const noexcept { return (*this)[size_ - 1]; }
+    const pooled_data * data() const noexcept { return data_; }
+
+    const_iterator begin() const noexcept { return data_; }
+    const_iterator cbegin() const noexcept { return data_; }
+    const_iterator end() const noexcept { return data_ + size_; }
+    const_iterator cend() const noexcept { return data_ + size_; }
+
+    bool empty() const noexcept { return size_ == 0; }
+    size_type size() const noexcept { return size_; }
+  private:
+    friend class value_pool;
+
+    pooled_list(const pooled_data *data, size_type size,
+                std::size_t hash) noexcept
+      : data_(data), size_(size), hash_(hash) {}
+
+    const pooled_data *data_ = nullptr;
+    size_type size_ = 0;
+    std::size_t hash_ = 0;
+  };
+
+  // An immutable dict in a `value_pool`, stored as an array of key/value
+  // pairs sorted by key.
+  class pooled_dict {
+  public:
+    using key_type = std::string_view;
+    using mapped_type = pooled_data;
+    using value_type = std::pair<std::string_view, pooled_data>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using const_reference = const value_type &;
+    using iterator = const value_type *;
+    using const_iterator = const value_type *;
+
+    pooled_dict() = default;
+
+    const mapped_type & at(std::string_view key) const {
+      auto i = find(key);
+      if(i == end())
+        detail::throw_exception<std::out_of_range>("pooled_dict::at");
+      return i->second;
+    }
+
+    const_iterator begin() const noexcept { return data_; }
+    const_iterator cbegin() const noexcept { return data_; }
+    const_iterator end() const noexcept { return data_ + size_; }
+    const_iterator cend() const noexcept { return data_ + size_; }
+
+    bool empty() const noexcept { return size_ == 0; }
+    size_type size() const noexcept { return size_; }
+
+    const_iterator find(std::string_view key) const {
+      auto i = std::lower_bound(
+        begin(), end(), key,
+        [](const value_type &lhs, std::string_view rhs) {
+          return lhs.first < rhs;
+        }
+      );
+      return i != end() && i->first == key ? i : end();
+    }
+
+    size_type count(std::string_view key) const {
+      return find(key) != end();
+    }
+  private:
+    friend class value_pool;
+
+    pooled_dict(const value_type *data, size_type size,
+                std::size_t hash) noexcept
+      : data_(data), size_(size), hash_(hash) {}
+
+    const value_type *data_ = nullptr;
+    size_type size_ = 0;
+    std::size_t hash_ = 0;
+  };
+
+  inline bool operator ==(const pooled_data &lhs, const pooled_data &rhs);
+
+  inline bool operator ==(const pooled_list &lhs, const pooled_list &rhs) {
+    return lhs.size() == rhs.size() &&
+           (lhs.data() == rhs.data() ||
+            std::equal(lhs.begin(), lhs.end(), rhs.begin()));
+  }
+
+  inline bool operator !=(const pooled_list &lhs, const pooled_list &rhs) {
+    return !(lhs == rhs);
+  }
+
+  inline bool operator ==(const pooled_dict &lhs, const pooled_dict &rhs) {
+    return lhs.size() == rhs.size() &&
+           (lhs.begin() == rhs.begin() ||
+            std::equal(lhs.begin(), lhs.end(), rhs.begin()));
+  }
+
+  inline bool operator !=(const pooled_dict &lhs, const pooled_dict &rhs) {
+    return !(lhs == rhs);
+  }
+
+  inline bool operator ==(const pooled_data &lhs, const pooled_data &rhs) {
+    if(lhs.is(rhs))
+      return true;
+    if(lhs.index() != rhs.index() || lhs.index() == 0)
+      return false;
+    return lhs.visit([&rhs](const auto &value) {
+      using T = std::decay_t<decltype(value)>;
+      return value == *rhs.get_if<T>();
+    });
+  }
+
+  inline bool operator !=(const pooled_data &lhs, const pooled_data &rhs) {
+    return !(lhs == rhs);
+  }
+
+  template<>
+  struct variant_traits_for<pooled_data> {
+    template<typename Visitor>
+    inline static decltype(auto)
+    visit(Visitor &&visitor, const pooled_data &data) {
+      return data.visit(std::forward<Visitor>(visitor));
+    }
+
+    template<typename Type>
+    inline static auto get_if(const pooled_data *data) {
+      return data->template get_if<Type>();
+    }
+
+    inline static auto index(const pooled_data &data) {
+      return data.index();
+    }
+  };
+
+  // A pool of immutable values shared by every document decoded into it.
+  // Each distinct string, list, and dict is stored only once: as decoding
+  // finishes each value, it's looked up by its contents and replaced with the
+  // pool's existing copy, if any. Since a list or dict's children have
+  // already been deduplicated, this only needs to hash and compare the
+  // children's handles, not their contents. When decoding many similar
+  // documents (e.g. torrents sharing trackers and file names), this stores
+  // each common subtree once, no matter how many documents contain it.
+  //
+  // Values are allocated from an arena and are never freed until the pool
+  // is destroyed, so the pool must outlive any values decoded into it. Like
+  // `key_table`, pools aren't thread-safe.
+  class value_pool {
+  public:
+    value_pool() = default;
+    value_pool(const value_pool &) = delete;
+    value_pool & operator =(const value_pool &) = delete;
+
+    // Get a handle to the pool's copy of the string `s`, adding it if
+    // necessary.
+    pooled_data intern(std::string_view s) {
+      if(auto i = strings_.find(&s); i != strings_.end())
+        return pooled_data(*i);
+
+      auto chars = arena_.allocate<char>(s.size());
+      std::copy(s.begin(), s.end(), chars);
+      auto node = new (arena_.allocate<std::string_view>(1))
+        std::string_view(chars, s.size());
+      strings_.insert(node);
+      return pooled_data(node);
+    }
+
+    // The number of distinct strings, lists, and dicts in the pool.
+    std::size_t size() const noexcept {
+      return strings_.size() + lists_.size() + dicts_.size();
+    }
+    bool empty() const noexcept { return size() == 0; }
+
+    // The number of bytes allocated for the pool's values (not including
+    // the indices used to look them up).
+    std::size_t memory_usage() const noexcept { return arena_.capacity(); }
+
+    // Decode a value into this pool. The input must be contiguous. On
+    // failure, `begin` points to where decoding stopped; any values already
+    // added to the pool are kept.
+    template<typename Iter>
+    decode_errc parse(Iter &begin, Iter end, pooled_data &value,
+                      decode_mode mode = lenient) {
+      static_assert(std::is_base_of_v<
+        std::forward_iterator_tag,
+        typename std::iterator_traits<Iter>::iterator_category
+      > && !detail::is_segmented_iterator_v<Iter>,
+      "pooled decoding requires contiguous input");
+
+      if constexpr(detail::is_byte_pointer_v<Iter>) {
+        auto orig = reinterpret_cast<const char *>(begin);
+        auto b = orig;
+        auto ec = parse(b, reinterpret_cast<const char *>(end), value, mode);
+        begin += b - orig;
+        return ec;
+      } else {
+        return mode == strict ? parse_impl<true>(begin, end, value) :
+                                parse_impl<false>(begin, end, value);
+      }
+    }
+
+    // If the last call to `parse` failed with `duplicated_key`, the
+    // offending key.
+    std::string_view last_key() const noexcept { return key_; }
+
+    template<typename Iter>
+    pooled_data decode(Iter &begin, Iter end, decode_mode mode = lenient) {
+      pooled_data value;
+      if(auto ec = parse(begin, end, value, mode); ec != decode_errc::ok)
+        detail::throw_decode_error(ec, key_);
+      return value;
+    }
+
+    template<typename Iter>
+    inline pooled_data
+    decode(const Iter &begin, Iter end, decode_mode mode = lenient) {
+      Iter b(begin);
+      return decode(b, end, mode);
+    }
+
+    inline pooled_data
+    decode(const string_view &s, decode_mode mode = lenient) {
+      return decode(s.data(), s.data() + s.size(), mode);
+    }
+
+    template<typename Iter>
+    decode_result<pooled_data>
+    try_decode(Iter &begin, Iter end, decode_mode mode = lenient) {
+      Iter orig = begin;
+      pooled_data value;
+      auto ec = parse(begin, end, value, mode);
+      auto offset = detail::iter_distance(orig, begin);
+      if(ec != decode_errc::ok)
+        return decode_result<pooled_data>(ec, offset);
+      return decode_result<pooled_data>(value, offset);
+    }
+
+    template<typename Iter>
+    inline decode_result<pooled_data>
+    try_decode(const Iter &begin, Iter end, decode_mode mode = lenient) {
+      Iter b(begin);
+      return try_decode(b, end, mode);
+    }
+
+    inline decode_result<pooled_data>
+    try_decode(const string_view &s, decode_mode mode = lenient) {
+      return try_decode(s.data(), s.data() + s.size(), mode);
+    }
+  private:
+    using dict_item = pooled_dict::value_type;
+
+    // Lists and dicts store their hash, so rehashing the index doesn't need
+    // to visit their children again.
+    struct node_hash {
+      std::size_t operator ()(const std::string_view *s) const noexcept {
+        return detail::fnv1a(*s);
+      }
+      template<typename T>
+      std::size_t operator ()(const T *node) const noexcept {
+        return node->hash_;
+      }
+    };
+
+    struct node_equal {
+      bool operator ()(const std::string_view *lhs,
+                       const std::string_view *rhs) const noexcept {
+        return *lhs == *rhs;
+      }
+      bool operator ()(const pooled_list *lhs,
+                       const pooled_list *rhs) const noexcept {
+        return lhs->size() == rhs->size() && std::equal(
+          lhs->begin(), lhs->end(), rhs->begin(),
+          [](const pooled_data &a, const pooled_data &b) { return a.is(b); }
+        );
+      }
+      bool operator ()(const pooled_dict *lhs,
+                       const pooled_dict *rhs) const noexcept {
+        // Keys are interned too, so we can compare them by address.
+        return lhs->size() == rhs->size() && std::equal(
+          lhs->begin(), lhs->end(), rhs->begin(),
+          [](const dict_item &a, const dict_item &b) {
+            return a.first.data() == b.first.data() && a.second.is(b.second);
+          }
+        );
+      }
+    };
+
+    template<typename T>
+    using index_type = std::unordered_set<const T *, node_hash, node_equal>;
+
+    struct frame {
+      std::size_t values, keys;
+      bool dict;
+      detail::key_order order;
+    };
+
+    static std::uint64_t mix(std::uint64_t hash,
+                             const pooled_data &value) noexcept {
+      hash = (hash ^ value.index()) * 1099511628211ull;
+      return (hash ^ value.bits()) * 1099511628211ull;
+    }
+
+    static std::size_t finish(std::uint64_t hash) noexcept {
+      return static_cast<std::size_t>(hash ^ (hash >> 32));
+    }
+
+    pooled_data make_list(const pooled_data *begin, std::size_t size) {
+      std::uint64_t hash = detail::fnv1a_basis;
+      for(std::size_t i = 0; i != size; i++)
+        hash = mix(hash, begin[i]);
+
+      pooled_list key(begin, size, finish(hash));
+      if(auto i = lists_.find(&key); i != lists_.end())
+        return pooled_data(*i);
+
+      auto items = arena_.allocate<pooled_data>(size);
+      std::copy(begin, begin + size, items);
+      auto node = new (arena_.allocate<pooled_list>(1))
+        pooled_list(items, size, key.hash_);
+      lists_.insert(node);
+      return pooled_data(node);
+    }
+
+    // Build a dict from the keys and values read since its frame was opened.
+    // The keys were already checked as they were read, so they're unique,
+    // and they only need sorting if `unsorted` is set (in lenient mode).
+    pooled_data make_dict(std::size_t values, std::size_t keys,
+                          bool unsorted) {
+      items_.clear();
+      for(std::size_t i = values, j = keys; i != values_.size(); i++, j++)
+        items_.emplace_back(keys_[j], values_[i]);
+      if(unsorted) {
+        std::sort(items_.begin(), items_.end(),
+                  [](const dict_item &lhs, const dict_item &rhs) {
+                    return lhs.first < rhs.first;
+                  });
+      }
+
+      std::uint64_t hash = detail::fnv1a_basis;
+      for(auto &i : items_) {
+        i.first = *intern(i.first).get_if<std::string_view>();
+        hash = (hash ^ reinterpret_cast<std::uintptr_t>(i.first.data())) *
+               1099511628211ull;
+        hash = mix(hash, i.second);
+      }
+
+      pooled_dict key(items_.data(), items_.size(), finish(hash));
+      if(auto i = dicts_.find(&key); i != dicts_.end())
+        return pooled_data(*i);
+
+      auto items = arena_.allocate<dict_item>(items_.size());
+      std::uninitialized_copy(items_.begin(), items_.end(), items);
+      auto node = new (arena_.allocate<pooled_dict>(1))
+        pooled_dict(items, items_.size(), key.hash_);
+      dicts_.insert(node);
+      return pooled_data(node);
+    }
+
+    template<bool Strict, typename Iter>
+    decode_errc parse_impl(Iter &begin, Iter end, pooled_data &result) {
+      frames_.clear();
+      values_.clear();
+      keys_.clear();
+      key_ = std::string_view();
+
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+
+        pooled_data value;
+        if(*begin == 'e') {
+          if(frames_.empty())
+            return decode_errc::unexpected_e;
+          ++begin;
+
+          auto f = frames_.back();
+          frames_.pop_back();
+          if(f.dict) {
+            value = make_dict(f.values, f.keys, f.order.unsorted);
+            keys_.resize(f.keys);
+          } else {
+            value = make_list(values_.data() + f.values,
+                              values_.size() - f.values);
+          }
+          values_.resize(f.values);
+        } else {
+          // Check each key as it's read, just like `basic_parser`, so that
+          // errors are reported at the same place. `keys_` holds the keys of
+          // every open dict, which is just what `check_unique` needs.
+          if(!frames_.empty() && frames_.back().dict) {
+            if(!std::isdigit(*begin))
+              return decode_errc::expected_string;
+            std::string_view key;
+            if(auto ec = detail::decode_str<Strict>(begin, end, key);
+               ec != decode_errc::ok)
+              return ec;
+            auto &order = frames_.back().order;
+            if constexpr(Strict) {
+              if(auto ec = order.check(key); ec != decode_errc::ok) {
+                key_ = key;
+                return ec;
+              }
+              keys_.push_back(key);
+            } else if(auto ec = order.check_unique(key, keys_);
+                      ec != decode_errc::ok) {
+              key_ = key;
+              return ec;
+            }
+            if(begin == end)
+              return decode_errc::unexpected_eos;
+          }
+
+          if(*begin == 'i') {
+            long long n;
+            if(auto ec = detail::decode_int<long long, Strict>(begin, end, n);
+               ec != decode_errc::ok)
+              return ec;
+            value = n;
+          } else if(*begin == 'l' || *begin == 'd') {
+            frames_.push_back({values_.size(), keys_.size(), *begin == 'd',
+                               {}});
+            ++begin;
+            continue;
+          } else if(std::isdigit(*begin)) {
+            std::string_view s;
+            if(auto ec = detail::decode_str<Strict>(begin, end, s);
+               ec != decode_errc::ok)
+              return ec;
+            value = intern(s);
+          } else {
+            return decode_errc::unexpected_type;
+          }
+        }
+
+        if(frames_.empty())
+          result = value;
+        else
+          values_.push_back(value);
+      } while(!frames_.empty());
+
+      return decode_errc::ok;
+    }
+
+    detail::arena arena_;
+    index_type<std::string_view> strings_;
+    index_type<pooled_list> lists_;
+    index_type<pooled_dict> dicts_;
+
+    // Scratch space for decoding, kept around to reuse its storage.
+    std::vector<frame> frames_;
+    std::vector<pooled_data> values_;
+    std::vector<std::string_view> keys_;
+    std::vector<dict_item> items_;
+    std::string_view key_;
+  };
+
+  // Compute the storage needed to decode a buffer, e.g. to allocate exactly
+  // enough nodes for a `flat_document`. Like `is_canonical`, this doesn't
+  // build any decoded data.
+  inline decode_result<decode_size> measure(const string_view &s) {
+    std::vector<std::size_t> lengths, open;
+    decode_size size;
+    const char *begin = s.data(), *end = s.data() + s.size();
+    auto ec = detail::count_values(begin, end, size, lengths, open);
+    if(ec != decode_errc::ok)
+      return decode_result<decode_size>(ec, begin - s.data());
+    return decode_result<decode_size>(size, begin - s.data());
+  }
+
+  // Hash a canonically-encoded buffer without decoding it. For a canonical
+  // buffer, this is equal to the `std::hash` of its decoded value; other
+  // buffers should be checked with `is_canonical` first.
+  inline std::size_t canonical_hash(const string_view &s) noexcept {
+    return detail::fnv1a(s);
+  }
+
+  // Check whether a buffer holds exactly one canonically-encoded value. This
+  // doesn't build any decoded data, so it's cheaper than a strict decode.
+  inline bool is_canonical(const string_view &s) {
+    const char *begin = s.data(), *end = s.data() + s.size();
+    return detail::scan_canonical(begin, end) == decode_errc::ok &&
+           begin == end;
+  }
+
+  // The type of a column decoded by `decode_columns`.
+  enum class column_type { integer, string };
+
+  // A column for `decode_columns` to extract: the dict key to read from each
+  // row, and the type of its values.
+  struct column_spec {
+    std::string_view key;
+    column_type type;
+  };
+
+  // A column of values decoded by `decode_columns`. Integers are stored in a
+  // single vector, and strings as one buffer of characters plus the offset
+  // where each string ends. Rows that are missing this column's key hold 0
+  // (or an empty string) and are marked invalid in the validity bitmap, which
+  // has one bit per row, starting from the least-significant bit of each
+  // word.
+  class column {
+  public:
+    column(std::string key, column_type type)
+      : key_(std::move(key)), type_(type) {}
+
+    const std::string & key() const noexcept { return key_; }
+    column_type type() const noexcept { return type_; }
+    std::size_t size() const noexcept { return size_; }
+
+    bool valid(std::size_t row) const noexcept {
+      assert(row < size_);
+      return (validity_[row / 64] >> (row % 64)) & 1;
+    }
+
+    std::size_t null_count() const noexcept { return size_ - valid_count_; }
+    const std::vector<std::uint64_t> & validity() const noexcept {
+      return validity_;
+    }
+
+    const std::vector<long long> & integers() const noexcept {
+      assert(type_ == column_type::integer);
+      return integers_;
+    }
+
+    std::string_view string_at(std::size_t row) const noexcept {
+      assert(type_ == column_type::string && row < size_);
+      std::size_t start = row ? ends_[row - 1] : 0;
+      return std::string_view(chars_.data() + start, ends_[row] - start);
+    }
+
+    const std::string & chars() const noexcept {
+      assert(type_ == column_type::string);
+      return chars_;
+    }
+
+    const std::vector<std::size_t> & string_ends() const noexcept {
+      assert(type_ == column_type::string);
+      return ends_;
+    }
+  private:
+    friend class column_table;
+
+    // Add a row, initially invalid.
+    void add_row() {
+      if(size_ % 64 == 0)
+        validity_.push_back(0);
+      if(type_ == column_type::integer)
+        integers_.push_back(0);
+      else
+        ends_.push_back(chars_.size());
+      ++size_;
+    }
+
+    void set_valid() noexcept {
+      validity_.back() |= std::uint64_t(1) << ((size_ - 1) % 64);
+      ++valid_count_;
+    }
+
+    void set_integer(long long value) noexcept {
+      integers_.back() = value;
+      set_valid();
+    }
+
+    void set_string(std::string_view value) {
+      chars_.append(value);
+      ends_.back() = chars_.size();
+      set_valid();
+    }
+
+    std::string key_;
+    column_type type_;
+    std::size_t size_ = 0, valid_count_ = 0;
+    std::vector<std::uint64_t> validity_;
+    std::vector<long long> integers_;
+    std::string chars_;
+    std::vector<std::size_t> ends_;
+  };
+
+  // A list of dicts decoded by `decode_columns`, stored as one `column` per
+  // key in the schema.
+  class column_table {
+  public:
+    using const_iterator = std::vector<column>::const_iterator;
+
+    std::size_t rows() const noexcept { return rows_; }
+    std::size_t size() const noexcept { return columns_.size(); }
+    bool empty() const noexcept { return columns_.empty(); }
+
+    const column & operator [](std::size_t i) const noexcept {
+      return columns_[i];
+    }
+
+    const column * find(std::string_view key) const noexcept {
+      for(auto &&i : columns_) {
+        if(i.key() == key)
+          return &i;
+      }
+      return nullptr;
+    }
+
+    const column & at(std::string_view key) const {
+      if(auto c = find(key))
+        return *c;
+      detail::throw_exception<std::out_of_range>("column_table::at");
+    }
+
+    const_iterator begin() const noexcept { return columns_.begin(); }
+    const_iterator end() const noexcept { return columns_.end(); }
+
+    // Decode the list of dicts found by following the dict keys in `path`
+    // from the root value, replacing this table's contents.
+    decode_errc parse(const char *&begin, const char *end,
+                      const std::vector<std::string_view> &path,
+                      const std::vector<column_spec> &schema,
+                      decode_mode mode = lenient) {
+      columns_.clear();
+      rows_ = 0;
+      key_ = {};
+      skip_.keys.clear();
+      columns_.reserve(schema.size());
+      for(auto &&i : schema)
+        columns_.emplace_back(std::string(i.key), i.type);
+
+      return mode == strict ? parse_impl<true>(begin, end, path) :
+                              parse_impl<false>(begin, end, path);
+    }
+
+    // If the last call to `parse` failed with `duplicated_key` or
+    // `missing_key`, the offending key. This points into the parsed buffer
+    // or the path.
+    std::string_view last_key() const noexcept { return key_; }
+  private:
+    template<bool Strict>
+    decode_errc parse_impl(const char *&begin, const char *end,
+                           const std::vector<std::string_view> &path) {
+      // Walk down to the rows, remembering the keys of each dict we pass
+      // through so we can check the rest of them afterward.
+      std::vector<detail::key_order> dicts(path.size());
+      for(std::size_t i = 0; i != path.size(); i++) {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+        if(*begin != 'd')
+          return decode_errc::unexpected_type;
+        ++begin;
+        while(true) {
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+          if(*begin == 'e') {
+            key_ = path[i];
+            return decode_errc::missing_key;
+          }
+          if(auto ec = read_key<Strict>(begin, end, dicts[i]);
+             ec != decode_errc::ok)
+            return ec;
+          if(key_ == path[i])
+            break;
+          if(auto ec = detail::skip_value<Strict>(begin, end, skip_);
+             ec != decode_errc::ok)
+            return ec;
+        }
+      }
+
+      if(auto ec = parse_rows<Strict>(begin, end); ec != decode_errc::ok)
+        return ec;
+
+      for(std::size_t i = path.size(); i-- != 0;) {
+        while(true) {
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+          if(*begin == 'e') {
+            ++begin;
+            dicts[i].template close<Strict>(skip_.keys);
+            break;
+          }
+          if(auto ec = read_key<Strict>(begin, end, dicts[i]);
+             ec != decode_errc::ok)
+            return ec;
+          if(auto ec = detail::skip_value<Strict>(begin, end, skip_);
+             ec != decode_errc::ok)
+            return ec;
+        }
+      }
+
+      return decode_errc::ok;
+    }
+
+    template<bool Strict>
+    decode_errc parse_rows(const char *&begin, const char *end) {
+      if(begin == end)
+        return decode_errc::unexpected_eos;
+      if(*begin != 'l')
+        return decode_errc::unexpected_type;
+      ++begin;
+
+      while(true) {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+        if(*begin == 'e') {
+          ++begin;
+          return decode_errc::ok;
+        }
+        if(*begin != 'd')
+          return decode_errc::unexpected_type;
+        ++begin;
+
+        for(auto &c : columns_)
+          c.add_row();
+        ++rows_;
+
+        detail::key_order keys;
+        std::size_t next = 0;
+        while(true) {
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+          if(*begin == 'e') {
+            ++begin;
+            keys.close<Strict>(skip_.keys);
+            break;
+          }
+          if(auto ec = read_key<Strict>(begin, end, keys);
+             ec != decode_errc::ok)
+            return ec;
+
+          auto c = find_column(next);
+          if(!c) {
+            if(auto ec = detail::skip_value<Strict>(begin, end, skip_);
+               ec != decode_errc::ok)
+              return ec;
+            continue;
+          }
+          if(c->valid(rows_ - 1))
+            return decode_errc::duplicated_key;
+
+          if(c->type() == column_type::integer) {
+            if(*begin != 'i')
+              return decode_errc::unexpected_type;
+            long long value;
+            if(auto ec = detail::decode_int<long long, Strict>(begin, end,
+                                                               value);
+               ec != decode_errc::ok)
+              return ec;
+            c->set_integer(value);
+          } else {
+            if(!std::isdigit(*begin))
+              return decode_errc::unexpected_type;
+            std::string_view value;
+            if(auto ec = detail::decode_str<Strict>(begin, end, value);
+               ec != decode_errc::ok)
+              return ec;
+            c->set_string(value);
+          }
+        }
+      }
+    }
+
+    template<bool Strict>
+    decode_errc read_key(const char *&begin, const char *end,
+                         detail::key_order &order) {
+      return detail::read_key<Strict>(begin, end, order, key_, skip_.keys);
+    }
+
+    // Find the column for `key_`. Rows usually list their keys in the same
+    // order as the schema, so start looking just after the last match.
+    column * find_column(std::size_t &next) noexcept {
+      for(std::size_t n = 0; n != columns_.size(); n++) {
+        auto i = (next + n) % columns_.size();
+        if(columns_[i].key() == key_) {
+          next = i + 1;
+          return &columns_[i];
+        }
+      }
+      return nullptr;
+    }
+
+    std::vector<column> columns_;
+    std::size_t rows_ = 0;
+    std::string_view key_;
+    detail::skip_state skip_;
+  };
+
+  // Decode a list of dicts with the same keys into columns, without building
+  // a dict for each row. `path` is the sequence of dict keys leading from the
+  // root value to the list (empty if the root is the list itself), and
+  // `schema` lists the keys to extract; other keys are skipped.
+  inline column_table
+  decode_columns(const string_view &s,
+                 const std::vector<std::string_view> &path,
+                 const std::vector<column_spec> &schema,
+                 decode_mode mode = lenient) {
+    column_table table;
+    const char *begin = s.data();
+    if(auto ec = table.parse(begin, s.data() + s.size(), path, schema, mode);
+       ec != decode_errc::ok)
+      detail::throw_decode_error(ec, table.last_key());
+    return table;
+  }
+
+  inline decode_result<column_table>
+  try_decode_columns(const string_view &s,
+                     const std::vector<std::string_view> &path,
+                     const std::vector<column_spec> &schema,
+                     decode_mode mode = lenient) {
+    column_table table;
+    const char *begin = s.data();
+    auto ec = table.parse(begin, s.data() + s.size(), path, schema, mode);
+    if(ec != decode_errc::ok)
+      return decode_result<column_table>(ec, begin - s.data());
+    return decode_result<column_table>(std::move(table), begin - s.data());
+  }
+
+  // A field of a struct bound with `struct_fields`: the dict key it's stored
+  // under and a pointer to the member holding its value.
+  template<typename Class, typename Member>
+  struct field {
+    constexpr field(std::string_view name, Member Class::*member) noexcept
+      : name(name), member(member) {}
+
+    std::string_view name;
+    Member Class::*member;
+  };
+
+  template<typename Class, typename Member>
+  field(std::string_view, Member Class::*) -> field<Class, Member>;
+
+  // Describes how to decode a struct from a dict with `decode_as` and encode
+  // it back. Specializations have a static `fields` member holding a tuple of
+  // `field`s; `BENCODE_FIELDS` defines one whose keys are the member names.
+  template<typename T>
+  struct struct_fields {};
+
+#define BENCODE_FIELD_ENTRY(type, member)                                     \
+  ::bencode::field(#member, &type::member)
+
+  // Bind the members of a struct to the dict keys of the same names. This
+  // must be used at global scope.
+#define BENCODE_FIELDS(type, ...)                                             \
+  template<>                                                                  \
+  struct bencode::struct_fields<type> {                                       \
+    static constexpr auto fields = std::make_tuple(                           \
+      BENCODE_FOR_EACH(BENCODE_FIELD_ENTRY, type, __VA_ARGS__)                \
+    );                                                                        \
+  }
+
+  namespace detail {
+    template<typename T, typename = void>
+    inline constexpr bool has_struct_fields_v = false;
+
+    template<typename T>
+    inline constexpr bool has_struct_fields_v<T, std::void_t<
+      decltype(struct_fields<T>::fields)
+    >> = true;
+
+    template<typename T>
+    inline constexpr std::size_t field_count_v = std::tuple_size_v<
+      std::decay_t<decltype(struct_fields<T>::fields)>
+    >;
+
+    template<typename T, typename = void>
+    inline constexpr bool is_data_v = false;
+
+    template<typename T>
+    inline constexpr bool is_data_v<T, std::void_t<
+      decltype(sizeof(variant_traits_for<T>))
+    >> = true;
+
+    template<typename T>
+    inline constexpr bool is_vector_v = false;
+
+    template<typename T, typename Allocator>
+    inline constexpr bool is_vector_v<std::vector<T, Allocator>> = true;
+
+    template<typename T>
+    inline constexpr bool is_optional_v = false;
+
+    template<typename T>
+    inline constexpr bool is_optional_v<std::optional<T>> = true;
+
+    template<typename T>
+    inline constexpr bool dependent_false_v = false;
+
+    // Decodes values straight into C++ types: integers, `std::string` and
+    // `std::string_view`, and vectors and optionals of these, structs bound
+    // with `struct_fields`, and data types like `bencode::data`.
+    class struct_decoder {
+    public:
+      template<typename T>
+      decode_errc parse(const char *&begin, const char *end, T &value,
+                        decode_mode mode = lenient) {
+        skip_.keys.clear();
+        return mode == strict ? decode<true>(begin, end, value) :
+                                decode<false>(begin, end, value);
+      }
+
+      // If the last call to `parse` failed with `duplicated_key`, the
+      // offending key.
+      std::string_view key() const noexcept { return key_; }
+    private:
+      // Structs and vectors are decoded recursively, so to keep a
+      // self-referential struct from overflowing the stack, we give up once
+      // they're nested `max_recursion` levels deep.
+      template<bool Strict, typename T>
+      decode_errc decode(const char *&begin, const char *end, T &value,
+                         std::size_t depth = 0) {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+        if constexpr(has_struct_fields_v<T> || is_vector_v<T>) {
+          if(depth == max_recursion)
+            return decode_errc::nesting_too_deep;
+        }
+
+        if constexpr(has_struct_fields_v<T>) {
+          return decode_struct<Strict>(begin, end, value, depth + 1);
+        } else if constexpr(is_data_v<T>) {
+          return basic_parser<T>{}.parse(begin, end, value,
+                                         Strict ? strict : lenient);
+        } else if constexpr((std::is_integral_v<T> &&
+                             !std::is_same_v<T, bool>) ||
+                            is_big_integer_v<T>) {
+          if(*begin != 'i')
+            return decode_errc::unexpected_type;
+          return decode_int<T, Strict>(begin, end, value);
+        } else if constexpr(std::is_same_v<T, std::string> ||
+                            std::is_same_v<T, std::string_view>) {
+          if(!std::isdigit(*begin))
+            return decode_errc::unexpected_type;
+          return decode_str<Strict>(begin, end, value);
+        } else if constexpr(is_optional_v<T>) {
+          return decode<Strict>(begin, end, value.emplace(), depth);
+        } else if constexpr(is_vector_v<T>) {
+          if(*begin != 'l')
+            return decode_errc::unexpected_type;
+          ++begin;
+          value.clear();
+          while(true) {
+            if(begin == end)
+              return decode_errc::unexpected_eos;
+            if(*begin == 'e') {
+              ++begin;
+              return decode_errc::ok;
+            }
+            if(auto ec = decode<Strict>(begin, end, value.emplace_back(),
+                                        depth + 1);
+               ec != decode_errc::ok)
+              return ec;
+          }
+        } else {
+          static_assert(dependent_false_v<T>, "type can't be decoded");
+        }
+      }
+
+      template<bool Strict, typename T>
+      decode_errc decode_struct(const char *&begin, const char *end,
+                                T &value, std::size_t depth) {
+        if(*begin != 'd')
+          return decode_errc::unexpected_type;
+        ++begin;
+
+        key_order order;
+        while(true) {
+          if(begin == end)
+            return decode_errc::unexpected_eos;
+          if(*begin == 'e') {
+            ++begin;
+            order.close<Strict>(skip_.keys);
+            return decode_errc::ok;
+          }
+          if(auto ec = read_key<Strict>(begin, end, order, key_, skip_.keys);
+             ec != decode_errc::ok)
+            return ec;
+
+          auto ec = decode_errc::ok;
+          if(!decode_field<Strict>(
+               begin, end, value, depth, ec,
+               std::make_index_sequence<field_count_v<T>>()
+             ))
+            ec = skip_value<Strict>(begin, end, skip_);
+          if(ec != decode_errc::ok)
+            return ec;
+        }
+      }
+
+      // Decode the field named by `key_`, if any. Each field's name is a
+      // `std::string_view` known at compile time, so comparing against it
+      // checks the length first and only compares the characters if that
+      // matches. `read_key` has already rejected duplicated keys.
+      template<bool Strict, typename T, std::size_t ...I>
+      bool decode_field(const char *&begin, const char *end, T &value,
+                        std::size_t depth, decode_errc &ec,
+                        std::index_sequence<I...>) {
+        return (match_field<Strict, I>(begin, end, value, depth, ec) || ...);
+      }
+
+      template<bool Strict, std::size_t I, typename T>
+      bool match_field(const char *&begin, const char *end, T &value,
+                       std::size_t depth, decode_errc &ec) {
+        constexpr auto &f = std::get<I>(struct_fields<T>::fields);
+        if(key_ != f.name)
+          return false;
+        ec = decode<Strict>(begin, end, value.*(f.member), depth);
+        return true;
+      }
+
+      std::string_view key_;
+      skip_state skip_;
+    };
+  }
+
+  // Decode a value directly into a `T` without building a `data` first. `T`
+  // is usually a struct bound with `BENCODE_FIELDS`; dict keys that don't
+  // match any of its fields are skipped, and fields whose keys are missing
+  // keep their default values. Any `std::string_view`s in the result point
+  // into `s`.
+  template<typename T>
+  T decode_as(const string_view &s, decode_mode mode = lenient) {
+    T result{};
+    detail::struct_decoder decoder;
+    const char *begin = s.data();
+    if(auto ec = decoder.parse(begin, s.data() + s.size(), result, mode);
+       ec != decode_errc::ok)
+      detail::throw_decode_error(ec, decoder.key());
+    return result;
+  }
+
+  template<typename T>
+  decode_result<T> try_decode_as(const string_view &s,
+                                 decode_mode mode = lenient) {
+    T result{};
+    detail::struct_decoder decoder;
+    const char *begin = s.data();
+    auto ec = decoder.parse(begin, s.data() + s.size(), result, mode);
+    if(ec != decode_errc::ok)
+      return decode_result<T>(ec, begin - s.data());
+    return decode_result<T>(std::move(result), begin - s.data());
+  }
+
+  // Decoding and encoding for KRPC, the protocol spoken by the BitTorrent DHT
+  // (BEP 5). Its messages are small dicts drawn from a fixed vocabulary, so
+  // rather than building a `data_view` for each packet, `krpc::parser` reads
+  // them straight into a `krpc::message`.
+  namespace krpc {
+    enum class message_type : char {
+      query = 'q',
+      response = 'r',
+      error = 'e'
+    };
+
+    // A view of the strings in a bencoded list, like the `values` of a
+    // `get_peers` response. `elements` holds the encoded strings themselves,
+    // without the surrounding `l` and `e`; each is decoded as you iterate.
+    class string_list {
+    public:
+      class iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view *;
+        using reference = const std::string_view &;
+
+        iterator() = default;
+
+        reference operator *() const noexcept { return value_; }
+        pointer operator ->() const noexcept { return &value_; }
+
+        iterator & operator ++() {
+          pos_ = next_;
+          read();
+          return *this;
+        }
+
+        iterator operator ++(int) {
+          auto tmp = *this;
+          ++*this;
+          return tmp;
+        }
+
+        bool operator ==(const iterator &rhs) const noexcept {
+          return pos_ == rhs.pos_;
+        }
+
+        bool operator !=(const iterator &rhs) const noexcept {
+          return pos_ != rhs.pos_;
+        }
+      private:
+        friend class string_list;
+
+        iterator(const char *pos, const char *end)
+          : pos_(pos), next_(pos), end_(end) {
+          read();
+        }
+
+        void read() {
+          if(next_ != end_)
+            bencode::detail::decode_str(next_, end_, value_);
+        }
+
+        const char *pos_ = nullptr, *next_ = nullptr, *end_ = nullptr;
+        std::string_view value_;
+      };
+
+      using const_iterator = iterator;
+
+      string_list() = default;
+      string_list(std::string_view elements, std::size_t size) noexcept
+        : elements_(elements), size_(size) {}
+
+      std::string_view elements() const noexcept { return elements_; }
+      std::size_t size() const noexcept { return size_; }
+      bool empty() const noexcept { return size_ == 0; }
+
+      iterator begin() const {
+        return iterator(elements_.data(), elements_.data() + elements_.size());
+      }
+
+      iterator end() const {
+        auto end = elements_.data() + elements_.size();
+        return iterator(end, end);
+      }
+    private:
+      std::string_view elements_;
+      std::size_t size_ = 0;
+    };
+
+    // A KRPC message. Strings point into the buffer the message was decoded
+    // from.
+    struct message {
+      std::string_view transaction_id;          // `t`
+      message_type type = message_type::query;  // `y`
+      std::string_view method;                  // `q`
+
+      // The query arguments (`a`) or response values (`r`).
+      std::string_view id;
+      std::string_view target;
+      std::string_view info_hash;
+      std::string_view nodes;
+      std::string_view token;
+      string_list values;
+      std::optional<integer> port;
+
+      // The error (`e`).
+      integer error_code = 0;
+      std::string_view error_message;
+    };
+
+    namespace detail {
+      using namespace bencode::detail;
+
+      // Check for a prefix whose length is known at compile time; compilers
+      // turn the `memcmp` into a few wide compares.
+      template<std::size_t N>
+      inline bool has_prefix(const char *begin, const char *end,
+                             const char (&prefix)[N]) {
+        return static_cast<std::size_t>(end - begin) >= N - 1 &&
+               std::memcmp(begin, prefix, N - 1) == 0;
+      }
+
+      template<bool Strict>
+      inline bool read_string(const char *&begin, const char *end,
+                              std::string_view &value) {
+        return begin != end && std::isdigit(*begin) &&
+               decode_str<Strict>(begin, end, value) == decode_errc::ok;
+      }
+
+      template<bool Strict>
+      inline bool read_integer(const char *&begin, const char *end,
+                               integer &value) {
+        return begin != end && *begin == 'i' &&
+               decode_int<integer, Strict>(begin, end, value) ==
+               decode_errc::ok;
+      }
+
+      // Read a dict key, requiring it to sort after the previous one even in
+      // lenient mode. Unsorted keys are rare, so rather than tracking every
+      // key to find duplicates, we leave those dicts to the slow path.
+      template<bool Strict>
+      inline bool read_sorted_key(const char *&begin, const char *end,
+                                  key_order &keys, std::string_view &key) {
+        return read_string<Strict>(begin, end, key) && begin != end &&
+               keys.check(key) == decode_errc::ok;
+      }
+
+      // Skip over an integer or string. Lists and dicts aren't expected
+      // here, so we leave those to the slow path.
+      template<bool Strict>
+      inline bool skip_scalar(const char *&begin, const char *end) {
+        if(begin != end && *begin == 'i') {
+          integer value;
+          return read_integer<Strict>(begin, end, value);
+        }
+        std::string_view value;
+        return read_string<Strict>(begin, end, value);
+      }
+    }
+
+    // A reusable KRPC decoder. Well-formed messages are read in a single pass
+    // without allocating; anything unusual (unknown keys holding lists or
+    // dicts, unsorted or duplicated keys, values of the wrong type, or
+    // malformed data) is decoded again into a `data_view` to get the same
+    // result or error as the general decoder.
+    class parser {
+    public:
+      decode_errc parse(const char *&begin, const char *end, message &msg,
+                        decode_mode mode = lenient) {
+        const char *p = begin;
+        bool fast = mode == strict ? parse_fast<true>(p, end, msg) :
+                                     parse_fast<false>(p, end, msg);
+        if(fast) {
+          begin = p;
+          return decode_errc::ok;
+        }
+        return parse_slow(begin, end, msg, mode);
+      }
+
+      // If the last call to `parse` failed with `duplicated_key` or
+      // `missing_key`, the offending key.
+      std::string_view key() const noexcept { return key_; }
+    private:
+      enum field_bit : unsigned {
+        body_bit  = 1 << 0,
+        error_bit = 1 << 1,
+        q_bit     = 1 << 2,
+        t_bit     = 1 << 3,
+        y_bit     = 1 << 4
+      };
+
+      template<bool Strict>
+      bool parse_fast(const char *&begin, const char *end, message &msg) {
+        using namespace detail;
+
+        msg = message();
+        if(begin == end || *begin != 'd')
+          return false;
+        ++begin;
+
+        key_order keys;
+        unsigned seen = 0;
+        char body = 0;
+        while(true) {
+          if(begin == end)
+            return false;
+          if(*begin == 'e') {
+            ++begin;
+            break;
+          }
+
+          // Every key we care about at the top level is one character long,
+          // so check for those directly.
+          std::string_view key;
+          if(has_prefix(begin, end, "1:") && end - begin >= 3) {
+            key = std::string_view(begin + 2, 1);
+            begin += 3;
+            if(keys.check(key) != decode_errc::ok)
+              return false;
+          } else {
+            if(!read_sorted_key<Strict>(begin, end, keys, key) ||
+               !skip_scalar<Strict>(begin, end))
+              return false;
+            continue;
+          }
+
+          unsigned bit;
+          bool ok;
+          switch(key[0]) {
+          case 'a':
+          case 'r':
+            bit = body_bit;
+            body = key[0];
+            ok = parse_body<Strict>(begin, end, msg);
+            break;
+          case 'e':
+            bit = error_bit;
+            ok = parse_error<Strict>(begin, end, msg);
+            break;
+          case 'q':
+            bit = q_bit;
+            ok = read_string<Strict>(begin, end, msg.method);
+            break;
+          case 't':
+            bit = t_bit;
+            ok = read_string<Strict>(begin, end, msg.transaction_id);
+            break;
+          case 'y':
+            bit = y_bit;
+            ok = has_prefix(begin, end, "1:q") ||
+                 has_prefix(begin, end, "1:r") ||
+                 has_prefix(begin, end, "1:e");
+            if(ok) {
+              msg.type = static_cast<message_type>(begin[2]);
+              begin += 3;
+            }
+            break;
+          default:
+            bit = 0;
+            ok = skip_scalar<Strict>(begin, end);
+            break;
+          }
+          if(!ok || (seen & bit))
+            return false;
+          seen |= bit;
+        }
+
+        // Let the slow path report missing keys, and ignore arguments or
+        // return values that don't match the message type.
+        char expected_body = msg.type == message_type::query    ? 'a' :
+                             msg.type == message_type::response ? 'r' : 0;
+        return (seen & t_bit) && (seen & y_bit) &&
+               (!body || body == expected_body);
+      }
+
+      template<bool Strict>
+      bool parse_body(const char *&begin, const char *end, message &msg) {
+        using namespace detail;
+
+        key_order keys;
+        unsigned seen = 0;
+
+        // Nearly every query and response starts with the sender's 20-byte
+        // ID, so check for it all at once.
+        if(has_prefix(begin, end, "d2:id20:") && end - begin >= 28) {
+          msg.id = std::string_view(begin + 8, 20);
+          begin += 28;
+          keys.check("id");
+          seen = 1;
+        } else if(has_prefix(begin, end, "d")) {
+          ++begin;
+        } else {
+          return false;
+        }
+
+        static constexpr std::string_view names[] = {
+          "id", "info_hash", "nodes", "target", "token", "port", "values"
+        };
+        std::string_view message::*members[] = {
+          &message::id, &message::info_hash, &message::nodes,
+          &message::target, &message::token
+        };
+
+        while(true) {
+          if(begin == end)
+            return false;
+          if(*begin == 'e') {
+            ++begin;
+            return true;
+          }
+
+          std::string_view key;
+          if(!read_sorted_key<Strict>(begin, end, keys, key))
+            return false;
+
+          std::size_t i = 0;
+          while(i != std::size(names) && key != names[i])
+            i++;
+
+          bool ok;
+          unsigned bit = 1u << i;
+          if(i < std::size(members)) {
+            ok = read_string<Strict>(begin, end, msg.*members[i]);
+          } else if(i == std::size(members)) {  // port
+            integer port;
+            if((ok = read_integer<Strict>(begin, end, port)))
+              msg.port = port;
+          } else if(i == std::size(members) + 1) {  // values
+            ok = parse_values<Strict>(begin, end, msg.values);
+          } else {
+            bit = 0;
+            ok = skip_scalar<Strict>(begin, end);
+          }
+          if(!ok || (seen & bit))
+            return false;
+          seen |= bit;
+        }
+      }
+
+      template<bool Strict>
+      bool parse_error(const char *&begin, const char *end, message &msg) {
+        if(!detail::has_prefix(begin, end, "l"))
+          return false;
+        ++begin;
+        if(!detail::read_integer<Strict>(begin, end, msg.error_code) ||
+           !detail::read_string<Strict>(begin, end, msg.error_message) ||
+           !detail::has_prefix(begin, end, "e"))
+          return false;
+        ++begin;
+        return true;
+      }
+
+      template<bool Strict>
+      bool parse_values(const char *&begin, const char *end,
+                        string_list &values) {
+        if(!detail::has_prefix(begin, end, "l"))
+          return false;
+        const char *start = ++begin;
+        std::size_t size = 0;
+        while(true) {
+          if(begin == end)
+            return false;
+          if(*begin == 'e')
+            break;
+          std::string_view value;
+          if(!detail::read_string<Strict>(begin, end, value))
+            return false;
+          ++size;
+        }
+        values = string_list(std::string_view(start, begin - start), size);
+        ++begin;
+        return true;
+      }
+
+      decode_errc parse_slow(const char *&begin, const char *end,
+                             message &msg, decode_mode mode) {
+        using dict = data_view::dict;
+        using list = data_view::list;
+
+        msg = message();
+        if(auto ec = parser_.parse(begin, end, data_, mode);
+           ec != decode_errc::ok) {
+          key_ = parser_.key();
+          return ec;
+        }
+
+        auto top = std::get_if<dict>(&data_.base());
+        if(!top)
+          return decode_errc::unexpected_type;
+
+        auto find = [this](const dict &d, std::string_view key,
+                           const data_view *&value, bool required = false) {
+          auto i = d.find(key);
+          value = i == d.end() ? nullptr : &i->second;
+          if(!value && required) {
+            key_ = key;
+            return decode_errc::missing_key;
+          }
+          return decode_errc::ok;
+        };
+        auto get_string = [](const data_view *value,
+                             std::string_view &result) {
+          if(!value)
+            return true;
+          auto s = std::get_if<std::string_view>(&value->base());
+          if(s)
+            result = *s;
+          return s != nullptr;
+        };
+
+        const data_view *t, *y, *q, *e;
+        if(auto ec = find(*top, "t", t, true); ec != decode_errc::ok)
+          return ec;
+        if(auto ec = find(*top, "y", y, true); ec != decode_errc::ok)
+          return ec;
+        find(*top, "q", q);
+        find(*top, "e", e);
+
+        std::string_view type;
+        if(!get_string(t, msg.transaction_id) || !get_string(y, type) ||
+           !get_string(q, msg.method) || type.size() != 1 ||
+           (type[0] != 'q' && type[0] != 'r' && type[0] != 'e'))
+          return decode_errc::unexpected_type;
+        msg.type = static_cast<message_type>(type[0]);
+
+        if(e) {
+          auto l = std::get_if<list>(&e->base());
+          if(!l || l->size() != 2)
+            return decode_errc::unexpected_type;
+          auto code = std::get_if<integer>(&(*l)[0].base());
+          if(!code || !get_string(&(*l)[1], msg.error_message))
+            return decode_errc::unexpected_type;
+          msg.error_code = *code;
+        }
+
+        if(msg.type == message_type::error)
+          return decode_errc::ok;
+
+        const data_view *body;
+        find(*top, msg.type == message_type::query ? "a" : "r", body);
+        if(!body)
+          return decode_errc::ok;
+        auto args = std::get_if<dict>(&body->base());
+        if(!args)
+          return decode_errc::unexpected_type;
+
+        const data_view *value;
+        for(auto [key, member] : {
+          std::pair("id", &message::id),
+          std::pair("info_hash", &message::info_hash),
+          std::pair("nodes", &message::nodes),
+          std::pair("target", &message::target),
+          std::pair("token", &message::token)
+        }) {
+          find(*args, key, value);
+          if(!get_string(value, msg.*member))
+            return decode_errc::unexpected_type;
+        }
+
+        if(find(*args, "port", value); value) {
+          auto port = std::get_if<integer>(&value->base());
+          if(!port)
+            return decode_errc::unexpected_type;
+          msg.port = *port;
+        }
+
+        if(find(*args, "values", value); value) {
+          auto l = std::get_if<list>(&value->base());
+          if(!l)
+            return decode_errc::unexpected_type;
+          for(auto &&i : *l) {
+            if(!std::get_if<std::string_view>(&i.base()))
+              return decode_errc::unexpected_type;
+          }
+          if(!l->empty()) {
+            // The strings are views into the buffer, so the encoded elements
+            // run from the length of the first string to the end of the last.
+            auto first = std::get<std::string_view>(l->front().base());
+            auto last = std::get<std::string_view>(l->back().base());
+            const char *start = first.data() - 1;
+            while(std::isdigit(start[-1]))
+              --start;
+            msg.values = string_list(std::string_view(
+              start, last.data() + last.size() - start
+            ), l->size());
+          }
+        }
+
+        return decode_errc::ok;
+      }
+
+      basic_parser<data_view> parser_;
+      data_view data_;
+      std::string_view key_;
+    };
+
+    // Decode a KRPC message. Strings in the result point into `s`.
+    inline message decode(const string_view &s, decode_mode mode = lenient) {
+      message msg;
+      parser p;
+      const char *begin = s.data();
+      if(auto ec = p.parse(begin, s.data() + s.size(), msg, mode);
+         ec != decode_errc::ok)
+        bencode::detail::throw_decode_error(ec, p.key());
+      return msg;
+    }
+
+    inline decode_result<message>
+    try_decode(const string_view &s, decode_mode mode = lenient) {
+      message msg;
+      parser p;
+      const char *begin = s.data();
+      auto ec = p.parse(begin, s.data() + s.size(), msg, mode);
+      if(ec != decode_errc::ok)
+        return decode_result<message>(ec, begin - s.data());
+      return decode_result<message>(std::move(msg), begin - s.data());
+    }
+  }
+
+  // A compact node in a `flat_document`. Nodes are stored in pre-order, so the
+  // children of a list or dict immediately follow it, and `next` is the index
+  // one past the end of this node's subtree (i.e. its next sibling).
+  class flat_node {
+  public:
+    enum class type : std::uint8_t { integer, string, list, dict };
+
+    // The largest string length or number of nodes we can represent.
+    static constexpr std::size_t max_size = (std::size_t(1) << 29) - 1;
+
+    type kind() const noexcept { return static_cast<type>(kind_); }
+    std::size_t size() const noexcept { return size_; }
+    std::size_t next() const noexcept { return next_; }
+
+    long long integer() const noexcept {
+      assert(kind() == type::integer);
+      return value_.integer;
+    }
+
+    std::string_view string() const noexcept {
+      assert(kind() == type::string);
+      return std::string_view(value_.string, size_);
+    }
+  private:
+    friend class flat_document;
+
+    std::uint32_t next_;
+    std::uint32_t size_ : 29;
+    std::uint32_t kind_ : 2;
+    std::uint32_t unsorted_ : 1;
+    union {
+      long long integer;
+      const char *string;
+    } value_;
+  };
+
+  class flat_document;
+
+  // A lightweight handle to one value in a `flat_document`.
+  class flat_value {
+  public:
+    using type = flat_node::type;
+
+    class iterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = flat_value;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = flat_value;
+
+      iterator() = default;
+      iterator(const flat_document *doc, std::size_t index)
+        : doc_(doc), index_(index) {}
+
+      inline flat_value operator *() const;
+      inline iterator & operator ++();
+
+      iterator operator ++(int) {
+        iterator tmp(*this);
+        ++*this;
+        return tmp;
+      }
+
+      bool operator ==(const iterator &rhs) const {
+        return index_ == rhs.index_;
+      }
+      bool operator !=(const iterator &rhs) const { return !(*this == rhs); }
+    private:
+      const flat_document *doc_ = nullptr;
+      std::size_t index_ = 0;
+    };
+
+    flat_value(const flat_document *doc, std::size_t index)
+      : doc_(doc), index_(index) {}
+
+    std::size_t index() const noexcept { return index_; }
+    inline const flat_node & node() const noexcept;
+
+    type kind() const noexcept { return node().kind(); }
+    bool is_integer() const noexcept { return kind() == type::integer; }
+    bool is_string() const noexcept { return kind() == type::string; }
+    bool is_list() const noexcept { return kind() == type::list; }
+    bool is_dict() const noexcept { return kind() == type::dict; }
+
+    long long as_integer() const noexcept { return node().integer(); }
+    std::string_view as_string() const noexcept { return node().string(); }
+
+    // The key this value was stored under, if its parent is a dict.
+    inline std::string_view key() const noexcept;
+
+    // The number of children of a list or dict.
+    std::size_t size() const noexcept {
+      assert(is_list() || is_dict());
+      return node().size();
+    }
+
+    iterator begin() const {
+      assert(is_list() || is_dict());
+      return iterator(doc_, index_ + 1);
+    }
+    iterator end() const {
+      assert(is_list() || is_dict());
+      return iterator(doc_, node().next());
+    }
+
+    // Find the child of a dict with the given key, or return `end()`.
+    inline iterator find(std::string_view key) const;
+
+    // Get the `i`th child of a list or dict. This is linear in `i`.
+    flat_value operator [](std::size_t i) const {
+      assert(i < size());
+      auto it = begin();
+      std::advance(it, i);
+      return *it;
+    }
+  private:
+    const flat_document *doc_;
+    std::size_t index_;
+  };
+
+  // A decoded value stored entirely in caller-provided arrays: one of nodes
+  // and one of keys (the key of each node whose parent is a dict). Strings
+  // point into the decoded buffer, so it must outlive this document. Decoding
+  // never allocates; if the arrays are too small, it fails with
+  // `decode_errc::out_of_capacity`.
+  class flat_document {
+  public:
+    flat_document(flat_node *nodes, std::string_view *keys,
+                  std::size_t capacity) noexcept
+      : nodes_(nodes), keys_(keys),
+        capacity_((std::min)(capacity, flat_node::max_size)) {}
+
+    template<std::size_t N>
+    flat_document(flat_node (&nodes)[N], std::string_view (&keys)[N]) noexcept
+      : flat_document(nodes, keys, N) {}
+
+    flat_document(const flat_document &) = delete;
+    flat_document & operator =(const flat_document &) = delete;
+
+    std::size_t capacity() const noexcept { return capacity_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    void clear() noexcept { size_ = 0; }
+
+    flat_value root() const {
+      assert(!empty());
+      return flat_value(this, 0);
+    }
+
+    const flat_node & node(std::size_t i) const noexcept {
+      assert(i < size_);
+      return nodes_[i];
+    }
 
-      ++begin;
-      return value;
+    std::string_view key(std::size_t i) const noexcept {
+      assert(i < size_);
+      return keys_[i];
     }
 
-    template<typename String>
-    class str_reader {
-    public:
-      template<typename Iter, typename Size>
-      inline String operator ()(Iter &begin, Iter end, Size len) {
-        return call(
-          begin, end, len,
-          typename std::iterator_traits<Iter>::iterator_category()
-        );
-      }
-    private:
-      template<typename Iter, typename Size>
-      String call(Iter &begin, Iter end, Size len, std::forward_iterator_tag) {
-        if(std::distance(begin, end) < static_cast<std::ptrdiff_t>(len))
-          throw std::invalid_argument("unexpected end of string");
+    // Decode a value, replacing the current contents of this document. The
+    // input must be contiguous. On failure, `begin` points to where decoding
+    // stopped and this document is empty.
+    template<typename Iter>
+    decode_errc parse(Iter &begin, Iter end, decode_mode mode = lenient) {
+      static_assert(std::is_base_of_v<
+        std::forward_iterator_tag,
+        typename std::iterator_traits<Iter>::iterator_category
+      > && !detail::is_segmented_iterator_v<Iter>,
+      "fixed-capacity decoding requires contiguous input");
 
-        auto orig = begin;
-        std::advance(begin, len);
-        return String(orig, begin);
+      if constexpr(detail::is_byte_pointer_v<Iter>) {
+        auto orig = reinterpret_cast<const char *>(begin);
+        auto b = orig;
+        auto ec = parse(b, reinterpret_cast<const char *>(end), mode);
+        begin += b - orig;
+        return ec;
+      } else {
+        auto ec = mode == strict ? parse_impl<true>(begin, end) :
+                                   parse_impl<false>(begin, end);
+        if(ec != decode_errc::ok)
+          size_ = 0;
+        return ec;
       }
+    }
 
-      template<typename Iter, typename Size>
-      String call(Iter &begin, Iter end, Size len, std::input_iterator_tag) {
-        String value(len, 0);
-        for(Size i = 0; i < len; i++) {
-          if(begin == end)
-            throw std::invalid_argument("unexpected end of string");
-          value[i] = *begin++;
-        }
-        return value;
-      }
-    };
+    // If the last call to `parse` failed with `duplicated_key`, the
+    // offending key.
+    std::string_view last_key() const noexcept { return key_; }
 
-    template<>
-    class str_reader<std::string_view> {
-    public:
-      template<typename Iter, typename Size>
-      std::string_view operator ()(Iter &begin, Iter end, Size len) {
-        if(std::distance(begin, end) < static_cast<std::ptrdiff_t>(len))
-          throw std::invalid_argument("unexpected end of string");
+    template<typename Iter>
+    void decode(Iter &begin, Iter end, decode_mode mode = lenient) {
+      if(auto ec = parse(begin, end, mode); ec != decode_errc::ok)
+        detail::throw_decode_error(ec, key_);
+    }
 
-        std::string_view value(&*begin, len);
-        std::advance(begin, len);
-        return value;
-      }
-    };
+    template<typename Iter>
+    inline void decode(const Iter &begin, Iter end,
+                       decode_mode mode = lenient) {
+      Iter b(begin);
+      decode(b, end, mode);
+    }
 
-    template<typename String, typename Iter>
-    String decode_str(Iter &begin, Iter end) {
-      assert(std::isdigit(*begin));
-      std::size_t len = decode_digits<std::size_t>(begin, end);
-      if(begin == end)
-        throw std::invalid_argument("unexpected end of string");
-      if(*begin != ':')
-        throw std::invalid_argument("expected ':'");
-      ++begin;
+    inline void decode(const string_view &s, decode_mode mode = lenient) {
+      decode(s.data(), s.data() + s.size(), mode);
+    }
 
-      return str_reader<String>{}(begin, end, len);
+    template<typename Iter>
+    decode_result<void>
+    try_decode(Iter &begin, Iter end, decode_mode mode = lenient) {
+      Iter orig = begin;
+      auto ec = parse(begin, end, mode);
+      return decode_result<void>(ec, detail::iter_distance(orig, begin));
     }
 
-  }
+    template<typename Iter>
+    inline decode_result<void>
+    try_decode(const Iter &begin, Iter end, decode_mode mode = lenient) {
+      Iter b(begin);
+      return try_decode(b, end, mode);
+    }
 
-  template<typename Data, typename Iter>
-  Data basic_decode(Iter &begin, Iter end) {
-    using Traits = variant_traits_for<Data>;
-    using integer = typename Data::integer;
-    using string  = typename Data::string;
-    using list    = typename Data::list;
-    using dict    = typename Data::dict;
+    inline decode_result<void>
+    try_decode(const string_view &s, decode_mode mode = lenient) {
+      return try_decode(s.data(), s.data() + s.size(), mode);
+    }
+  private:
+    static constexpr std::uint32_t npos = ~std::uint32_t(0);
 
-    typename Data::string dict_key;
-    Data result;
-    std::stack<Data*> state;
-
-    // There are three ways we can store an element we've just parsed:
-    //   1) to the root node
-    //   2) appended to the end of a list
-    //   3) inserted into a dict
-    // We then return a pointer to the thing we've just inserted, which lets
-    // us add that pointer to our node stack. Since we only ever manipulate the
-    // top element of the stack, this pointer should be valid for as long as we
-    // hold onto it.
-    auto store = [&result, &state, &dict_key](auto &&thing) -> Data * {
-      if(state.empty()) {
-        result = std::move(thing);
-        return &result;
-      } else if(auto p = Traits::template get_if<list>(state.top())) {
-        p->push_back(std::move(thing));
-        return &p->back();
-      } else if(auto p = Traits::template get_if<dict>(state.top())) {
-        auto i = p->emplace(std::move(dict_key), std::move(thing));
-        if(!i.second) {
-          throw std::invalid_argument(
-            "duplicated key in dict: " + std::string(i.first->first)
-          );
-        }
-        return &i.first->second;
+    bool is_duplicate(std::uint32_t dict, std::string_view key) const {
+      for(auto i = dict + 1; i != size_; i = nodes_[i].next_) {
+        if(keys_[i] == key)
+          return true;
       }
-      assert(false && "expected list or dict");
-      return nullptr;
-    };
+      return false;
+    }
 
-    do {
-      if(begin == end)
-        throw std::invalid_argument("unexpected end of string");
+    template<bool Strict, typename Iter>
+    decode_errc parse_impl(Iter &begin, Iter end) {
+      // While a list or dict is open, its `next_` holds the index of its
+      // parent instead, so we can track our position without a separate
+      // stack. `prev` is the last child added to the innermost open node.
+      std::uint32_t current = npos, prev = npos;
+      size_ = 0;
 
-      if(*begin == 'e') {
-        if(!state.empty()) {
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_eos;
+
+        if(*begin == 'e') {
+          if(current == npos)
+            return decode_errc::unexpected_e;
           ++begin;
-          state.pop();
-        } else {
-          throw std::invalid_argument("unexpected e");
+          auto &n = nodes_[current];
+          prev = current;
+          current = n.next_;
+          n.next_ = size_;
+          continue;
         }
-      } else {
-        if(!state.empty() && Traits::index(*state.top()) == 3 /* dict */) {
+
+        key_ = std::string_view();
+        if(current != npos && nodes_[current].kind_ ==
+           static_cast<std::uint32_t>(flat_node::type::dict)) {
           if(!std::isdigit(*begin))
-            throw std::invalid_argument("expected string token");
-          dict_key = detail::decode_str<string>(begin, end);
+            return decode_errc::expected_string;
+          if(auto ec = detail::decode_str<Strict>(begin, end, key_);
+             ec != decode_errc::ok)
+            return ec;
+
+          // Keys are usually sorted, so we only need to search for
+          // duplicates once we've seen one out of order.
+          auto &parent = nodes_[current];
+          if(prev != npos && !(keys_[prev] < key_)) {
+            if(keys_[prev] == key_)
+              return decode_errc::duplicated_key;
+            if constexpr(Strict)
+              return decode_errc::unsorted_keys;
+            parent.unsorted_ = 1;
+          }
+          if(parent.unsorted_ && is_duplicate(current, key_))
+            return decode_errc::duplicated_key;
           if(begin == end)
-            throw std::invalid_argument("unexpected end of string");
+            return decode_errc::unexpected_eos;
         }
 
+        if(size_ == capacity_)
+          return decode_errc::out_of_capacity;
+        std::uint32_t index = size_;
+        auto &n = nodes_[index];
+        n.size_ = 0;
+        n.unsorted_ = 0;
+        n.next_ = index + 1;
+
         if(*begin == 'i') {
-          store(detail::decode_int<integer>(begin, end));
-        } else if(*begin == 'l') {
-          ++begin;
-          state.push(store( list{} ));
-        } else if(*begin == 'd') {
+          n.kind_ = static_cast<std::uint32_t>(flat_node::type::integer);
+          if(auto ec = detail::decode_int<long long, Strict>(
+               begin, end, n.value_.integer
+             ); ec != decode_errc::ok)
+            return ec;
+        } else if(*begin == 'l' || *begin == 'd') {
+          n.kind_ = static_cast<std::uint32_t>(
+            *begin == 'l' ? flat_node::type::list : flat_node::type::dict
+          );
           ++begin;
-          state.push(store( dict{} ));
         } else if(std::isdigit(*begin)) {
-          store(detail::decode_str<string>(begin, end));
+          std::string_view value;
+          if(auto ec = detail::decode_str<Strict>(begin, end, value);
+             ec != decode_errc::ok)
+            return ec;
+          if(value.size() > flat_node::max_size)
+            return decode_errc::out_of_capacity;
+          n.kind_ = static_cast<std::uint32_t>(flat_node::type::string);
+          n.size_ = static_cast<std::uint32_t>(value.size());
+          n.value_.string = value.data();
         } else {
-          throw std::invalid_argument("unexpected type");
+          return decode_errc::unexpected_type;
         }
-      }
-    } while(!state.empty());
-
-    return result;
-  }
-
-  template<typename Data, typename Iter>
-  inline Data basic_decode(const Iter &begin, Iter end) {
-    Iter b(begin);
-    return basic_decode<Data>(b, end);
-  }
-
-  template<typename Data>
-  inline Data basic_decode(const string_view &s) {
-    return basic_decode<Data>(s.begin(), s.end());
-  }
-
-  template<typename Data>
-  Data basic_decode(std::istream &s, eof_behavior e = check_eof) {
-    static_assert(!std::is_same_v<typename Data::string, std::string_view>,
-                  "reading from stream not supported for data views");
-
-    std::istreambuf_iterator<char> begin(s), end;
-    auto result = basic_decode<Data>(begin, end);
-    // If we hit EOF, update the parent stream.
-    if(e == check_eof && begin == end)
-      s.setstate(std::ios_base::eofbit);
-    return result;
-  }
-
-  template<typename T>
-  inline data decode(T &begin, T end) {
-    return basic_decode<data>(begin, end);
-  }
-
-  template<typename T>
-  inline data decode(const T &begin, T end) {
-    return basic_decode<data>(begin, end);
-  }
-
-  inline data decode(const string_view &s) {
-    return basic_decode<data>(s.begin(), s.end());
-  }
 
-  inline data decode(std::istream &s, eof_behavior e = check_eof) {
-    return basic_decode<data>(s, e);
-  }
-
-  template<typename T>
-  inline data_view decode_view(T &begin, T end) {
-    return basic_decode<data_view>(begin, end);
-  }
+        keys_[index] = key_;
+        size_++;
+        if(current != npos)
+          nodes_[current].size_++;
 
-  template<typename T>
-  inline data_view decode_view(const T &begin, T end) {
-    return basic_decode<data_view>(begin, end);
-  }
+        if(n.kind() == flat_node::type::list ||
+           n.kind() == flat_node::type::dict) {
+          n.next_ = current;
+          current = index;
+          prev = npos;
+        } else {
+          prev = index;
+        }
+      } while(current != npos);
 
-  inline data_view decode_view(const string_view &s) {
-    return basic_decode<data_view>(s.begin(), s.end());
-  }
+      return decode_errc::ok;
+    }
 
-#ifdef BENCODE_HAS_BOOST
-  template<typename T>
-  inline boost_data boost_decode(T &begin, T end) {
-    return basic_decode<boost_data>(begin, end);
-  }
+    flat_node *nodes_;
+    std::string_view *keys_;
+    std::size_t capacity_;
+    std::uint32_t size_ = 0;
+    std::string_view key_;
+  };
 
-  template<typename T>
-  inline boost_data boost_decode(const T &begin, T end) {
-    return basic_decode<boost_data>(begin, end);
-  }
+  // A `flat_document` with storage for `N` nodes held inline, e.g. on the
+  // stack.
+  template<std::size_t N>
+  class fixed_document : public flat_document {
+  public:
+    fixed_document() noexcept : flat_document(nodes_, keys_) {}
+  private:
+    flat_node nodes_[N];
+    std::string_view keys_[N];
+  };
 
-  inline boost_data boost_decode(const string_view &s) {
-    return basic_decode<boost_data>(s.begin(), s.end());
+  inline const flat_node & flat_value::node() const noexcept {
+    return doc_->node(index_);
   }
 
-  inline boost_data boost_decode(std::istream &s, eof_behavior e = check_eof) {
-    return basic_decode<boost_data>(s, e);
+  inline std::string_view flat_value::key() const noexcept {
+    return doc_->key(index_);
   }
 
-  template<typename T>
-  inline boost_data_view boost_decode_view(T &begin, T end) {
-    return basic_decode<boost_data_view>(begin, end);
+  inline flat_value::iterator flat_value::find(std::string_view key) const {
+    assert(is_dict());
+    for(auto i = begin(), e = end(); i != e; ++i) {
+      if((*i).key() == key)
+        return i;
+    }
+    return end();
   }
 
-  template<typename T>
-  inline boost_data_view boost_decode_view(const T &begin, T end) {
-    return basic_decode<boost_data_view>(begin, end);
+  inline flat_value flat_value::iterator::operator *() const {
+    return flat_value(doc_, index_);
   }
 
-  inline boost_data_view boost_decode_view(const string_view &s) {
-    return basic_decode<boost_data_view>(s.begin(), s.end());
+  inline flat_value::iterator & flat_value::iterator::operator ++() {
+    index_ = doc_->node(index_).next();
+    return *this;
   }
-#endif
 
   namespace detail {
     class list_encoder {
@@ -612,6 +7741,10 @@ namespace bencode {
 
       template<typename T>
       inline dict_encoder & add(const string_view &key, T &&value);
+      template<typename T>
+      inline dict_encoder & add(const bytes_view &key, T &&value);
+      template<std::size_t N, typename T>
+      inline dict_encoder & add(const key_literal<N> &key, T &&value);
     private:
       std::ostream &os;
     };
@@ -625,7 +7758,7 @@ namespace bencode {
       char buf[std::numeric_limits<T>::digits10 + 2];
       auto r = std::to_chars(buf, buf + sizeof(buf), value);
       if(r.ec != std::errc())
-        throw std::invalid_argument("failed to write integer value");
+        throw_exception<std::invalid_argument>("failed to write integer value");
       os.write(buf, r.ptr - buf);
 #else
       auto s = std::to_string(value);
@@ -640,38 +7773,142 @@ namespace bencode {
     os.put('e');
   }
 
+  template<typename String>
+  void encode(std::ostream &os, const basic_big_integer<String> &value) {
+    if(value.is_small())
+      return encode(os, value.small());
+    os.put('i');
+    if(value.negative())
+      os.put('-');
+    os.write(value.digits().data(), value.digits().size());
+    os.put('e');
+  }
+
   inline void encode(std::ostream &os, const string_view &value) {
     detail::write_integer(os, value.size());
     os.put(':');
     os.write(value.data(), value.size());
   }
 
+  inline void encode(std::ostream &os, const bytes_view &value) {
+    encode(os, value.chars());
+  }
+
+  template<std::size_t N>
+  inline void encode(std::ostream &os, const key_literal<N> &value) {
+    os.write(value.token, sizeof(value.token));
+  }
+
+  // These are templates so that other types implicitly convertible to
+  // compact strings or data (like string literals) don't match them.
   template<typename T>
-  void encode(std::ostream &os, const std::vector<T> &value) {
+  std::enable_if_t<std::is_same_v<T, compact_string>>
+  encode(std::ostream &os, const T &value) {
+    encode(os, value.view());
+  }
+
+#ifdef BENCODE_HAS_SPAN
+  inline void encode(std::ostream &os, std::span<const std::byte> value) {
+    encode(os, bytes_view(value));
+  }
+
+  inline void encode(std::ostream &os, std::span<const std::uint8_t> value) {
+    encode(os, bytes_view(value));
+  }
+#endif
+
+  template<typename T, typename A>
+  void encode(std::ostream &os, const std::vector<T, A> &value) {
     detail::list_encoder e(os);
     for(auto &&i : value)
       e.add(i);
   }
 
-  template<typename T>
-  void encode(std::ostream &os, const std::map<string, T> &value) {
+  template<typename Traits, typename SA, typename T, typename C, typename A>
+  void encode(std::ostream &os,
+              const std::map<std::basic_string<char, Traits, SA>, T, C, A>
+              &value) {
     detail::dict_encoder e(os);
     for(auto &&i : value)
       e.add(i.first, i.second);
   }
 
-  template<typename T>
-  void encode(std::ostream &os, const std::map<string_view, T> &value) {
+  template<typename T, typename C, typename A>
+  void encode(std::ostream &os, const std::map<string_view, T, C, A> &value) {
+    detail::dict_encoder e(os);
+    for(auto &&i : value)
+      e.add(i.first, i.second);
+  }
+
+  template<typename T, typename C, typename A>
+  void encode(std::ostream &os, const std::map<bytes_view, T, C, A> &value) {
+    detail::dict_encoder e(os);
+    for(auto &&i : value)
+      e.add(i.first, i.second);
+  }
+
+  template<typename T, typename C, typename A>
+  void encode(std::ostream &os,
+              const std::map<interned_string, T, C, A> &value) {
+    detail::dict_encoder e(os);
+    for(auto &&i : value)
+      e.add(i.first.view(), i.second);
+  }
+
+  template<typename V, typename A>
+  void encode(std::ostream &os, const packed_list<V, A> &value) {
+    using packing = typename packed_list<V, A>::packing;
+    detail::list_encoder e(os);
+    if(value.kind() == packing::integers) {
+      for(auto i : value.integers())
+        encode(os, i);
+    } else if(value.kind() == packing::strings) {
+      for(std::size_t i = 0; i != value.size(); i++)
+        encode(os, value.string_at(i));
+    } else {
+      for(auto &&i : value)
+        e.add(i);
+    }
+  }
+
+  template<typename T, typename C, typename A>
+  void encode(std::ostream &os,
+              const std::map<compact_string, T, C, A> &value) {
+    detail::dict_encoder e(os);
+    for(auto &&i : value)
+      e.add(i.first.view(), i.second);
+  }
+
+  template<typename K, typename V, typename A>
+  void encode(std::ostream &os, const flat_dict<K, V, A> &value) {
     detail::dict_encoder e(os);
     for(auto &&i : value)
       e.add(i.first, i.second);
   }
 
-  template<typename K, typename V>
-  void encode(std::ostream &os, const map_proxy<K, V> &value) {
+  template<typename K, typename V, typename A>
+  void encode(std::ostream &os, const hash_dict<K, V, A> &value) {
+    detail::dict_encoder e(os);
+    value.for_each_sorted([&e](auto &&i) { e.add(i.first, i.second); });
+  }
+
+  template<typename K, typename V, typename A>
+  void encode(std::ostream &os, const map_proxy<K, V, A> &value) {
     encode(os, *value);
   }
 
+  inline void encode(std::ostream &os, const pooled_list &value) {
+    detail::list_encoder e(os);
+    for(auto &&i : value)
+      e.add(i);
+  }
+
+  inline void encode(std::ostream &os, const pooled_dict &value) {
+    detail::dict_encoder e(os);
+    for(auto &&i : value)
+      e.add(i.first, i.second);
+  }
+
   namespace detail {
     class encode_visitor {
     public:
@@ -692,6 +7929,66 @@ namespace bencode {
     variant_traits<Variant>::visit(detail::encode_visitor(os), value);
   }
 
+  template<typename T>
+  std::enable_if_t<std::is_same_v<T, compact_data>>
+  encode(std::ostream &os, const T &value) {
+    value.visit(detail::encode_visitor(os));
+  }
+
+  template<typename T>
+  std::enable_if_t<std::is_same_v<T, pooled_data>>
+  encode(std::ostream &os, const T &value) {
+    value.visit(detail::encode_visitor(os));
+  }
+
+  namespace detail {
+    // The indices of a bound struct's fields, sorted by key.
+    template<typename T>
+    constexpr auto sorted_fields() {
+      constexpr std::size_t size = field_count_v<T>;
+      auto names = std::apply([](const auto &...f) {
+        return std::array<std::string_view, size>{f.name...};
+      }, struct_fields<T>::fields);
+
+      std::array<std::size_t, size> order = {};
+      for(std::size_t i = 0; i != size; i++) {
+        std::size_t j = i;
+        for(; j != 0 && names[i] < names[order[j - 1]]; j--)
+          order[j] = order[j - 1];
+        order[j] = i;
+      }
+      return order;
+    }
+
+    template<std::size_t I, typename T>
+    void encode_field(dict_encoder &e, const T &value) {
+      constexpr auto &f = std::get<I>(struct_fields<T>::fields);
+      static constexpr key_literal<f.name.size()> key(f.name);
+      auto &member = value.*(f.member);
+      if constexpr(is_optional_v<std::decay_t<decltype(member)>>) {
+        if(member)
+          e.add(key, *member);
+      } else {
+        e.add(key, member);
+      }
+    }
+
+    template<typename T, std::size_t ...I>
+    void encode_fields(dict_encoder &e, const T &value,
+                       std::index_sequence<I...>) {
+      constexpr auto order = sorted_fields<T>();
+      (encode_field<order[I]>(e, value), ...);
+    }
+  }
+
+  template<typename T>
+  std::enable_if_t<detail::has_struct_fields_v<T>>
+  encode(std::ostream &os, const T &value) {
+    detail::dict_encoder e(os);
+    detail::encode_fields(e, value,
+                          std::make_index_sequence<detail::field_count_v<T>>());
+  }
+
   namespace detail {
     template<typename T>
     inline list_encoder & list_encoder::add(T &&value) {
@@ -706,6 +8003,22 @@ namespace bencode {
       encode(os, std::forward<T>(value));
       return *this;
     }
+
+    template<typename T>
+    inline dict_encoder &
+    dict_encoder::add(const bytes_view &key, T &&value) {
+      encode(os, key);
+      encode(os, std::forward<T>(value));
+      return *this;
+    }
+
+    template<std::size_t N, typename T>
+    inline dict_encoder &
+    dict_encoder::add(const key_literal<N> &key, T &&value) {
+      encode(os, key);
+      encode(os, std::forward<T>(value));
+      return *this;
+    }
   }
 
   template<typename T>
@@ -715,6 +8028,209 @@ namespace bencode {
     return ss.str();
   }
 
+  namespace detail {
+    // A stream buffer that appends everything written to it onto the end of
+    // a container of bytes.
+    template<typename Container>
+    class appending_streambuf : public std::streambuf {
+    public:
+      using byte_type = typename Container::value_type;
+
+      explicit appending_streambuf(Container &c) : c_(c) {}
+    protected:
+      int_type overflow(int_type ch) override {
+        if(!traits_type::eq_int_type(ch, traits_type::eof()))
+          c_.push_back(static_cast<byte_type>(ch));
+        return traits_type::not_eof(ch);
+      }
+
+      std::streamsize xsputn(const char *s, std::streamsize n) override {
+        auto p = reinterpret_cast<const byte_type *>(s);
+        c_.insert(c_.end(), p, p + n);
+        return n;
+      }
+    private:
+      Container &c_;
+    };
+  }
+
+  // Encode a value into a vector of bytes, suitable for passing directly to
+  // an I/O layer that expects `std::byte` or `std::uint8_t`.
+  template<typename Byte = std::byte, typename T>
+  std::vector<Byte> encode_bytes(T &&t) {
+    std::vector<Byte> result;
+    detail::appending_streambuf<std::vector<Byte>> buf(result);
+    std::ostream os(&buf);
+    encode(os, std::forward<T>(t));
+    return result;
+  }
+
+  namespace krpc {
+    namespace detail {
+      // Writes into a fixed-size buffer, remembering if it ran out of room.
+      class buffer_writer {
+      public:
+        buffer_writer(char *buf, std::size_t size)
+          : begin_(buf), pos_(buf), end_(buf + size) {}
+
+        std::size_t size() const noexcept {
+          return overflow_ ? 0 : pos_ - begin_;
+        }
+
+        void put(char c) {
+          if(pos_ == end_)
+            overflow_ = true;
+          else
+            *pos_++ = c;
+        }
+
+        void write(const char *s, std::size_t n) {
+          if(static_cast<std::size_t>(end_ - pos_) < n) {
+            overflow_ = true;
+          } else {
+            std::memcpy(pos_, s, n);
+            pos_ += n;
+          }
+        }
+
+        void write(std::string_view s) {
+          write(s.data(), s.size());
+        }
+
+        void write_integer(integer value) {
+          char buf[std::numeric_limits<integer>::digits10 + 2];
+          char *p = buf + sizeof(buf);
+          auto n = static_cast<unsigned long long>(value);
+          if(value < 0)
+            n = 0 - n;
+          do {
+            *--p = static_cast<char>('0' + n % 10);
+            n /= 10;
+          } while(n);
+          if(value < 0)
+            *--p = '-';
+          write(p, buf + sizeof(buf) - p);
+        }
+
+        void write_int_value(integer value) {
+          put('i');
+          write_integer(value);
+          put('e');
+        }
+
+        void write_string(std::string_view s) {
+          write_integer(static_cast<integer>(s.size()));
+          put(':');
+          write(s);
+        }
+
+        // Write `key` (already encoded) and `value` if `value` isn't empty.
+        void write_field(std::string_view key, std::string_view value) {
+          if(!value.empty()) {
+            write(key);
+            write_string(value);
+          }
+        }
+      private:
+        char *begin_, *pos_, *end_;
+        bool overflow_ = false;
+      };
+
+      template<typename WriteValues>
+      std::size_t encode_message(char *buf, std::size_t size,
+                                 const message &msg, bool has_values,
+                                 WriteValues &&write_values) {
+        buffer_writer w(buf, size);
+        auto write_body = [&](std::string_view key) {
+          w.write(key);
+          w.put('d');
+          w.write_field("2:id", msg.id);
+          w.write_field("9:info_hash", msg.info_hash);
+          w.write_field("5:nodes", msg.nodes);
+          if(msg.port) {
+            w.write("4:port");
+            w.write_int_value(*msg.port);
+          }
+          w.write_field("6:target", msg.target);
+          w.write_field("5:token", msg.token);
+          if(has_values) {
+            w.write("6:valuesl");
+            write_values(w);
+            w.put('e');
+          }
+          w.put('e');
+        };
+
+        // Keys are written in sorted order: `a`, `e`, `q`, `r`, `t`, `y`.
+        w.put('d');
+        if(msg.type == message_type::query) {
+          write_body("1:a");
+        } else if(msg.type == message_type::error) {
+          w.write("1:el");
+          w.write_int_value(msg.error_code);
+          w.write_string(msg.error_message);
+          w.put('e');
+        }
+        w.write_field("1:q", msg.method);
+        if(msg.type == message_type::response)
+          write_body("1:r");
+        w.write("1:t");
+        w.write_string(msg.transaction_id);
+        w.write("1:y1:");
+        w.put(static_cast<char>(msg.type));
+        w.put('e');
+        return w.size();
+      }
+    }
+
+    // Encode a KRPC message into `buf` without allocating, returning the
+    // number of bytes written, or 0 if the message didn't fit. Empty strings
+    // in the arguments or return values are left out.
+    inline std::size_t encode(char *buf, std::size_t size,
+                              const message &msg) {
+      return detail::encode_message(
+        buf, size, msg, !msg.values.empty(), [&msg](auto &w) {
+          w.write(msg.values.elements());
+        }
+      );
+    }
+
+    // Encode a KRPC message, taking its `values` from a range of strings
+    // (e.g. compact peer addresses) instead of `msg.values`.
+    template<typename Values>
+    std::size_t encode(char *buf, std::size_t size, const message &msg,
+                       const Values &values) {
+      using std::begin;
+      using std::end;
+      return detail::encode_message(
+        buf, size, msg, begin(values) != end(values), [&values](auto &w) {
+          for(auto &&i : values)
+            w.write_string(i);
+        }
+      );
+    }
+
+    template<std::size_t N>
+    inline std::size_t encode(char (&buf)[N], const message &msg) {
+      return encode(buf, N, msg);
+    }
+
+    template<std::size_t N, typename Values>
+    std::size_t encode(char (&buf)[N], const message &msg,
+                       const Values &values) {
+      return encode(buf, N, msg, values);
+    }
+  }
+
 }
 
+template<template<typename ...> typename Variant, typename I, typename S,
+         template<typename ...> typename L, template<typename ...> typename D>
+struct std::hash<bencode::basic_data<Variant, I, S, L, D>> {
+  std::size_t
+  operator ()(const bencode::basic_data<Variant, I, S, L, D> &value) const {
+    return bencode::detail::hash_data(value);
+  }
+};
+
 #endif
@@ -0,0 +1,473 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include "bencode.hpp"
+
+#include <unordered_set>
+
+suite<> test_data("test data", [](auto &_) {
+  subsuite<>(_, "map_proxy", [](auto &_) {
+    static_assert(std::is_nothrow_move_constructible_v<bencode::dict>);
+    static_assert(std::is_nothrow_move_assignable_v<bencode::dict>);
+    static_assert(std::is_nothrow_move_constructible_v<bencode::data>);
+    static_assert(std::is_nothrow_move_assignable_v<bencode::data>);
+
+    _.test("copy", []() {
+      bencode::dict d{{"foo", 1}, {"bar", bencode::list{2, 3}}};
+      bencode::dict copy(d);
+      expect(copy.size(), equal_to(2u));
+      expect(&copy["foo"], not_equal_to(&d["foo"]));
+
+      copy["foo"] = 4;
+      expect(std::get<bencode::integer>(d["foo"]), equal_to(1));
+    });
+
+    _.test("copy assignment", []() {
+      bencode::dict d{{"foo", 1}}, other{{"bar", 2}};
+      auto &result = (other = d);
+      expect(&result, equal_to(&other));
+      expect(other.size(), equal_to(1u));
+      expect(std::get<bencode::integer>(other.at("foo")), equal_to(1));
+      expect(&other["foo"], not_equal_to(&d["foo"]));
+    });
+
+    _.test("move", []() {
+      bencode::dict d{{"foo", 1}, {"bar", bencode::list{2, 3}}};
+      auto *node = &d["bar"];
+      bencode::dict moved(std::move(d));
+      expect(&moved["bar"], equal_to(node));
+
+      // Moved-from dicts are still usable.
+      d["baz"] = 4;
+      expect(d.size(), equal_to(1u));
+    });
+
+    _.test("move assignment", []() {
+      bencode::dict d{{"foo", 1}, {"bar", bencode::list{2, 3}}}, other;
+      auto *node = &d["bar"];
+      auto &result = (other = std::move(d));
+      expect(&result, equal_to(&other));
+      expect(&other["bar"], equal_to(node));
+
+      bencode::data outer = std::move(other), target;
+      target = std::move(outer);
+      expect(&std::get<bencode::dict>(target)["bar"], equal_to(node));
+    });
+
+    _.test("swap", []() {
+      bencode::dict d{{"foo", 1}}, other{{"bar", 2}, {"baz", 3}};
+      auto *node = &d["foo"];
+      swap(d, other);
+      expect(d.size(), equal_to(2u));
+      expect(&other["foo"], equal_to(node));
+    });
+  });
+
+  subsuite<>(_, "deeply-nested data", [](auto &_) {
+    constexpr std::size_t depth = 100000;
+    auto deep_list = [depth]() {
+      return bencode::decode(std::string(depth, 'l') + std::string(depth, 'e'));
+    };
+    auto list_depth = [](const bencode::data &d) {
+      std::size_t n = 0;
+      for(auto *i = &d; !std::get<bencode::list>(*i).empty(); n++)
+        i = &std::get<bencode::list>(*i)[0];
+      return n + 1;
+    };
+
+    _.test("destroy", [deep_list]() {
+      deep_list();
+
+      std::string dict;
+      for(std::size_t i = 0; i != depth; i++)
+        dict += "d1:a";
+      bencode::decode(dict + "i0e" + std::string(depth, 'e'));
+    });
+
+    _.test("copy", [deep_list, list_depth]() {
+      auto d = deep_list();
+      bencode::data copy(d);
+      expect(list_depth(copy), equal_to(depth));
+      expect(&std::get<bencode::list>(copy)[0],
+             not_equal_to(&std::get<bencode::list>(d)[0]));
+    });
+
+    _.test("copy assignment", [deep_list, list_depth]() {
+      auto d = deep_list();
+      bencode::data copy = bencode::list{1, 2};
+      copy = d;
+      expect(list_depth(copy), equal_to(depth));
+
+      copy = std::get<bencode::list>(copy)[0];
+      expect(list_depth(copy), equal_to(depth - 1));
+    });
+
+    _.test("compare", [deep_list]() {
+      auto a = deep_list(), b = deep_list();
+      expect(a == b, equal_to(true));
+      expect(a < b, equal_to(false));
+
+      std::string s(depth, 'l');
+      b = bencode::decode(s + "i1e" + std::string(depth, 'e'));
+      expect(a == b, equal_to(false));
+      expect(a < b, equal_to(true));
+    });
+
+    _.test("convert", []() {
+      std::string s = std::string(depth, 'l') + std::string(depth, 'e');
+      auto view = bencode::decode_view(s);
+      expect(bencode::convert<bencode::data>(view) == bencode::decode(s),
+             equal_to(true));
+    });
+
+    _.test("hash", [deep_list]() {
+      std::string s = std::string(depth, 'l') + std::string(depth, 'e');
+      expect(std::hash<bencode::data>{}(deep_list()),
+             equal_to(bencode::canonical_hash(s)));
+    });
+
+    _.test("compact_data", []() {
+      std::string s(depth, 'l');
+      auto a = bencode::compact_decode(s + std::string(depth, 'e'));
+      bencode::compact_data copy(a);
+      expect(copy == a, equal_to(true));
+
+      auto b = bencode::compact_decode(s + "i1e" + std::string(depth, 'e'));
+      expect(b == a, equal_to(false));
+      copy = b;
+      expect(copy == b, equal_to(true));
+
+      std::string dict;
+      for(std::size_t i = 0; i != depth; i++)
+        dict += "d1:a";
+      auto d = bencode::compact_decode(dict + "i0e" + std::string(depth, 'e'));
+      expect(bencode::compact_data(d) == d, equal_to(true));
+    });
+  });
+
+  subsuite<>(_, "comparison", [](auto &_) {
+    _.test("dicts", []() {
+      bencode::dict a{{"a", 1}}, b{{"b", 1}}, c{{"a", 2}};
+      expect(a == a, equal_to(true));
+      expect(a != b, equal_to(true));
+      expect(a < b, equal_to(true));
+      expect(b > a, equal_to(true));
+      expect(a < c, equal_to(true));
+      expect(c <= a, equal_to(false));
+      expect(a >= a, equal_to(true));
+    });
+
+    _.test("data", []() {
+      bencode::data i = 2, s = "1", l = bencode::list{1},
+                    d = bencode::dict{{"a", 1}};
+      expect(i < s && s < l && l < d, equal_to(true));
+      expect(bencode::data(1) < i, equal_to(true));
+      expect(bencode::data("10") < s, equal_to(false));
+      expect(bencode::data(bencode::list{1, 2}) > l, equal_to(true));
+      expect(bencode::data(bencode::list{1}) == l, equal_to(true));
+      expect(bencode::data(bencode::dict{{"a", 2}}) != d, equal_to(true));
+
+#ifdef BENCODE_HAS_THREE_WAY_COMPARISON
+      expect((i <=> s) < 0, equal_to(true));
+      expect((d <=> bencode::data(bencode::dict{{"a", 1}})) == 0,
+             equal_to(true));
+#endif
+    });
+
+    _.test("views", []() {
+      auto a = bencode::decode_view("d1:ali1ei2ee1:bi3ee");
+      auto b = bencode::decode_view("d1:ali1ei3ee1:bi3ee");
+      expect(a == a, equal_to(true));
+      expect(a != b, equal_to(true));
+      expect(a < b, equal_to(true));
+    });
+
+    _.test("hash dicts", []() {
+      auto a = bencode::basic_decode<bencode::hash_dict_data>(
+        "d1:ai1e1:bi2ee"
+      );
+      bencode::hash_dict_data b = bencode::hash_dict_data::dict{
+        {"b", 2}, {"a", 1}
+      };
+      expect(a == b, equal_to(true));
+
+      std::get<bencode::hash_dict_data::dict>(b)["c"] = 3;
+      expect(a != b, equal_to(true));
+    });
+  });
+
+  subsuite<>(_, "hashing", [](auto &_) {
+    _.test("matches canonical_hash", []() {
+      for(std::string s : {"i42e", "3:foo", "le", "li1e3:fooe", "de",
+                           "d1:ai1e1:bl3:fooee"}) {
+        expect(std::hash<bencode::data>{}(bencode::decode(s)),
+               equal_to(bencode::canonical_hash(s)));
+        expect(std::hash<bencode::data_view>{}(bencode::decode_view(s)),
+               equal_to(bencode::canonical_hash(s)));
+      }
+    });
+
+    _.test("hash dicts", []() {
+      std::string s = "d1:ai1e1:bi2ee";
+      bencode::hash_dict_data d = bencode::hash_dict_data::dict{
+        {"b", 2}, {"a", 1}
+      };
+      expect(std::hash<bencode::hash_dict_data>{}(d),
+             equal_to(bencode::canonical_hash(s)));
+    });
+
+    _.test("unordered_set", []() {
+      std::unordered_set<bencode::data> seen;
+      seen.insert(bencode::decode("d1:ai1ee"));
+      seen.insert(bencode::decode("li1ei2ee"));
+      seen.insert(bencode::data(bencode::dict{{"a", 1}}));
+      expect(seen.size(), equal_to(2u));
+      expect(seen.count(bencode::list{1, 2}), equal_to(1u));
+    });
+  });
+
+  subsuite<>(_, "convert", [](auto &_) {
+    std::string buf = "d3:bari1e3:bazde3:fooli1e4:spamd1:xi-1eee1:qlee";
+
+    _.test("view to owned", [buf]() {
+      auto view = bencode::decode_view(buf);
+      auto value = bencode::convert<bencode::data>(view);
+      expect(value == bencode::decode(buf), equal_to(true));
+
+      auto &foo = std::get<bencode::dict>(value)["foo"];
+      auto &spam = std::get<std::string>(std::get<bencode::list>(foo)[1]);
+      expect(spam, equal_to("spam"));
+      expect(spam.data(), not_equal_to(buf.data() + 27));
+    });
+
+    _.test("alternate variants", [buf]() {
+      auto value = bencode::decode(buf);
+      auto boost_value = bencode::convert<bencode::boost_data>(value);
+      expect(bencode::encode(boost_value), equal_to(buf));
+      expect(bencode::convert<bencode::data>(boost_value) == value,
+             equal_to(true));
+
+      auto flat = bencode::convert<bencode::flat_dict_data>(value);
+      expect(bencode::encode(flat), equal_to(buf));
+      auto hash = bencode::convert<bencode::hash_dict_data>(flat);
+      expect(bencode::encode(hash), equal_to(buf));
+      auto bytes = bencode::convert<bencode::byte_data_view>(value);
+      expect(bencode::encode(bytes), equal_to(buf));
+    });
+
+    _.test("moving", []() {
+      bencode::data value = bencode::list{
+        std::string(32, 'a'), bencode::dict{{"b", std::string(32, 'c')}}
+      };
+      auto &list = std::get<bencode::list>(value);
+      auto *a = std::get<std::string>(list[0]).data();
+      auto *c = std::get<std::string>(
+        std::get<bencode::dict>(list[1])["b"]
+      ).data();
+
+      auto flat = bencode::convert<bencode::flat_dict_data>(std::move(value));
+      auto &flat_list = std::get<bencode::flat_dict_data::list>(flat);
+      expect(std::get<std::string>(flat_list[0]).data(), equal_to(a));
+      expect(std::get<std::string>(
+        std::get<bencode::flat_dict_data::dict>(flat_list[1])["b"]
+      ).data(), equal_to(c));
+    });
+
+    _.test("packed lists", []() {
+      auto packed = bencode::basic_decode<bencode::packed_data>(
+        "lli1ei2eel1:a1:bee"
+      );
+      auto value = bencode::convert<bencode::data>(packed);
+      expect(bencode::encode(value), equal_to("lli1ei2eel1:a1:bee"));
+
+      auto repacked = bencode::convert<bencode::packed_data>(value);
+      auto &inner = std::get<bencode::packed_data::list>(repacked)[0];
+      expect(std::get<bencode::packed_data::list>(inner).is_packed(),
+             equal_to(false));
+      expect(repacked == packed, equal_to(true));
+    });
+
+    _.test("big integers", []() {
+      auto big = bencode::basic_decode<bencode::big_data_view>(
+        "li5ei123456789012345678901234567890ee"
+      );
+      auto owned = bencode::convert<bencode::big_data>(big);
+      expect(bencode::encode(owned),
+             equal_to("li5ei123456789012345678901234567890ee"));
+      expect([&owned]() { bencode::convert<bencode::data>(owned); },
+             thrown<std::out_of_range>("integer out of range"));
+
+      bencode::data small = bencode::list{5};
+      expect(bencode::convert<bencode::data>(
+        bencode::convert<bencode::big_data>(small)
+      ) == small, equal_to(true));
+    });
+  });
+
+  subsuite<>(_, "compact_data", [](auto &_) {
+    using bencode::compact_data;
+    static_assert(sizeof(compact_data) == 16);
+    static_assert(sizeof(bencode::compact_string) == 16);
+    static_assert(std::is_nothrow_move_constructible_v<compact_data>);
+    static_assert(std::is_nothrow_move_assignable_v<compact_data>);
+
+    _.test("integers", []() {
+      compact_data value = 42;
+      expect(value.index(), equal_to(0u));
+      expect(value.get<compact_data::integer>(), equal_to(42));
+      expect(value.get_if<compact_data::string>(), equal_to(nullptr));
+      expect([&]() { value.get<compact_data::list>(); },
+             thrown<std::bad_variant_access>());
+    });
+
+    _.test("strings", []() {
+      compact_data small = "foo";
+      expect(small.index(), equal_to(1u));
+      auto &s = small.get<bencode::compact_string>();
+      expect(s, equal_to("foo"));
+      expect(s.is_inline(), equal_to(true));
+
+      std::string text(100, 'x');
+      compact_data large = text;
+      auto &l = large.get<bencode::compact_string>();
+      expect(l, equal_to(text));
+      expect(l.is_inline(), equal_to(false));
+
+      l.append("yz", 2);
+      expect(l.size(), equal_to(102u));
+      l = "short";
+      expect(l, equal_to("short"));
+      expect(l.capacity(), greater_equal(102u));
+    });
+
+    _.test("lists and dicts", []() {
+      compact_data value = bencode::compact_list{
+        1, "foo", bencode::compact_dict{{"bar", 2}}
+      };
+      expect(value.index(), equal_to(2u));
+      auto &l = value.get<bencode::compact_list>();
+      expect(l.size(), equal_to(3u));
+      expect(l[2].index(), equal_to(3u));
+      expect(l[2].get<bencode::compact_dict>().at("bar"),
+             equal_to(compact_data(2)));
+    });
+
+    _.test("copy", []() {
+      compact_data value = bencode::compact_list{
+        "a string too long to fit inline", bencode::compact_dict{{"foo", 1}}
+      };
+      compact_data copy(value);
+      expect(copy, equal_to(value));
+
+      auto &l = copy.get<bencode::compact_list>();
+      expect(l[0].get<bencode::compact_string>().data(), not_equal_to(
+        value.get<bencode::compact_list>()[0].get<bencode::compact_string>()
+             .data()
+      ));
+      l[1].get<bencode::compact_dict>()["foo"] = 2;
+      expect(copy, not_equal_to(value));
+    });
+
+    _.test("move", []() {
+      compact_data value = bencode::compact_list{1, 2};
+      auto *list = value.get_if<bencode::compact_list>();
+      compact_data moved(std::move(value));
+      expect(moved.get_if<bencode::compact_list>(), equal_to(list));
+      expect(value, equal_to(compact_data(0)));
+
+      // Assigning a value owned by the target is safe.
+      compact_data outer = bencode::compact_list{"a string too long to fit"};
+      outer = std::move(outer.get<bencode::compact_list>()[0]);
+      expect(outer, equal_to(compact_data("a string too long to fit")));
+    });
+
+    _.test("swap", []() {
+      compact_data a = "foo", b = bencode::compact_list{1};
+      swap(a, b);
+      expect(a, equal_to(compact_data(bencode::compact_list{1})));
+      expect(b, equal_to(compact_data("foo")));
+    });
+  });
+
+  subsuite<>(_, "big_integer", [](auto &_) {
+    using bencode::big_integer;
+
+    _.test("construction", []() {
+      big_integer small(false, "9223372036854775807");
+      expect(small.is_small(), equal_to(true));
+      expect(small.small(), equal_to(9223372036854775807LL));
+
+      big_integer min(true, "9223372036854775808");
+      expect(min.is_small(), equal_to(true));
+      expect(min, equal_to(big_integer(-9223372036854775807LL - 1)));
+
+      big_integer big(false, "9223372036854775808");
+      expect(big.is_small(), equal_to(false));
+      expect(big.digits(), equal_to("9223372036854775808"));
+    });
+
+    _.test("conversion", []() {
+      big_integer big(true, "9223372036854775809");
+      expect(big.as<long long>().has_value(), equal_to(false));
+      expect(big.as<unsigned long long>().has_value(), equal_to(false));
+
+      big_integer u64(false, "18446744073709551615");
+      expect(*u64.as<unsigned long long>(),
+             equal_to(18446744073709551615ULL));
+      expect(big_integer(-1).as<unsigned>().has_value(), equal_to(false));
+      expect(*big_integer(300).as<short>(), equal_to(300));
+      expect(big_integer(300).as<std::int8_t>().has_value(),
+             equal_to(false));
+    });
+
+    _.test("comparison", []() {
+      big_integer big(false, "99999999999999999999"),
+                  bigger(false, "100000000000000000000"),
+                  neg(true, "99999999999999999999");
+      expect(big, equal_to(big_integer(false, "99999999999999999999")));
+      expect(big, not_equal_to(bigger));
+      expect(big, less(bigger));
+      expect(big_integer(5), less(big));
+      expect(neg, less(big_integer(-5)));
+      expect(big_integer(true, "100000000000000000000"), less(neg));
+      expect(big_integer(1), greater(big_integer(-1)));
+    });
+  });
+
+  subsuite<>(_, "key_literal", [](auto &_) {
+    static constexpr bencode::key_literal info("info");
+    static_assert(info.size() == 4);
+    static_assert(info.view() == "info");
+    static_assert(info.encoded() == "4:info");
+    static_assert(bencode::key_literal("0123456789").encoded() ==
+                  "10:0123456789");
+    static_assert(bencode::key_literal("").encoded() == "0:");
+
+    _.test("comparison", []() {
+      std::string s = "info";
+      expect(s == info, equal_to(true));
+      expect(info != std::string_view("infp"), equal_to(true));
+      expect(info < std::string_view("infp"), equal_to(true));
+      expect(std::string_view("inf") < info, equal_to(true));
+    });
+
+    _.test("lookup", []() {
+      bencode::dict d = {{"info", 1}, {"name", "foo"}};
+      expect(std::get<bencode::integer>(d.at(info)), equal_to(1));
+      expect(d.count(info), equal_to(1u));
+      expect(d.find(bencode::key_literal("x")), equal_to(d.end()));
+
+      bencode::flat_dict<std::string, int> flat = {{"info", 2}, {"x", 3}};
+      expect(flat.at(info), equal_to(2));
+
+      bencode::hash_dict<std::string, int> hash = {{"info", 4}, {"x", 5}};
+      expect(hash.at(info), equal_to(4));
+      expect(hash.contains(bencode::key_literal("y")), equal_to(false));
+
+#ifdef BENCODE_HAS_CLASS_NTTP
+      expect(std::get<bencode::integer>(d.at(bencode::key<"info">)),
+             equal_to(1));
+#endif
+    });
+  });
+});
@@ -3,6 +3,8 @@ using namespace mettle;
 
 #include "bencode.hpp"
 
+#include <list>
+
 struct at_eof : matcher_tag {
   bool operator ()(const std::string &) const {
     return true;
@@ -18,6 +20,58 @@ struct at_eof : matcher_tag {
   }
 };
 
+#ifdef BENCODE_HAS_PMR
+struct counting_resource : std::pmr::memory_resource {
+  std::size_t allocations = 0;
+  std::size_t outstanding = 0;
+private:
+  void * do_allocate(std::size_t bytes, std::size_t align) override {
+    ++allocations;
+    ++outstanding;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t align) override {
+    --outstanding;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+  noexcept override {
+    return this == &other;
+  }
+};
+#endif
+
+struct peer {
+  std::string ip;
+  int port = 0;
+};
+BENCODE_FIELDS(peer, ip, port);
+
+struct announce {
+  long long interval = 0;
+  std::vector<peer> peers;
+  std::optional<std::string> failure;
+  bencode::data extra;
+};
+
+struct tree {
+  std::vector<tree> children;
+};
+BENCODE_FIELDS(tree, children);
+
+template<>
+struct bencode::struct_fields<announce> {
+  static constexpr auto fields = std::make_tuple(
+    bencode::field("interval", &announce::interval),
+    bencode::field("peers", &announce::peers),
+    bencode::field("failure reason", &announce::failure),
+    bencode::field("extra", &announce::extra)
+  );
+};
+
 suite<> test_decode("test decoder", [](auto &_) {
 
   subsuite<
@@ -195,6 +249,1220 @@ suite<> test_decode("test decoder", [](auto &_) {
     });
   });
 
+  subsuite<>(_, "decoding from segmented buffers", [](auto &_) {
+    _.test("data", []() {
+      bencode::segmented_buffer buf{"d3:fo", "o", "", "l4:spami4", "2eee"};
+      auto value = bencode::decode(buf);
+      auto list = std::get<bencode::list>(
+        std::get<bencode::dict>(value)["foo"]
+      );
+      expect(std::get<bencode::string>(list[0]), equal_to("spam"));
+      expect(std::get<bencode::integer>(list[1]), equal_to(42));
+    });
+
+    _.test("data_view", []() {
+      std::string seg1("l4:spam4:g"), seg2("oa"), seg3("t0:e");
+      bencode::segmented_buffer buf{seg1, seg2, seg3};
+      auto in_seg1 = all(
+        greater_equal(seg1.data()),
+        less_equal(seg1.data() + seg1.size())
+      );
+
+      auto value = bencode::decode_view(buf);
+      auto list = std::get<bencode::list_view>(value);
+      auto spam = std::get<bencode::string_view>(list[0]);
+      expect(spam, equal_to("spam"));
+      expect(spam.data(), in_seg1);
+
+      auto goat = std::get<bencode::string_view>(list[1]);
+      expect(goat, equal_to("goat"));
+      expect(goat.data(), is_not(in_seg1));
+
+      expect(std::get<bencode::string_view>(list[2]), equal_to(""));
+    });
+
+    _.test("successive objects", []() {
+      bencode::segmented_buffer buf{"i4", "2e4:go", "at"};
+      auto begin = buf.begin(), end = buf.end();
+
+      auto first = bencode::decode(begin, end);
+      expect(std::get<bencode::integer>(first), equal_to(42));
+      expect(begin.offset(), equal_to(4u));
+
+      auto second = bencode::decode_view(begin, end);
+      expect(std::get<bencode::string_view>(second), equal_to("goat"));
+      expect(begin == end, equal_to(true));
+    });
+
+    _.test("errors", []() {
+      bencode::segmented_buffer buf{"l4:sp", "am5:go", "at"};
+      auto result = bencode::try_decode_view(buf);
+      expect(result.error(), equal_to(bencode::decode_errc::unexpected_eos));
+      expect(result.offset(), equal_to(9u));
+    });
+  });
+
+  subsuite<>(_, "decoding from forward iterators", [](auto &_) {
+    _.test("list<char>", []() {
+      std::string str("d3:foo4:spame");
+      std::list<char> data(str.begin(), str.end());
+      auto value = bencode::decode(data.begin(), data.end());
+      expect(std::get<bencode::string>(
+        std::get<bencode::dict>(value)["foo"]
+      ), equal_to("spam"));
+
+      std::list<char> truncated(str.begin(), str.end() - 2);
+      expect([&truncated]() {
+        bencode::decode(truncated.begin(), truncated.end());
+      }, thrown<std::invalid_argument>("unexpected end of string"));
+    });
+  });
+
+  subsuite<>(_, "decoding bytes", [](auto &_) {
+    _.test("from byte pointers", []() {
+      std::vector<std::byte> data;
+      for(char c : std::string("d3:fooi42ee"))
+        data.push_back(static_cast<std::byte>(c));
+
+      const std::byte *begin = data.data(), *end = begin + data.size();
+      auto value = bencode::decode(begin, end);
+      expect(begin == end, equal_to(true));
+      expect(std::get<bencode::integer>(
+        std::get<bencode::dict>(value)["foo"]
+      ), equal_to(42));
+    });
+
+    _.test("from uint8_t pointers", []() {
+      std::vector<std::uint8_t> data = {'4', ':', 's', 'p', 'a', 'm'};
+      auto value = bencode::decode_view(data.data(), data.data() + data.size());
+      auto str = std::get<bencode::string_view>(value);
+      expect(str, equal_to("spam"));
+      expect(static_cast<const void *>(str.data()),
+             equal_to(static_cast<const void *>(data.data() + 2)));
+    });
+
+    _.test("byte_data_view", []() {
+      std::string data("d3:foo4:\x01\x02\xff\x03" "e");
+      auto value = bencode::decode_byte_view(data);
+      auto dict = std::get<bencode::dict_byte_view>(value);
+      auto str = std::get<bencode::bytes_view>(
+        dict[bencode::bytes_view("foo")]
+      );
+      expect(str.size(), equal_to(4u));
+      expect(static_cast<const void *>(str.data()),
+             equal_to(static_cast<const void *>(data.data() + 8)));
+      expect(str[2], equal_to(std::byte{0xff}));
+    });
+
+#ifdef BENCODE_HAS_SPAN
+    _.test("from spans", []() {
+      std::vector<std::uint8_t> data = {'l', 'i', '1', 'e', '0', ':', 'e'};
+      auto value = bencode::decode(std::span<const std::uint8_t>(data));
+      expect(std::get<bencode::integer>(
+        std::get<bencode::list>(value)[0]
+      ), equal_to(1));
+
+      auto bytes = std::as_bytes(std::span(data));
+      auto view = bencode::decode_byte_view(bytes);
+      expect(std::get<bencode::bytes_view>(
+        std::get<bencode::list_byte_view>(view)[1]
+      ).size(), equal_to(0u));
+
+      auto result = bencode::try_decode_view(bytes.first(3));
+      expect(result.error(), equal_to(bencode::decode_errc::unexpected_eos));
+    });
+#endif
+  });
+
+  subsuite<>(_, "decoding into existing data", [](auto &_) {
+    _.test("decode_into", []() {
+      bencode::data target = 42;
+      bencode::decode_into(target, "d3:fooli1e3:bare3:bazi2ee");
+      expect(bencode::encode(target), equal_to("d3:bazi2e3:fooli1e3:baree"));
+
+      bencode::decode_into(target, "4:spam");
+      expect(std::get<bencode::string>(target), equal_to("spam"));
+    });
+
+    _.test("reuses storage", []() {
+      bencode::parser parser;
+      bencode::data target;
+      parser.decode_into(target, "d3:bar27:the quick brown fox jumps o"
+                                 "3:fooli1ei2ei3eee");
+
+      auto &dict = std::get<bencode::dict>(target);
+      auto *bar = &dict["bar"];
+      auto *bar_data = std::get<bencode::string>(*bar).data();
+      auto *foo_data = std::get<bencode::list>(dict["foo"]).data();
+
+      parser.decode_into(target, "d3:bar26:jumped over the lazy dog!!"
+                                 "3:fooli4ei5eee");
+      expect(&dict["bar"], equal_to(bar));
+      expect(std::get<bencode::string>(*bar).data(), equal_to(bar_data));
+      expect(std::get<bencode::string>(*bar),
+             equal_to("jumped over the lazy dog!!"));
+
+      auto &foo = std::get<bencode::list>(dict["foo"]);
+      expect(foo.data(), equal_to(foo_data));
+      expect(foo.size(), equal_to(2u));
+      expect(std::get<bencode::integer>(foo[1]), equal_to(5));
+    });
+
+    _.test("changes shape", []() {
+      bencode::parser parser;
+      bencode::data target;
+      parser.decode_into(target, "d1:ai1e1:bli1ei2ee1:c3:fooe");
+      parser.decode_into(target, "d1:a3:bar1:bd1:xi0ee1:di9ee");
+      expect(bencode::encode(target),
+             equal_to("d1:a3:bar1:bd1:xi0ee1:di9ee"));
+      parser.decode_into(target, "le");
+      expect(std::get<bencode::list>(target).size(), equal_to(0u));
+    });
+
+    _.test("views", []() {
+      bencode::parser_view parser;
+      bencode::data_view target;
+      std::string first("d3:fooi1ee"), second("d3:foo3:bare");
+      parser.decode_into(target, first);
+      parser.decode_into(target, second);
+      auto &dict = std::get<bencode::dict_view>(target);
+      expect(dict.begin()->first.data(), equal_to(second.data() + 3));
+      expect(std::get<bencode::string_view>(dict["foo"]), equal_to("bar"));
+    });
+
+    _.test("presized", []() {
+      bencode::parser parser(bencode::presized);
+      bencode::data target;
+      parser.decode_into(target, "d3:fooli1ei2ei3ee3:barlleli1eeee");
+      expect(bencode::encode(target),
+             equal_to("d3:barlleli1eee3:fooli1ei2ei3eee"));
+
+      auto &dict = std::get<bencode::dict>(target);
+      auto &foo = std::get<bencode::list>(dict["foo"]);
+      expect(foo.capacity(), equal_to(3u));
+      auto &bar = std::get<bencode::list>(dict["bar"]);
+      expect(bar.capacity(), equal_to(2u));
+      expect(std::get<bencode::list>(bar[1]).capacity(), equal_to(1u));
+
+      auto result = parser.try_decode_into(target, "li1ei2e");
+      expect(result.error(), equal_to(bencode::decode_errc::unexpected_eos));
+      expect(result.offset(), equal_to(7u));
+    });
+
+    _.test("errors", []() {
+      bencode::parser parser;
+      bencode::data target;
+      auto result = parser.try_decode_into(target, "d3:fooi1e3:fooi2ee");
+      expect(result.error(), equal_to(bencode::decode_errc::duplicated_key));
+      expect(result.offset(), equal_to(14u));
+
+      expect([&]() { parser.decode_into(target, "d3:fooi1e3:fooi2ee"); },
+             thrown<std::invalid_argument>("duplicated key in dict: foo"));
+      expect([&]() {
+        parser.decode_into(target, "d3:fooi1e3:bari2ee", bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+
+      expect(parser.try_decode_into(target, "d3:fooi1ee").has_value(),
+             equal_to(true));
+      expect(bencode::encode(target), equal_to("d3:fooi1ee"));
+    });
+  });
+
+  subsuite<>(_, "flat dicts", [](auto &_) {
+    using dict = bencode::flat_dict_data::dict;
+
+    _.test("decoding", []() {
+      auto value = bencode::basic_decode<bencode::flat_dict_data>(
+        "d3:bari1e3:fooli1ei2ee3:bazd1:xi1eee"
+      );
+      auto &d = std::get<dict>(value);
+      expect(d.size(), equal_to(3u));
+      expect(d.begin()->first, equal_to("bar"));
+      expect(std::get<bencode::integer>(d.at(std::string_view("bar"))),
+             equal_to(1));
+      expect(d.contains("foo"), equal_to(true));
+      expect(d.contains("qux"), equal_to(false));
+      expect(bencode::encode(value),
+             equal_to("d3:bari1e3:bazd1:xi1ee3:fooli1ei2eee"));
+    });
+
+    _.test("views", []() {
+      std::string data("d3:bar3:baz3:quxd1:xi1eee");
+      auto value = bencode::basic_decode<bencode::flat_dict_data_view>(data);
+      auto &d = std::get<bencode::flat_dict_data_view::dict>(value);
+      expect(d.begin()->first.data(), equal_to(data.data() + 3));
+      expect(std::get<std::string_view>(d.at("bar")), equal_to("baz"));
+    });
+
+    _.test("reusing storage", []() {
+      bencode::basic_parser<bencode::flat_dict_data> parser;
+      bencode::flat_dict_data value;
+      parser.decode_into(value, "d1:ai1e1:bi2e1:ci3ee");
+      auto *storage = &*std::get<dict>(value).begin();
+      parser.decode_into(value, "d1:xi1e1:yi2ee");
+      expect(&*std::get<dict>(value).begin(), equal_to(storage));
+      expect(bencode::encode(value), equal_to("d1:xi1e1:yi2ee"));
+    });
+
+    _.test("unsorted keys", []() {
+      auto value = bencode::basic_decode<bencode::flat_dict_data>(
+        "d1:ci1e1:ai2e1:bi3ee"
+      );
+      expect(bencode::encode(value), equal_to("d1:ai2e1:bi3e1:ci1ee"));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        bencode::basic_decode<bencode::flat_dict_data>("d1:ai1e1:ai2ee");
+      }, thrown<std::invalid_argument>("duplicated key in dict: a"));
+      expect([]() {
+        bencode::basic_decode<bencode::flat_dict_data>("d1:bi1e1:ai2ee",
+                                                       bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+    });
+
+    _.test("modifying", []() {
+      dict d;
+      d["b"] = 2;
+      d["a"] = 1;
+      expect(d.begin()->first, equal_to("a"));
+      expect(d.try_emplace("a", 3).second, equal_to(false));
+      expect(d.insert_or_assign("a", 3).second, equal_to(false));
+      expect(std::get<bencode::integer>(d["a"]), equal_to(3));
+      expect(d.erase("a"), equal_to(1u));
+      expect(d.size(), equal_to(1u));
+      expect([&]() { d.at("a"); }, thrown<std::out_of_range>());
+    });
+  });
+
+  subsuite<>(_, "hash dicts", [](auto &_) {
+    using dict = bencode::hash_dict_data::dict;
+
+    _.test("decoding", []() {
+      auto value = bencode::basic_decode<bencode::hash_dict_data>(
+        "d3:bari1e3:fooli1ei2ee3:bazd1:xi1eee"
+      );
+      auto &d = std::get<dict>(value);
+      expect(d.size(), equal_to(3u));
+      expect(std::get<bencode::integer>(d.at(std::string_view("bar"))),
+             equal_to(1));
+      expect(d.contains("foo"), equal_to(true));
+      expect(d.contains("qux"), equal_to(false));
+      expect(bencode::encode(value),
+             equal_to("d3:bari1e3:bazd1:xi1ee3:fooli1ei2eee"));
+    });
+
+    _.test("views", []() {
+      std::string data("d3:bar3:baz3:quxd1:xi1eee");
+      auto value = bencode::basic_decode<bencode::hash_dict_data_view>(data);
+      auto &d = std::get<bencode::hash_dict_data_view::dict>(value);
+      expect(d.find("bar")->first.data(), equal_to(data.data() + 3));
+      expect(std::get<std::string_view>(d.at("bar")), equal_to("baz"));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        bencode::basic_decode<bencode::hash_dict_data>("d1:ai1e1:ai2ee");
+      }, thrown<std::invalid_argument>("duplicated key in dict: a"));
+      expect([]() {
+        bencode::basic_decode<bencode::hash_dict_data>("d1:bi1e1:ai2ee",
+                                                       bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+    });
+
+    _.test("many keys", []() {
+      dict d;
+      for(int i = 0; i != 1000; i++)
+        d[std::to_string(i)] = i;
+      expect(d.size(), equal_to(1000u));
+      for(int i = 0; i != 1000; i += 2)
+        expect(d.erase(std::to_string(i)), equal_to(1u));
+      expect(d.size(), equal_to(500u));
+      for(int i = 0; i != 1000; i++) {
+        auto found = d.find(std::to_string(i));
+        if(i % 2) {
+          expect(std::get<bencode::integer>(found->second), equal_to(i));
+        } else {
+          expect(found == d.end(), equal_to(true));
+        }
+      }
+    });
+  });
+
+  subsuite<>(_, "packed lists", [](auto &_) {
+    using list = bencode::packed_data::list;
+    using packing = list::packing;
+
+    _.test("integers", []() {
+      auto value = bencode::basic_decode<bencode::packed_data>("li1ei-2ei3ee");
+      auto &l = std::get<list>(value);
+      expect(l.kind(), equal_to(packing::integers));
+      expect(l.integers(), equal_to(list::integer_vector{1, -2, 3}));
+      expect(bencode::encode(value), equal_to("li1ei-2ei3ee"));
+    });
+
+    _.test("strings", []() {
+      auto value = bencode::basic_decode<bencode::packed_data>(
+        "l3:foo0:6:foobare"
+      );
+      auto &l = std::get<list>(value);
+      expect(l.kind(), equal_to(packing::strings));
+      expect(l.size(), equal_to(3u));
+      expect(l.string_at(0), equal_to("foo"));
+      expect(l.string_at(1), equal_to(""));
+      expect(l.string_at(2), equal_to("foobar"));
+      expect(bencode::encode(value), equal_to("l3:foo0:6:foobare"));
+    });
+
+    _.test("mixed", []() {
+      auto value = bencode::basic_decode<bencode::packed_data>(
+        "li1e3:fooli2ei3eee"
+      );
+      auto &l = std::get<list>(value);
+      expect(l.kind(), equal_to(packing::none));
+      expect(std::get<std::string>(l[1]), equal_to("foo"));
+      expect(std::get<list>(l[2]).kind(), equal_to(packing::integers));
+      expect(bencode::encode(value), equal_to("li1e3:fooli2ei3eee"));
+    });
+
+    _.test("unpacking", []() {
+      auto value = bencode::basic_decode<bencode::packed_data>("li1ei2ee");
+      auto &l = std::get<list>(value);
+      expect(std::get<bencode::integer>(l[1]), equal_to(2));
+      expect(l.kind(), equal_to(packing::none));
+      l.emplace_back("foo");
+      expect(bencode::encode(value), equal_to("li1ei2e3:fooe"));
+    });
+
+    _.test("const access", []() {
+      const auto ints = bencode::basic_decode<bencode::packed_data>("li1ei2ee");
+      const auto strings = bencode::basic_decode<bencode::packed_data>(
+        "l3:foo3:bare"
+      );
+      const bencode::packed_data unpacked = list{1, 2};
+      const bencode::packed_data mixed = list{1, "foo"};
+
+      expect(ints == unpacked, equal_to(true));
+      expect(strings == bencode::packed_data(list{"foo", "bar"}),
+             equal_to(true));
+      expect(ints < mixed, equal_to(true));
+      expect(mixed < strings, equal_to(true));
+      expect(ints == strings, equal_to(false));
+      expect(bencode::encode(ints), equal_to("li1ei2ee"));
+      expect(std::hash<bencode::packed_data>{}(strings),
+             equal_to(bencode::canonical_hash("l3:foo3:bare")));
+      expect(bencode::convert<bencode::data>(ints),
+             equal_to(bencode::decode("li1ei2ee")));
+
+      expect(std::get<list>(ints).kind(), equal_to(packing::integers));
+      expect(std::get<list>(strings).kind(), equal_to(packing::strings));
+    });
+
+    _.test("reusing storage", []() {
+      bencode::basic_parser<bencode::packed_data> p;
+      bencode::packed_data value;
+      p.decode_into(value, "li1ei2ei3ee");
+      p.decode_into(value, "li4ee");
+      expect(std::get<list>(value).integers(),
+             equal_to(list::integer_vector{4}));
+
+      p.decode_into(value, "ld1:ai1eee");
+      expect(std::get<list>(value).kind(), equal_to(packing::none));
+      p.decode_into(value, "l3:fooe");
+      expect(std::get<list>(value).kind(), equal_to(packing::strings));
+      expect(bencode::encode(value), equal_to("l3:fooe"));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        bencode::basic_decode<bencode::packed_data>("li1ei01ee",
+                                                    bencode::strict);
+      }, thrown<std::invalid_argument>("unexpected leading zero"));
+      expect([]() {
+        bencode::basic_decode<bencode::packed_data>("l3:foo3:ba");
+      }, thrown<std::invalid_argument>("unexpected end of string"));
+    });
+  });
+
+  subsuite<>(_, "compact data", [](auto &_) {
+    _.test("decoding", []() {
+      auto value = bencode::compact_decode(
+        "d3:bari1e3:fooli1e37:a string too long to be stored inlinee3:bazd"
+        "1:xi-1eee"
+      );
+      auto &d = value.get<bencode::compact_dict>();
+      expect(d.size(), equal_to(3u));
+      expect(d.at("bar").get<bencode::integer>(), equal_to(1));
+      auto &l = d.at("foo").get<bencode::compact_list>();
+      expect(l.size(), equal_to(2u));
+      expect(l[1].get<bencode::compact_string>(),
+             equal_to("a string too long to be stored inline"));
+      expect(d.at("baz").get<bencode::compact_dict>().at("x")
+               .get<bencode::integer>(), equal_to(-1));
+    });
+
+    _.test("reusing storage", []() {
+      bencode::compact_parser p;
+      bencode::compact_data value;
+      p.decode_into(value, "l37:a string too long to be stored inlinei1ee");
+      auto *chars = value.get<bencode::compact_list>()[0]
+                         .get<bencode::compact_string>().data();
+
+      p.decode_into(value, "l21:a shorter long stringe");
+      auto &l = value.get<bencode::compact_list>();
+      expect(l.size(), equal_to(1u));
+      expect(l[0].get<bencode::compact_string>().data(), equal_to(chars));
+      expect(l[0].get<bencode::compact_string>(),
+             equal_to("a shorter long string"));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        bencode::compact_decode("d1:ai1e1:ai2ee");
+      }, thrown<std::invalid_argument>("duplicated key in dict: a"));
+      expect([]() {
+        bencode::compact_decode("d1:bi1e1:ai2ee", bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+      expect([]() {
+        bencode::compact_decode("l3:fo");
+      }, thrown<std::invalid_argument>("unexpected end of string"));
+    });
+  });
+
+  subsuite<>(_, "pooled data", [](auto &_) {
+    _.test("decoding", []() {
+      bencode::value_pool pool;
+      auto value = pool.decode("d3:bari1e3:fooli1e4:spame3:bazd1:xi-1eee");
+      auto &d = value.get<bencode::pooled_dict>();
+      expect(d.size(), equal_to(3u));
+      expect(d.at("bar").get<bencode::integer>(), equal_to(1));
+      auto &l = d.at("foo").get<bencode::pooled_list>();
+      expect(l.size(), equal_to(2u));
+      expect(l[1].get<std::string_view>(), equal_to("spam"));
+      expect(d.at("baz").get<bencode::pooled_dict>().at("x")
+               .get<bencode::integer>(), equal_to(-1));
+      expect(d.count("qux"), equal_to(0u));
+
+      auto unsorted = pool.decode("d1:bi1e1:ai2ee");
+      expect(unsorted.get<bencode::pooled_dict>().begin()->first,
+             equal_to("a"));
+    });
+
+    _.test("deduplication", []() {
+      bencode::value_pool pool;
+      auto a = pool.decode("d3:fooli1e4:spame4:spam4:spame");
+      auto &d = a.get<bencode::pooled_dict>();
+      expect(d.at("spam").is(d.at("foo").get<bencode::pooled_list>()[1]),
+             equal_to(true));
+      expect(pool.size(), equal_to(4u));
+
+      // Subtrees (and whole documents) are only stored once.
+      auto b = pool.decode("l4:spami2eli1e4:spamee");
+      auto &l = b.get<bencode::pooled_list>();
+      expect(l[2].is(d.at("foo")), equal_to(true));
+      expect(&l[2].get<bencode::pooled_list>(),
+             equal_to(&d.at("foo").get<bencode::pooled_list>()));
+      expect(pool.size(), equal_to(5u));
+
+      expect(pool.decode("d4:spam4:spam3:fooli1e4:spamee").is(a),
+             equal_to(true));
+      expect(pool.size(), equal_to(5u));
+    });
+
+    _.test("errors", []() {
+      bencode::value_pool pool;
+      expect([&pool]() {
+        pool.decode("d1:ai1e1:ai2ee");
+      }, thrown<std::invalid_argument>("duplicated key in dict: a"));
+      expect([&pool]() {
+        pool.decode("d1:bi1e1:ci2e1:bi3ee");
+      }, thrown<std::invalid_argument>("duplicated key in dict: b"));
+      expect([&pool]() {
+        pool.decode("d1:bi1e1:ai2ee", bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+
+      auto result = pool.try_decode("l3:fo");
+      expect(result.error(), equal_to(bencode::decode_errc::unexpected_eos));
+      expect(result.offset(), equal_to(3u));
+    });
+
+    _.test("errors match try_decode", []() {
+      bencode::value_pool pool;
+      auto check = [&pool](std::string_view s, bencode::decode_mode mode) {
+        auto expected = bencode::try_decode(s, mode);
+        auto result = pool.try_decode(s, mode);
+        expect(result.error(), equal_to(expected.error()));
+        expect(result.offset(), equal_to(expected.offset()));
+      };
+
+      check("d1:bi1e1:ai2ee", bencode::strict);
+      check("d1:bi1e1:ai99999999999999999999ee", bencode::strict);
+      check("d1:ai1e1:ai99999999999999999999ee", bencode::lenient);
+      check("d1:bi1e1:ci2e1:bi3e1:di4ee", bencode::lenient);
+      check("d1:bd1:ai1ee1:ai2e1:ad1:bi1eee", bencode::lenient);
+    });
+  });
+
+  subsuite<>(_, "interned keys", [](auto &_) {
+    _.test("key_table", []() {
+      bencode::key_table table{"foo", "bar"};
+      expect(table.size(), equal_to(2u));
+
+      auto foo = table.intern("foo");
+      expect(foo.view(), equal_to("foo"));
+      expect(table.size(), equal_to(2u));
+      expect(table.intern(std::string("foo")).data(), equal_to(foo.data()));
+
+      expect(table.find("bar").has_value(), equal_to(true));
+      expect(table.find("baz").has_value(), equal_to(false));
+      auto baz = table.intern("baz");
+      expect(table.size(), equal_to(3u));
+      expect(*table.find("baz") == baz, equal_to(true));
+      expect(foo == baz, equal_to(false));
+      expect(baz < foo, equal_to(true));
+    });
+
+    _.test("interned_decode", []() {
+      bencode::key_table table;
+      auto value = bencode::interned_decode(
+        "d1:ad2:id3:abce1:q4:ping1:t2:aa1:y1:qe", table
+      );
+      expect(table.size(), equal_to(5u));
+
+      auto &dict = std::get<bencode::interned_dict>(value);
+      expect(std::get<bencode::string>(dict.at(table.intern("q"))),
+             equal_to("ping"));
+      auto &a = std::get<bencode::interned_dict>(dict.at(*table.find("a")));
+      expect(a.begin()->first.data(), equal_to(table.intern("id").data()));
+      expect(bencode::encode(value),
+             equal_to("d1:ad2:id3:abce1:q4:ping1:t2:aa1:y1:qe"));
+
+      auto other = bencode::interned_decode("d1:qi1e1:zi2ee", table);
+      auto &other_dict = std::get<bencode::interned_dict>(other);
+      expect(other_dict.begin()->first.data(), equal_to(
+        dict.find(table.intern("q"))->first.data()
+      ));
+      expect(table.size(), equal_to(6u));
+    });
+
+    _.test("reusing nodes", []() {
+      bencode::key_table table;
+      bencode::interned_parser parser(table);
+      bencode::interned_data value;
+      parser.decode_into(value, "d3:fooi1e3:zzzi2ee");
+      parser.decode_into(value, "d3:bari1e3:fooi2ee", bencode::strict);
+      expect(bencode::encode(value), equal_to("d3:bari1e3:fooi2ee"));
+      expect(table.size(), equal_to(3u));
+    });
+
+    _.test("errors", []() {
+      bencode::key_table table;
+      expect([&]() { bencode::interned_decode("d1:ai1e1:ai2ee", table); },
+             thrown<std::invalid_argument>("duplicated key in dict: a"));
+      expect([&]() {
+        bencode::interned_decode("d1:bi1e1:ai2ee", table, bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+    });
+  });
+
+#ifdef BENCODE_HAS_PMR
+  subsuite<>(_, "decoding with allocators", [](auto &_) {
+    _.test("pmr_decode", []() {
+      counting_resource resource;
+      {
+        auto value = bencode::pmr_decode(
+          "d3:fooli1e25:a string too long for SSOe3:bard1:xi2eee", &resource
+        );
+        expect(resource.allocations, greater(0u));
+
+        auto &dict = std::get<bencode::pmr_dict>(value);
+        expect(dict.get_allocator().resource(), equal_to(&resource));
+        auto &foo = std::get<bencode::pmr_list>(dict["foo"]);
+        expect(foo.get_allocator().resource(), equal_to(&resource));
+        expect(std::get<std::pmr::string>(foo[1]).get_allocator().resource(),
+               equal_to(&resource));
+        expect(std::get<bencode::pmr_dict>(dict["bar"])
+               .get_allocator().resource(), equal_to(&resource));
+        expect(bencode::encode(value), equal_to(
+          "d3:bard1:xi2ee3:fooli1e25:a string too long for SSOee"
+        ));
+      }
+      expect(resource.outstanding, equal_to(0u));
+    });
+
+    _.test("pmr_decode_view", []() {
+      counting_resource resource;
+      std::string data("d3:fooli1ei2ee3:bar3:baze");
+      auto value = bencode::pmr_decode_view(data, &resource);
+      auto &dict = std::get<bencode::pmr_dict_view>(value);
+      expect(dict.get_allocator().resource(), equal_to(&resource));
+      expect(std::get<std::string_view>(dict["bar"]).data(),
+             equal_to(data.data() + 21));
+      expect(std::get<bencode::pmr_list_view>(dict["foo"]).size(),
+             equal_to(2u));
+    });
+
+    _.test("monotonic buffer", []() {
+      counting_resource upstream;
+      std::pmr::monotonic_buffer_resource resource(4096, &upstream);
+      bencode::pmr_parser parser(&resource);
+      bencode::pmr_data value;
+      parser.decode_into(value, "d3:fooli1ei2ei3ee3:bar3:baze");
+      expect(upstream.allocations, equal_to(1u));
+      expect(bencode::encode(value), equal_to("d3:bar3:baz3:fooli1ei2ei3eee"));
+    });
+
+    _.test("strict", []() {
+      std::pmr::monotonic_buffer_resource resource;
+      expect([&]() {
+        bencode::pmr_decode("d3:fooi1e3:bari2ee", &resource, bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+    });
+  });
+#endif
+
+  subsuite<>(_, "measuring", [](auto &_) {
+    _.test("values", []() {
+      auto size = bencode::measure("i42e");
+      expect(size->values, equal_to(1u));
+      expect(size->string_bytes, equal_to(0u));
+      expect(size.offset(), equal_to(4u));
+
+      size = bencode::measure("d3:bazd0:lee3:fooli1e3:baree");
+      expect(size->values, equal_to(6u));
+      expect(size->string_bytes, equal_to(9u));
+      expect(size.offset(), equal_to(28u));
+    });
+
+    _.test("errors", []() {
+      using bencode::decode_errc;
+      expect(bencode::measure("li1e").error(),
+             equal_to(decode_errc::unexpected_eos));
+      expect(bencode::measure("e").error(),
+             equal_to(decode_errc::unexpected_e));
+      expect(bencode::measure("5:foo").error(),
+             equal_to(decode_errc::unexpected_eos));
+      expect(bencode::measure("3foo").error(),
+             equal_to(decode_errc::expected_colon));
+      expect(bencode::measure("x").error(),
+             equal_to(decode_errc::unexpected_type));
+    });
+  });
+
+  subsuite<>(_, "columnar decoding", [](auto &_) {
+    using bencode::column_type;
+    std::vector<bencode::column_spec> schema = {
+      {"complete", column_type::integer},
+      {"name", column_type::string}
+    };
+
+    _.test("columns", [schema]() {
+      auto table = bencode::decode_columns(
+        "d5:filesld8:completei5e4:name3:fooed8:completei7e4:name6:foobar5:"
+        "otherli1eeee4:infoi1ee", {"files"}, schema
+      );
+      expect(table.rows(), equal_to(2u));
+      expect(table.size(), equal_to(2u));
+
+      auto &complete = table.at("complete");
+      expect(complete.type(), equal_to(column_type::integer));
+      expect(complete.integers(), equal_to(std::vector<long long>{5, 7}));
+      expect(complete.null_count(), equal_to(0u));
+
+      auto &name = table[1];
+      expect(name.key(), equal_to("name"));
+      expect(name.string_at(0), equal_to("foo"));
+      expect(name.string_at(1), equal_to("foobar"));
+      expect(name.chars(), equal_to("foofoobar"));
+    });
+
+    _.test("root list", [schema]() {
+      auto table = bencode::decode_columns("ld4:name3:fooee", {}, schema);
+      expect(table.rows(), equal_to(1u));
+      expect(table.at("name").string_at(0), equal_to("foo"));
+    });
+
+    _.test("missing keys", [schema]() {
+      auto table = bencode::decode_columns(
+        "ld8:completei1eed4:name3:fooedee", {}, schema
+      );
+      expect(table.rows(), equal_to(3u));
+
+      auto &complete = table.at("complete");
+      expect(complete.valid(0), equal_to(true));
+      expect(complete.valid(1), equal_to(false));
+      expect(complete.integers(), equal_to(std::vector<long long>{1, 0, 0}));
+      expect(complete.null_count(), equal_to(2u));
+      expect(complete.validity(), equal_to(std::vector<std::uint64_t>{1}));
+
+      auto &name = table.at("name");
+      expect(name.validity(), equal_to(std::vector<std::uint64_t>{2}));
+      expect(name.string_at(0), equal_to(""));
+      expect(name.string_at(1), equal_to("foo"));
+      expect(table.find("other"), equal_to(nullptr));
+    });
+
+    _.test("errors", [schema]() {
+      expect([schema]() {
+        bencode::decode_columns("d4:infoi1ee", {"files"}, schema);
+      }, thrown<std::invalid_argument>("key not found: files"));
+      expect([schema]() {
+        bencode::decode_columns("ld8:complete3:fooee", {}, schema);
+      }, thrown<std::invalid_argument>("unexpected type"));
+      expect([schema]() {
+        bencode::decode_columns("ld8:completei1e8:completei2eee", {}, schema);
+      }, thrown<std::invalid_argument>("duplicated key in dict: complete"));
+      expect([schema]() {
+        bencode::decode_columns("ld4:name3:foo8:completei1eee", {}, schema,
+                                bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+      expect([schema]() {
+        bencode::decode_columns("d5:filesle5:filesi1ee", {"files"}, schema,
+                                bencode::strict);
+      }, thrown<std::invalid_argument>("duplicated key in dict: files"));
+
+      auto result = bencode::try_decode_columns("li1ee", {}, schema);
+      expect(result.error(), equal_to(bencode::decode_errc::unexpected_type));
+      expect(result.offset(), equal_to(1u));
+    });
+
+    _.test("duplicated skipped keys", [schema]() {
+      using bencode::decode_errc;
+      auto error = [schema](std::string_view s,
+                            std::vector<std::string_view> path = {}) {
+        return bencode::try_decode_columns(s, path, schema).error();
+      };
+
+      expect(error("ld8:completei1e1:xi1e1:xi2eee"),
+             equal_to(decode_errc::duplicated_key));
+      expect(error("ld1:xi1e1:ai1e1:xi2eee"),
+             equal_to(decode_errc::duplicated_key));
+      expect(error("ld1:xd1:ai1e1:ai2eeee"),
+             equal_to(decode_errc::duplicated_key));
+      expect(error("d1:xi1e1:xi2e5:filesleee", {"files"}),
+             equal_to(decode_errc::duplicated_key));
+      expect(error("d5:filesle5:filesi1ee", {"files"}),
+             equal_to(decode_errc::duplicated_key));
+
+      expect(error("ld1:xi1e1:ai1e8:completei3eed1:xi1eee"),
+             equal_to(decode_errc::ok));
+      expect(error("d1:zi1e5:filesld1:xd1:ai1eeee1:ai2ee", {"files"}),
+             equal_to(decode_errc::ok));
+    });
+  });
+
+  subsuite<>(_, "decoding into structs", [](auto &_) {
+    _.test("struct", []() {
+      auto p = bencode::decode_as<peer>("d2:ip7:1.2.3.44:porti6881ee");
+      expect(p.ip, equal_to("1.2.3.4"));
+      expect(p.port, equal_to(6881));
+    });
+
+    _.test("nested", []() {
+      auto a = bencode::decode_as<announce>(
+        "d5:extrali1ee8:intervali1800e5:peersld2:ip3:1.24:porti1eed2:ip3:3.4"
+        "4:porti2e7:unknownd1:ai1eeee4:xtra3:fooe"
+      );
+      expect(a.interval, equal_to(1800));
+      expect(a.peers.size(), equal_to(2u));
+      expect(a.peers[0].ip, equal_to("1.2"));
+      expect(a.peers[0].port, equal_to(1));
+      expect(a.peers[1].ip, equal_to("3.4"));
+      expect(a.peers[1].port, equal_to(2));
+      expect(a.failure.has_value(), equal_to(false));
+      expect(std::get<bencode::list>(a.extra), equal_to(bencode::list{1}));
+    });
+
+    _.test("optional", []() {
+      auto a = bencode::decode_as<announce>("d14:failure reason3:bade");
+      expect(*a.failure, equal_to("bad"));
+      expect(a.interval, equal_to(0));
+    });
+
+    _.test("string_view", []() {
+      std::string buf = "l3:foo3:bare";
+      auto v = bencode::decode_as<std::vector<std::string_view>>(buf);
+      expect(v, equal_to(std::vector<std::string_view>{"foo", "bar"}));
+      expect(v[0].data(), equal_to(buf.data() + 3));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        bencode::decode_as<peer>("d4:porti1e4:porti2ee");
+      }, thrown<std::invalid_argument>("duplicated key in dict: port"));
+      expect([]() {
+        bencode::decode_as<peer>("d4:port3:fooe");
+      }, thrown<std::invalid_argument>("unexpected type"));
+      expect([]() {
+        bencode::decode_as<peer>("d4:porti9999999999ee");
+      }, thrown<std::invalid_argument>("integer overflow"));
+      expect([]() {
+        bencode::decode_as<peer>("d4:porti1e2:ip1:xe", bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+      expect([]() {
+        bencode::decode_as<peer>("d7:unknownd1:ai1ei1eee");
+      }, thrown<std::invalid_argument>("expected string token"));
+
+      auto result = bencode::try_decode_as<peer>("li1ee");
+      expect(result.error(), equal_to(bencode::decode_errc::unexpected_type));
+      expect(result.offset(), equal_to(0u));
+    });
+
+    _.test("duplicated skipped keys", []() {
+      using bencode::decode_errc;
+      expect(bencode::try_decode_as<peer>("d1:ai1e1:xi1e1:xi2ee").error(),
+             equal_to(decode_errc::duplicated_key));
+      expect(bencode::try_decode_as<peer>("d1:xi1e1:ai1e1:xi2ee").error(),
+             equal_to(decode_errc::duplicated_key));
+      expect(bencode::try_decode_as<peer>("d1:xd1:ai1e1:ai2eee").error(),
+             equal_to(decode_errc::duplicated_key));
+      expect(bencode::try_decode_as<peer>("d4:porti1e1:xi1e2:ip1:xe").error(),
+             equal_to(decode_errc::ok));
+    });
+
+    _.test("deeply-nested", []() {
+      auto nested = [](std::size_t depth) {
+        std::string s;
+        for(std::size_t i = 0; i != depth; i++)
+          s += "d8:childrenl";
+        for(std::size_t i = 0; i != depth; i++)
+          s += "ee";
+        return s;
+      };
+
+      auto t = bencode::decode_as<tree>(nested(10));
+      expect(t.children.size(), equal_to(1u));
+      expect(bencode::try_decode_as<tree>(nested(100000)).error(),
+             equal_to(bencode::decode_errc::nesting_too_deep));
+    });
+  });
+
+  subsuite<>(_, "krpc", [](auto &_) {
+    using bencode::krpc::message_type;
+
+    _.test("query", []() {
+      auto msg = bencode::krpc::decode(
+        "d1:ad2:id20:abcdefghij01234567896:target20:mnopqrstuvwxyz123456e"
+        "1:q9:find_node1:t2:aa1:y1:qe"
+      );
+      expect(msg.transaction_id, equal_to("aa"));
+      expect(msg.type, equal_to(message_type::query));
+      expect(msg.method, equal_to("find_node"));
+      expect(msg.id, equal_to("abcdefghij0123456789"));
+      expect(msg.target, equal_to("mnopqrstuvwxyz123456"));
+      expect(msg.port.has_value(), equal_to(false));
+    });
+
+    _.test("response", []() {
+      auto msg = bencode::krpc::decode(
+        "d2:ip6:abcdef1:rd2:id20:mnopqrstuvwxyz1234564:porti6881e5:token8:"
+        "aoeusnth6:valuesl6:axje.u6:idhtnmee1:t2:aa1:v4:UT011:y1:re"
+      );
+      expect(msg.type, equal_to(message_type::response));
+      expect(msg.id, equal_to("mnopqrstuvwxyz123456"));
+      expect(*msg.port, equal_to(6881));
+      expect(msg.token, equal_to("aoeusnth"));
+      expect(msg.values.size(), equal_to(2u));
+      expect(std::vector<std::string_view>(msg.values.begin(),
+                                           msg.values.end()),
+             equal_to(std::vector<std::string_view>{"axje.u", "idhtnm"}));
+    });
+
+    _.test("error", []() {
+      auto msg = bencode::krpc::decode(
+        "d1:eli201e23:A Generic Error Ocurrede1:t2:aa1:y1:ee"
+      );
+      expect(msg.type, equal_to(message_type::error));
+      expect(msg.error_code, equal_to(201));
+      expect(msg.error_message, equal_to("A Generic Error Ocurred"));
+    });
+
+    _.test("unusual messages", []() {
+      // Unsorted keys and nested values in unknown keys.
+      auto msg = bencode::krpc::decode(
+        "d1:t2:aa1:y1:r1:rd2:id3:abc1:xd1:ai1ee6:valuesl2:ab3:cdeeee"
+      );
+      expect(msg.transaction_id, equal_to("aa"));
+      expect(msg.id, equal_to("abc"));
+      expect(msg.values.elements(), equal_to("2:ab3:cde"));
+      expect(msg.values.size(), equal_to(2u));
+
+      // Return values in a query are ignored.
+      msg = bencode::krpc::decode("d1:rd2:id3:abce1:t2:aa1:y1:qe");
+      expect(msg.type, equal_to(message_type::query));
+      expect(msg.id, equal_to(""));
+    });
+
+    _.test("reusing a parser", []() {
+      bencode::krpc::parser parser;
+      bencode::krpc::message msg;
+      std::string buf = "d1:rd2:id3:abc4:porti1ee1:t2:aa1:y1:re"
+                        "d1:t2:bb1:y1:qe";
+      const char *begin = buf.data(), *end = buf.data() + buf.size();
+
+      expect(parser.parse(begin, end, msg),
+             equal_to(bencode::decode_errc::ok));
+      expect(*msg.port, equal_to(1));
+      expect(parser.parse(begin, end, msg),
+             equal_to(bencode::decode_errc::ok));
+      expect(msg.transaction_id, equal_to("bb"));
+      expect(msg.port.has_value(), equal_to(false));
+      expect(begin, equal_to(end));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        bencode::krpc::decode("d1:rd2:id3:abce1:t2:aae");
+      }, thrown<std::invalid_argument>("key not found: y"));
+      expect([]() {
+        bencode::krpc::decode("d1:t2:aa1:t2:bb1:y1:qe");
+      }, thrown<std::invalid_argument>("duplicated key in dict: t"));
+      expect([]() {
+        bencode::krpc::decode("d1:t2:aa1:y1:xe");
+      }, thrown<std::invalid_argument>("unexpected type"));
+      expect([]() {
+        bencode::krpc::decode("d1:ad4:portli1eee1:t2:aa1:y1:qe");
+      }, thrown<std::invalid_argument>("unexpected type"));
+      expect([]() {
+        bencode::krpc::decode("d1:t2:aa1:y1:q1:ad2:id3:abcee",
+                              bencode::strict);
+      }, thrown<std::invalid_argument>("dict keys not sorted"));
+
+      auto result = bencode::krpc::try_decode("d1:t2:aa1:y1:q");
+      expect(result.error(), equal_to(bencode::decode_errc::unexpected_eos));
+      expect(result.offset(), equal_to(14u));
+    });
+
+    _.test("duplicated unknown keys", []() {
+      expect([]() {
+        bencode::krpc::decode("d1:t2:aa1:xi1e1:y1:q1:xi2ee");
+      }, thrown<std::invalid_argument>("duplicated key in dict: x"));
+      expect([]() {
+        bencode::krpc::decode("d1:xi1e1:t2:aa1:xi2e1:y1:qe");
+      }, thrown<std::invalid_argument>("duplicated key in dict: x"));
+      expect([]() {
+        bencode::krpc::decode("d1:ad2:id3:abc3:fooi1e3:fooi2ee1:t2:aa1:y1:qe");
+      }, thrown<std::invalid_argument>("duplicated key in dict: foo"));
+      expect([]() {
+        bencode::krpc::decode(
+          "d1:ad2:id20:abcdefghij01234567893:fooi1e3:fooi2ee1:t2:aa1:y1:qe"
+        );
+      }, thrown<std::invalid_argument>("duplicated key in dict: foo"));
+      expect([]() {
+        bencode::krpc::decode(
+          "d1:ad2:id20:abcdefghij01234567892:id3:abce1:t2:aa1:y1:qe"
+        );
+      }, thrown<std::invalid_argument>("duplicated key in dict: id"));
+    });
+  });
+
+  subsuite<>(_, "owned documents", [](auto &_) {
+    auto within = [](std::string_view s, std::string_view buf) {
+      return s.data() >= buf.data() &&
+             s.data() + s.size() <= buf.data() + buf.size();
+    };
+
+    _.test("decode", [within]() {
+      std::string data("d3:foo4:spam3:barli1ei2eee");
+      bencode::document doc(std::move(data));
+      expect(doc.empty(), equal_to(false));
+      expect(doc.buffer(), equal_to("d3:foo4:spam3:barli1ei2eee"));
+
+      auto &dict = std::get<bencode::dict_view>(*doc);
+      auto foo = std::get<bencode::string_view>(dict.at("foo"));
+      expect(foo, equal_to("spam"));
+      expect(within(foo, doc.buffer()), equal_to(true));
+      expect(within(dict.begin()->first, doc.buffer()), equal_to(true));
+    });
+
+    _.test("move and copy", [within]() {
+      bencode::document doc(std::string("l4:spame"));
+      auto view = std::get<bencode::string_view>(
+        std::get<bencode::list_view>(*doc)[0]
+      );
+
+      bencode::document moved(std::move(doc));
+      auto moved_view = std::get<bencode::string_view>(
+        std::get<bencode::list_view>(*moved)[0]
+      );
+      expect(moved_view.data(), equal_to(view.data()));
+
+      bencode::document copied(moved);
+      auto copied_view = std::get<bencode::string_view>(
+        std::get<bencode::list_view>(*copied)[0]
+      );
+      expect(copied_view, equal_to("spam"));
+      expect(within(copied_view, copied.buffer()), equal_to(true));
+      expect(within(copied_view, moved.buffer()), equal_to(false));
+
+      copied.clear();
+      expect(copied.empty(), equal_to(true));
+      copied = moved;
+      expect(copied.buffer(), equal_to("l4:spame"));
+    });
+
+    _.test("errors", []() {
+      using bencode::decode_errc;
+      bencode::document doc(std::string("i42e"));
+
+      auto result = doc.try_decode("d1:bi1e1:ai2e1:bi3ee");
+      expect(result.error(), equal_to(decode_errc::duplicated_key));
+      expect(result.offset(), equal_to(16u));
+      expect(std::get<bencode::integer>(*doc), equal_to(42));
+
+      expect([&]() { doc.decode("d1:bi1e1:ai2e1:bi3ee"); },
+             thrown<std::invalid_argument>("duplicated key in dict: b"));
+      expect([&]() { doc.decode("li1e", bencode::strict); },
+             thrown<std::invalid_argument>("unexpected end of string"));
+      expect(doc.buffer(), equal_to("i42e"));
+
+      expect(doc.try_decode("i1ei2e").has_value(), equal_to(true));
+      expect(std::get<bencode::integer>(*doc), equal_to(1));
+    });
+  });
+
+  subsuite<>(_, "shared documents", [](auto &_) {
+    _.test("decode", []() {
+      bencode::shared_document doc(std::string("d3:fooli1e4:spamee"));
+      expect(doc.empty(), equal_to(false));
+      expect(doc.use_count(), equal_to(1));
+      expect(doc.buffer(), equal_to("d3:fooli1e4:spamee"));
+
+      auto &list = std::get<bencode::list_view>(
+        std::get<bencode::dict_view>(*doc).at("foo")
+      );
+      expect(std::get<bencode::integer>(list[0]), equal_to(1));
+    });
+
+    _.test("from a document", []() {
+      bencode::document doc;
+      expect(doc.try_decode("li1ee").has_value(), equal_to(true));
+      bencode::shared_document shared(std::move(doc));
+      expect(shared.buffer(), equal_to("li1ee"));
+      expect(bencode::shared_document(bencode::document()).empty(),
+             equal_to(true));
+    });
+
+    _.test("slicing", []() {
+      bencode::shared_document slice;
+      std::string_view buffer;
+      {
+        bencode::shared_document doc(std::string("d3:fooli1e4:spamee"));
+        buffer = doc.buffer();
+        auto &list = std::get<bencode::list_view>(
+          std::get<bencode::dict_view>(*doc).at("foo")
+        );
+        slice = doc.slice(list[1]);
+        expect(doc.use_count(), equal_to(2));
+
+        auto copy = slice;
+        expect(copy.use_count(), equal_to(3));
+        expect(&*copy, equal_to(&list[1]));
+      }
+
+      expect(slice.use_count(), equal_to(1));
+      expect(slice.buffer().data(), equal_to(buffer.data()));
+      auto spam = std::get<bencode::string_view>(*slice);
+      expect(spam, equal_to("spam"));
+      expect(spam.data(), equal_to(buffer.data() + 12));
+    });
+  });
+
+  subsuite<>(_, "fixed-capacity decoding", [](auto &_) {
+    using type = bencode::flat_node::type;
+
+    _.test("scalars", []() {
+      bencode::fixed_document<1> doc;
+      doc.decode("i-42e");
+      expect(doc.size(), equal_to(1u));
+      expect(doc.root().as_integer(), equal_to(-42));
+
+      std::string data("4:spam");
+      doc.decode(data);
+      expect(doc.root().kind(), equal_to(type::string));
+      expect(doc.root().as_string(), equal_to("spam"));
+      expect(doc.root().as_string().data(), equal_to(data.data() + 2));
+    });
+
+    _.test("lists and dicts", []() {
+      bencode::fixed_document<8> doc;
+      doc.decode("d3:fooli1ei2ee3:bard1:xi3eee");
+      expect(doc.size(), equal_to(6u));
+
+      auto root = doc.root();
+      expect(root.kind(), equal_to(type::dict));
+      expect(root.size(), equal_to(2u));
+      std::vector<std::string_view> keys;
+      for(auto i : root)
+        keys.push_back(i.key());
+      expect(keys, equal_to(std::vector<std::string_view>{"foo", "bar"}));
+
+      auto foo = *root.find("foo");
+      expect(foo.kind(), equal_to(type::list));
+      expect(foo.size(), equal_to(2u));
+      expect(foo[1].as_integer(), equal_to(2));
+      expect((*(*root.find("bar")).find("x")).as_integer(), equal_to(3));
+      expect(root.find("baz") == root.end(), equal_to(true));
+    });
+
+    _.test("caller-provided storage", []() {
+      bencode::flat_node nodes[4];
+      std::string_view keys[4];
+      bencode::flat_document doc(nodes, keys);
+      expect(doc.capacity(), equal_to(4u));
+
+      doc.decode("d1:ai1e1:b0:e");
+      expect(doc.size(), equal_to(3u));
+      expect(nodes[1].integer(), equal_to(1));
+      expect(keys[2], equal_to("b"));
+    });
+
+    _.test("successive objects", []() {
+      bencode::fixed_document<4> doc;
+      std::string data("li1eei2e");
+      auto begin = data.begin();
+      doc.decode(begin, data.end());
+      expect(doc.root().size(), equal_to(1u));
+      doc.decode(begin, data.end());
+      expect(doc.root().as_integer(), equal_to(2));
+      expect(begin == data.end(), equal_to(true));
+    });
+
+    _.test("out of capacity", []() {
+      bencode::fixed_document<3> doc;
+      auto result = doc.try_decode("d1:ai1e1:bi2e1:ci3ee");
+      expect(result.error(), equal_to(bencode::decode_errc::out_of_capacity));
+      expect(result.offset(), equal_to(16u));
+      expect(doc.empty(), equal_to(true));
+
+      expect(doc.try_decode("d1:ai1e1:bi2ee").has_value(), equal_to(true));
+      expect([&]() { doc.decode("li1ei2ei3ee"); },
+             thrown<std::invalid_argument>("out of node capacity"));
+    });
+
+    _.test("errors", []() {
+      using bencode::decode_errc;
+      bencode::fixed_document<8> doc;
+
+      auto result = doc.try_decode("d1:bi1e1:ai2e1:bi3ee");
+      expect(result.error(), equal_to(decode_errc::duplicated_key));
+      expect(result.offset(), equal_to(16u));
+      expect([&]() { doc.decode("d1:bi1e1:ai2e1:bi3ee"); },
+             thrown<std::invalid_argument>("duplicated key in dict: b"));
+
+      result = doc.try_decode("d1:bi1e1:ai2ee", bencode::strict);
+      expect(result.error(), equal_to(decode_errc::unsorted_keys));
+      expect(doc.try_decode("d1:bi1e1:ai2ee").has_value(), equal_to(true));
+
+      expect(doc.try_decode("li1e").error(),
+             equal_to(decode_errc::unexpected_eos));
+      expect(doc.try_decode("e").error(),
+             equal_to(decode_errc::unexpected_e));
+      expect(doc.try_decode("di1ei2ee").error(),
+             equal_to(decode_errc::expected_string));
+    });
+  });
+
   subsuite<>(_, "decoding integers", [](auto &_) {
     using udata = bencode::basic_data<
       std::variant, unsigned long long, std::string, std::vector,
@@ -252,6 +1520,78 @@ suite<> test_decode("test decoder", [](auto &_) {
     });
   });
 
+  subsuite<>(_, "decoding big integers", [](auto &_) {
+    using bencode::big_data;
+    using bencode::big_data_view;
+    using bencode::big_integer;
+    using bencode::big_integer_view;
+
+    _.test("small values", []() {
+      auto value = bencode::basic_decode<big_data>("i-42e");
+      auto &i = std::get<big_integer>(value);
+      expect(i.is_small(), equal_to(true));
+      expect(i.small(), equal_to(-42));
+
+      value = bencode::basic_decode<big_data>("i-9223372036854775808e");
+      expect(std::get<big_integer>(value).small(),
+             equal_to(-9223372036854775807LL - 1));
+    });
+
+    _.test("big values", []() {
+      auto value = bencode::basic_decode<big_data>("i18446744073709551615e");
+      auto &i = std::get<big_integer>(value);
+      expect(i.is_small(), equal_to(false));
+      expect(i.negative(), equal_to(false));
+      expect(i.digits(), equal_to("18446744073709551615"));
+      expect(*i.as<std::uint64_t>(), equal_to(18446744073709551615ULL));
+      expect(i.as<long long>().has_value(), equal_to(false));
+
+      value = bencode::basic_decode<big_data>(
+        "i-123456789012345678901234567890e"
+      );
+      expect(std::get<big_integer>(value).to_string(),
+             equal_to("-123456789012345678901234567890"));
+    });
+
+    _.test("views", []() {
+      std::string buf = "li1ei99999999999999999999ee";
+      auto value = bencode::basic_decode<big_data_view>(buf);
+      auto &list = std::get<big_data_view::list>(value);
+      expect(std::get<big_integer_view>(list[0]).small(), equal_to(1));
+      auto &big = std::get<big_integer_view>(list[1]);
+      expect(big.digits(), equal_to("99999999999999999999"));
+      expect(big.digits().data(), equal_to(buf.data() + 5));
+    });
+
+    _.test("from a stream", []() {
+      std::istringstream ss("i-99999999999999999999e");
+      auto value = bencode::basic_decode<big_data>(ss);
+      expect(std::get<big_integer>(value).to_string(),
+             equal_to("-99999999999999999999"));
+    });
+
+    _.test("leading zeros", []() {
+      auto value = bencode::basic_decode<big_data>(
+        "i-000000000000000000000042e"
+      );
+      expect(std::get<big_integer>(value).small(), equal_to(-42));
+
+      expect([]() {
+        bencode::basic_decode<big_data>("i0099999999999999999999e",
+                                        bencode::strict);
+      }, thrown<std::invalid_argument>("unexpected leading zero"));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        bencode::basic_decode<big_data>("i99999999999999999999");
+      }, thrown<std::invalid_argument>("unexpected end of string"));
+      expect([]() {
+        bencode::basic_decode<big_data>("i99999999999999999999xe");
+      }, thrown<std::invalid_argument>("expected 'e'"));
+    });
+  });
+
   subsuite<>(_, "error handling", [](auto &_) {
     _.test("unexpected type", []() {
       expect([]() { bencode::decode("x"); },
@@ -293,4 +1633,124 @@ suite<> test_decode("test decoder", [](auto &_) {
     });
   });
 
+  subsuite<>(_, "strict decoding", [](auto &_) {
+    using bencode::decode_errc;
+
+    _.test("canonical data", []() {
+      auto value = bencode::decode(
+        "d" "3:bar" "i0e" "3:foo" "l" "i-42e" "0:" "e" "e", bencode::strict
+      );
+      auto dict = std::get<bencode::dict>(value);
+      expect(std::get<bencode::integer>(dict["bar"]), equal_to(0));
+      expect(std::get<bencode::string>(
+        std::get<bencode::list>(dict["foo"])[1]
+      ), equal_to(""));
+    });
+
+    _.test("non-canonical data", []() {
+      auto check = [](const char *data, decode_errc error,
+                      std::size_t offset) {
+        expect(bencode::try_decode(data).has_value(), equal_to(true));
+        auto result = bencode::try_decode(data, bencode::strict);
+        expect(result.error(), equal_to(error));
+        expect(result.offset(), equal_to(offset));
+        expect(bencode::is_canonical(data), equal_to(false));
+      };
+
+      check("ie", decode_errc::expected_digit, 1);
+      check("i-0e", decode_errc::negative_zero, 2);
+      check("i03e", decode_errc::leading_zero, 2);
+      check("i-03e", decode_errc::negative_zero, 2);
+      check("03:foo", decode_errc::leading_zero, 1);
+      check("d3:fooi1e3:bari2ee", decode_errc::unsorted_keys, 14);
+      check("d1:ad1:bi1e1:ai2eee", decode_errc::unsorted_keys, 14);
+    });
+
+    _.test("duplicated key", []() {
+      auto result = bencode::try_decode("d3:fooi1e3:fooi1ee", bencode::strict);
+      expect(result.error(), equal_to(decode_errc::duplicated_key));
+      expect([]() { bencode::decode("d3:fooi1e3:fooi1ee", bencode::strict); },
+             thrown<std::invalid_argument>("duplicated key in dict: foo"));
+      expect(bencode::is_canonical("d3:fooi1e3:fooi1ee"), equal_to(false));
+    });
+
+    _.test("is_canonical", []() {
+      expect(bencode::is_canonical("i0e"), equal_to(true));
+      expect(bencode::is_canonical("i-1e"), equal_to(true));
+      expect(bencode::is_canonical("i123456789012345678901234567890e"),
+             equal_to(true));
+      expect(bencode::is_canonical("0:"), equal_to(true));
+      expect(bencode::is_canonical("d1:ai1e1:bd1:ai1e1:bi2eee"),
+             equal_to(true));
+      expect(bencode::is_canonical("i0ei1e"), equal_to(false));
+      expect(bencode::is_canonical("li1e"), equal_to(false));
+      expect(bencode::is_canonical("x"), equal_to(false));
+    });
+  });
+
+  subsuite<>(_, "non-throwing decoding", [](auto &_) {
+    using bencode::decode_errc;
+
+    _.test("success", []() {
+      auto result = bencode::try_decode("d4:spami42ee");
+      expect(result.has_value(), equal_to(true));
+      expect(result.error(), equal_to(decode_errc::ok));
+      expect(result.offset(), equal_to(12u));
+      expect(std::get<bencode::integer>(
+        std::get<bencode::dict>(*result).at("spam")
+      ), equal_to(42));
+    });
+
+    _.test("success (view)", []() {
+      std::string data("l4:spame");
+      auto result = bencode::try_decode_view(data);
+      expect(result.has_value(), equal_to(true));
+      expect(std::get<bencode::string_view>(
+        std::get<bencode::list_view>(*result)[0]
+      ), equal_to("spam"));
+    });
+
+    _.test("successive objects", []() {
+      std::string data("i42e4:goat");
+      auto begin = data.begin(), end = data.end();
+
+      auto first = bencode::try_decode(begin, end);
+      expect(std::get<bencode::integer>(*first), equal_to(42));
+      expect(first.offset(), equal_to(4u));
+
+      auto second = bencode::try_decode(begin, end);
+      expect(std::get<bencode::string>(*second), equal_to("goat"));
+      expect(second.offset(), equal_to(6u));
+    });
+
+    _.test("errors", []() {
+      auto check = [](const char *data, decode_errc error,
+                      std::size_t offset) {
+        auto result = bencode::try_decode(data);
+        expect(result.has_value(), equal_to(false));
+        expect(result.error(), equal_to(error));
+        expect(result.offset(), equal_to(offset));
+      };
+
+      check("", decode_errc::unexpected_eos, 0);
+      check("x", decode_errc::unexpected_type, 0);
+      check("e", decode_errc::unexpected_e, 0);
+      check("i", decode_errc::unexpected_eos, 1);
+      check("li1e3:as", decode_errc::unexpected_eos, 6);
+      check("i123i", decode_errc::expected_e, 4);
+      check("l1abce", decode_errc::expected_colon, 2);
+      check("di123ee", decode_errc::expected_string, 1);
+      check("i9223372036854775808e", decode_errc::integer_overflow, 20);
+      check("i-9223372036854775809e", decode_errc::integer_underflow, 21);
+      check("d3:fooi1e3:fooi1ee", decode_errc::duplicated_key, 14);
+    });
+
+    _.test("error messages", []() {
+      expect(bencode::error_message(decode_errc::unexpected_eos),
+             equal_to(std::string("unexpected end of string")));
+      expect(bencode::error_message(decode_errc::duplicated_key),
+             equal_to(std::string("duplicated key in dict")));
+    });
+  });
+
 });
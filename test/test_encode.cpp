@@ -3,6 +3,13 @@ using namespace mettle;
 
 #include "bencode.hpp"
 
+struct torrent_file {
+  long long length = 0;
+  std::vector<std::string> path;
+  std::optional<std::string> md5sum;
+};
+BENCODE_FIELDS(torrent_file, path, length, md5sum);
+
 suite<> test_encode("test encoder", [](auto &_) {
 
   _.test("integer", []() {
@@ -50,6 +57,143 @@ suite<> test_encode("test encoder", [](auto &_) {
     "e"));
   });
 
+  _.test("bytes", []() {
+    std::string raw("\x01\xff");
+    bencode::bytes_view bytes(raw);
+    expect(bencode::encode(bytes), equal_to("2:\x01\xff"));
+
+    bencode::byte_data_view d = bencode::dict_byte_view{
+      {bencode::bytes_view("foo"), bytes}
+    };
+    expect(bencode::encode(d), equal_to("d3:foo2:\x01\xff" "e"));
+
+#ifdef BENCODE_HAS_SPAN
+    std::vector<std::uint8_t> data = {'a', 'b'};
+    expect(bencode::encode(std::span<const std::uint8_t>(data)),
+           equal_to("2:ab"));
+#endif
+  });
+
+  _.test("flat_dict", []() {
+    using dict = bencode::flat_dict_data::dict;
+    bencode::flat_dict_data d = dict{
+      {"foo", 1}, {"bar", dict{{"baz", "x"}}}
+    };
+    expect(bencode::encode(d), equal_to("d3:bard3:baz1:xe3:fooi1ee"));
+  });
+
+  _.test("hash_dict", []() {
+    using dict = bencode::hash_dict_data::dict;
+    dict d{{"foo", 1}, {"bar", dict{{"baz", "x"}}}};
+    expect(bencode::encode(d), equal_to("d3:bard3:baz1:xe3:fooi1ee"));
+
+    d.cache_order(true);
+    expect(bencode::encode(d), equal_to("d3:bard3:baz1:xe3:fooi1ee"));
+    d["abc"] = 2;
+    expect(bencode::encode(d),
+           equal_to("d3:abci2e3:bard3:baz1:xe3:fooi1ee"));
+  });
+
+  _.test("packed_list", []() {
+    using list = bencode::packed_data::list;
+    list ints, strings;
+    for(int i = 0; i != 3; i++) {
+      ints.push_integer(i);
+      strings.push_string(std::string(i, 'x'));
+    }
+    expect(bencode::encode(ints), equal_to("li0ei1ei2ee"));
+    expect(bencode::encode(strings), equal_to("l0:1:x2:xxe"));
+    expect(bencode::encode(list{1, "foo"}), equal_to("li1e3:fooe"));
+  });
+
+  _.test("compact_data", []() {
+    bencode::compact_data value = bencode::compact_dict{
+      {"foo", 1},
+      {"bar", bencode::compact_list{"baz", "a string stored on the heap"}}
+    };
+    expect(bencode::encode(value),
+           equal_to("d3:barl3:baz27:a string stored on the heape3:fooi1ee"));
+  });
+
+  _.test("pooled_data", []() {
+    bencode::value_pool pool;
+    auto value = pool.decode("d3:fooi1e3:barl3:baz3:bazee");
+    expect(bencode::encode(value), equal_to("d3:barl3:baz3:baze3:fooi1ee"));
+  });
+
+  _.test("struct", []() {
+    torrent_file f{42, {"dir", "file"}, std::nullopt};
+    expect(bencode::encode(f), equal_to("d6:lengthi42e4:pathl3:dir4:fileee"));
+
+    f.md5sum = "abc";
+    expect(bencode::encode(std::vector<torrent_file>{f}),
+           equal_to("ld6:lengthi42e6:md5sum3:abc4:pathl3:dir4:fileeee"));
+  });
+
+  _.test("krpc", []() {
+    using bencode::krpc::message_type;
+    char buf[128];
+
+    bencode::krpc::message query;
+    query.transaction_id = "aa";
+    query.method = "ping";
+    query.id = "abcdefghij0123456789";
+    auto size = bencode::krpc::encode(buf, query);
+    expect(std::string(buf, size), equal_to(
+      "d1:ad2:id20:abcdefghij0123456789e1:q4:ping1:t2:aa1:y1:qe"
+    ));
+
+    bencode::krpc::message reply;
+    reply.transaction_id = "aa";
+    reply.type = message_type::response;
+    reply.id = "mnopqrstuvwxyz123456";
+    reply.token = "aoeusnth";
+    size = bencode::krpc::encode(buf, reply,
+                                 std::vector<std::string>{"axje.u"});
+    expect(std::string(buf, size), equal_to(
+      "d1:rd2:id20:mnopqrstuvwxyz1234565:token8:aoeusnth6:valuesl6:axje.uee"
+      "1:t2:aa1:y1:re"
+    ));
+
+    bencode::krpc::message error;
+    error.transaction_id = "aa";
+    error.type = message_type::error;
+    error.error_code = 201;
+    error.error_message = "A Generic Error Ocurred";
+    size = bencode::krpc::encode(buf, error);
+    expect(std::string(buf, size), equal_to(
+      "d1:eli201e23:A Generic Error Ocurrede1:t2:aa1:y1:ee"
+    ));
+
+    expect(bencode::krpc::encode(buf, 10, error), equal_to(0u));
+  });
+
+  _.test("key_literal", []() {
+    constexpr bencode::key_literal info("info");
+    expect(bencode::encode(info), equal_to("4:info"));
+  });
+
+  _.test("big_integer", []() {
+    expect(bencode::encode(bencode::big_integer(42)), equal_to("i42e"));
+    expect(bencode::encode(bencode::big_integer(true, "99999999999999999999")),
+           equal_to("i-99999999999999999999e"));
+
+    std::string buf = "li1ei18446744073709551616ee";
+    expect(bencode::encode(bencode::basic_decode<bencode::big_data_view>(buf)),
+           equal_to(buf));
+  });
+
+  _.test("encode_bytes", []() {
+    auto bytes = bencode::encode_bytes(bencode::list{1, "foo"});
+    std::string expected("li1e3:fooe");
+    expect(bytes.size(), equal_to(expected.size()));
+    expect(std::memcmp(bytes.data(), expected.data(), expected.size()),
+           equal_to(0));
+
+    auto u8 = bencode::encode_bytes<std::uint8_t>(42);
+    expect(u8, equal_to(std::vector<std::uint8_t>{'i', '4', '2', 'e'}));
+  });
+
   subsuite<>(_, "vector", [](auto &_) {
     _.test("vector<int>", []() {
       std::vector<int> v = {1, 2, 3};